@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#include "bytecode.hpp"
+
+const char* opcodeToString(Opcode opcode) {
+    static const char* names[] = {
+#define STARSHIP_OPCODE_NAME(name) #name,
+        STARSHIP_OPCODES(STARSHIP_OPCODE_NAME)
+#undef STARSHIP_OPCODE_NAME
+    };
+
+    return names[static_cast<std::size_t>(opcode)];
+}
+
+// Registers are handed out like a stack: a scope's locals stay until it ends, temporaries only
+// until the instruction that uses them. Arguments go in the topmost registers, so the callee's
+// registers can start right there and nothing has to be copied.
+class BytecodeCompiler {
+public:
+    explicit BytecodeCompiler(Diagnostics& diagnostics) : diagnostics(diagnostics) {}
+
+    BytecodeProgram compile(ASTTree* tree) {
+        // Functions and globals get their numbers first, calls can go to functions further down
+        for (ASTNodeBase* statement : tree->statements) {
+            if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+                functionIndices[function->name] = static_cast<std::int32_t>(program.functions.size());
+                program.functions.emplace_back();
+                program.functions.back().name = function->name;
+            } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+                declareGlobal(declaration);
+            }
+        }
+
+        for (ASTNodeBase* statement : tree->statements) {
+            if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+                compileFunction(function);
+            }
+        }
+
+        auto main = functionIndices.find("main");
+        if (main == functionIndices.end()) {
+            diagnostics.error("There is no main function to run");
+        }
+        program.mainFunction = main->second;
+
+        return std::move(program);
+    }
+
+private:
+    // The register of a local, arrays hold a pointer to their elements
+    struct Local {
+        std::int32_t reg;
+    };
+
+    void declareGlobal(VariableDeclarationNode* declaration) {
+        if (declaration->constant) {
+            constantArrays[declaration->name] = addConstantArray(declaration->values);
+            return;
+        }
+
+        LiteralNode* literal = dynamic_cast<LiteralNode*>(declaration->value);
+        if (!literal) {
+            diagnostics.error("The value of top level variable " + declaration->name + " must be a constant",
+                              declaration->line);
+        }
+
+        Value value;
+        if (literal->value.isInt()) {
+            value.integer = literal->value.getInt();
+        } else {
+            value.string = internString(literal->value.getString());
+        }
+
+        globalIndices[declaration->name] = static_cast<std::int32_t>(program.globals.size());
+        program.globals.push_back(value);
+    }
+
+    std::int32_t addConstantArray(const std::vector<int>& values) {
+        program.arrayData.push_back(static_cast<std::int32_t>(values.size()));
+        std::int32_t offset = static_cast<std::int32_t>(program.arrayData.size());
+        program.arrayData.insert(program.arrayData.end(), values.begin(), values.end());
+        return offset;
+    }
+
+    std::int32_t internString(const std::string& text) {
+        auto existing = stringIndices.find(text);
+        if (existing != stringIndices.end()) {
+            return existing->second;
+        }
+
+        std::int32_t index = static_cast<std::int32_t>(program.strings.size());
+        program.strings.push_back(text);
+        stringIndices[text] = index;
+        return index;
+    }
+
+    void compileFunction(FunctionNode* functionNode) {
+        function = &program.functions[functionIndices.at(functionNode->name)];
+        function->parameterCount = static_cast<std::int32_t>(functionNode->parameters.parameters.size());
+
+        nextRegister = 0;
+        scopes.clear();
+        scopes.emplace_back();
+        for (Variable* parameter : functionNode->parameters.parameters) {
+            if (parameter->structType) {
+                diagnostics.error("Parameter " + parameter->name + " of " + functionNode->name +
+                                  " is a struct, structs can't be interpreted yet, build the program instead");
+            }
+            scopes.back()[parameter->name] = {allocateRegister()};
+        }
+
+        compileStatements(functionNode->body->statements);
+        line = functionNode->returnValue->line;
+        emit(Opcode::RETURN, compileOperand(functionNode->returnValue));
+    }
+
+    std::int32_t allocateRegister() {
+        std::int32_t reg = nextRegister++;
+        function->registerCount = std::max(function->registerCount, nextRegister);
+        return reg;
+    }
+
+    std::size_t emit(Opcode opcode, std::int32_t a = 0, std::int32_t b = 0, std::int32_t c = 0) {
+        Instruction instruction;
+        instruction.opcode = opcode;
+        instruction.a = a;
+        instruction.b = b;
+        instruction.c = c;
+        function->code.push_back(instruction);
+        function->lines.push_back(line);
+        return function->code.size() - 1;
+    }
+
+    std::int32_t here() const {
+        return static_cast<std::int32_t>(function->code.size());
+    }
+
+    const Local* findLocal(const std::string& name) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto local = scope->find(name);
+            if (local != scope->end()) {
+                return &local->second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void compileStatements(const std::vector<ASTNodeBase*>& statements) {
+        for (ASTNodeBase* statement : statements) {
+            compileStatement(statement);
+        }
+    }
+
+    // Statements get a scope of their own, their registers are free again once it ends
+    void compileBlock(const std::vector<ASTNodeBase*>& statements) {
+        std::int32_t mark = nextRegister;
+        scopes.emplace_back();
+        compileStatements(statements);
+        scopes.pop_back();
+        nextRegister = mark;
+    }
+
+    void compileStatement(ASTNodeBase* statement) {
+        std::int32_t mark = nextRegister;
+
+        if (PrintNode* printNode = dynamic_cast<PrintNode*>(statement)) {
+            line = printNode->expression->line;
+            std::int32_t value = compileOperand(printNode->expression);
+            emit(printNode->type == TokenType::STRING ? Opcode::PRINT_STRING : Opcode::PRINT_INT, value);
+        } else if (CallNode* callNode = dynamic_cast<CallNode*>(statement)) {
+            compileExpression(callNode, allocateRegister());
+        } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            compileDeclaration(declaration);
+            return; // The local keeps its register
+        } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(statement)) {
+            compileAssignment(assignment);
+        } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(statement)) {
+            // The condition goes at the bottom, every iteration takes one branch
+            std::size_t entry = emit(Opcode::JUMP);
+            std::int32_t body = here();
+            compileBlock(whileNode->body);
+            function->code[entry].a = here();
+            compileLoopCondition(whileNode->condition, body);
+        } else if (ForNode* forNode = dynamic_cast<ForNode*>(statement)) {
+            scopes.emplace_back();
+            if (forNode->initializer) {
+                compileStatement(forNode->initializer);
+            }
+
+            std::size_t entry = emit(Opcode::JUMP);
+            std::int32_t body = here();
+            compileBlock(forNode->body);
+            compileStatement(forNode->step);
+            function->code[entry].a = here();
+            compileLoopCondition(forNode->condition, body);
+            scopes.pop_back();
+        } else {
+            diagnostics.error("Statement can't be compiled to bytecode");
+        }
+
+        nextRegister = mark;
+    }
+
+    void compileDeclaration(VariableDeclarationNode* declaration) {
+        line = declaration->line;
+        std::int32_t reg = allocateRegister();
+
+        if (declaration->structType) {
+            diagnostics.error("Structs can't be interpreted yet, build the program instead", declaration->line);
+        }
+
+        if (declaration->constant) {
+            emit(Opcode::CONSTANT_ARRAY, reg, addConstantArray(declaration->values));
+        } else if (declaration->arrayLength > 0) {
+            // Every array of the function has its own place, the length goes first
+            emit(Opcode::NEW_ARRAY, reg, function->arraySpace + 1, static_cast<std::int32_t>(declaration->arrayLength));
+            function->arraySpace += static_cast<std::int32_t>(declaration->arrayLength) + 1;
+        } else {
+            // The value can't refer to the variable itself, so it's fine to compute it right into its register
+            std::int32_t mark = nextRegister;
+            compileExpression(declaration->value, reg);
+            nextRegister = mark;
+        }
+
+        scopes.back()[declaration->name] = {reg};
+    }
+
+    void compileAssignment(AssignmentNode* assignment) {
+        line = assignment->line;
+
+        if (assignment->index) {
+            std::int32_t array = compileArray(assignment->name);
+            std::int32_t index = compileOperand(assignment->index);
+            std::int32_t value = compileOperand(assignment->value);
+            line = assignment->line;
+            emit(Opcode::STORE_ELEMENT, array, index, value);
+            return;
+        }
+
+        if (const Local* local = findLocal(assignment->name)) {
+            compileExpression(assignment->value, local->reg);
+            return;
+        }
+
+        std::int32_t value = compileOperand(assignment->value);
+        emit(Opcode::STORE_GLOBAL, globalIndices.at(assignment->name), value);
+    }
+
+    // Jumps to target while condition holds
+    void compileLoopCondition(ExpressionNode* condition, std::int32_t target) {
+        std::int32_t mark = nextRegister;
+        line = condition->line;
+
+        BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(condition);
+        if (binaryNode && binaryNode->operatorType == TokenType::LESS) {
+            std::int32_t left = compileOperand(binaryNode->left);
+            std::int32_t right = compileOperand(binaryNode->right);
+            line = condition->line;
+            emit(Opcode::JUMP_IF_LESS, left, right, target);
+        } else {
+            emit(Opcode::JUMP_IF_NOT_ZERO, compileOperand(condition), target);
+        }
+
+        nextRegister = mark;
+    }
+
+    // The register that holds the value, locals are used where they are
+    std::int32_t compileOperand(ExpressionNode* expression) {
+        VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(expression);
+        if (reference) {
+            if (const Local* local = findLocal(reference->name)) {
+                return local->reg;
+            }
+        }
+
+        std::int32_t reg = allocateRegister();
+        compileExpression(expression, reg);
+        return reg;
+    }
+
+    std::int32_t compileArray(const std::string& name) {
+        if (const Local* local = findLocal(name)) {
+            return local->reg;
+        }
+
+        std::int32_t reg = allocateRegister();
+        emit(Opcode::CONSTANT_ARRAY, reg, constantArrays.at(name));
+        return reg;
+    }
+
+    void compileExpression(ExpressionNode* expression, std::int32_t target) {
+        std::int32_t mark = nextRegister;
+        line = expression->line;
+
+        if (LiteralNode* literal = dynamic_cast<LiteralNode*>(expression)) {
+            if (literal->value.isInt()) {
+                emit(Opcode::LOAD_INT, target, literal->value.getInt());
+            } else {
+                emit(Opcode::LOAD_STRING, target, internString(literal->value.getString()));
+            }
+        } else if (VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(expression)) {
+            if (const Local* local = findLocal(reference->name)) {
+                if (local->reg != target) {
+                    emit(Opcode::MOVE, target, local->reg);
+                }
+            } else {
+                emit(Opcode::LOAD_GLOBAL, target, globalIndices.at(reference->name));
+            }
+        } else if (IndexNode* indexNode = dynamic_cast<IndexNode*>(expression)) {
+            std::int32_t array = compileArray(indexNode->name);
+            std::int32_t index = compileOperand(indexNode->index);
+            line = indexNode->line;
+            emit(Opcode::LOAD_ELEMENT, target, array, index);
+        } else if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(expression)) {
+            compileBinaryExpression(binaryNode, target);
+        } else if (CallNode* callNode = dynamic_cast<CallNode*>(expression)) {
+            // The arguments go in the registers the callee starts with
+            std::int32_t base = nextRegister;
+            for (ExpressionNode* argument : callNode->arguments) {
+                compileExpression(argument, allocateRegister());
+            }
+            line = callNode->line;
+            emit(Opcode::CALL, target, functionIndices.at(callNode->name), base);
+        } else {
+            diagnostics.error("Expression can't be compiled to bytecode", expression->line);
+        }
+
+        nextRegister = mark;
+    }
+
+    void compileBinaryExpression(BinaryExpressionNode* binaryNode, std::int32_t target) {
+        // x + 1 and 1 + x, counters are everywhere
+        if (binaryNode->operatorType == TokenType::PLUS) {
+            LiteralNode* literal = dynamic_cast<LiteralNode*>(binaryNode->right);
+            ExpressionNode* other = binaryNode->left;
+            if (!literal) {
+                literal = dynamic_cast<LiteralNode*>(binaryNode->left);
+                other = binaryNode->right;
+            }
+
+            if (literal) {
+                std::int32_t operand = compileOperand(other);
+                line = binaryNode->line;
+                emit(Opcode::ADD_INT, target, operand, literal->value.getInt());
+                return;
+            }
+        }
+
+        std::int32_t left = compileOperand(binaryNode->left);
+        std::int32_t right = compileOperand(binaryNode->right);
+        line = binaryNode->line;
+
+        static const std::map<TokenType, Opcode> opcodes = {
+            {TokenType::PLUS, Opcode::ADD},
+            {TokenType::MINUS, Opcode::SUBTRACT},
+            {TokenType::STAR, Opcode::MULTIPLY},
+            {TokenType::SLASH, Opcode::DIVIDE},
+            {TokenType::LESS, Opcode::LESS},
+            {TokenType::LESS_EQUAL, Opcode::LESS_EQUAL},
+            {TokenType::GREATER, Opcode::GREATER},
+            {TokenType::GREATER_EQUAL, Opcode::GREATER_EQUAL},
+            {TokenType::EQUAL_EQUAL, Opcode::EQUAL},
+            {TokenType::BANG_EQUAL, Opcode::NOT_EQUAL},
+        };
+
+        auto opcode = opcodes.find(binaryNode->operatorType);
+        if (opcode == opcodes.end()) {
+            diagnostics.error("Invalid operator " + tokenTypeToString(binaryNode->operatorType), binaryNode->line);
+        }
+        emit(opcode->second, target, left, right);
+    }
+
+    Diagnostics& diagnostics;
+    BytecodeProgram program;
+
+    std::map<std::string, std::int32_t> functionIndices;
+    std::map<std::string, std::int32_t> globalIndices;
+    std::map<std::string, std::int32_t> constantArrays; // Their offset in the program's array data
+    std::map<std::string, std::int32_t> stringIndices;
+
+    // The function being compiled
+    BytecodeFunction* function = nullptr;
+    std::vector<std::map<std::string, Local>> scopes;
+    std::int32_t nextRegister = 0;
+    std::size_t line = 0; // Of the node being compiled, every instruction records it
+};
+
+BytecodeProgram compileBytecode(ASTTree* tree, const CompilerOptions& options, Diagnostics& diagnostics) {
+    logStream(options) << "RUNNING: Starting Bytecode Generation\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    BytecodeProgram program = BytecodeCompiler(diagnostics).compile(tree);
+
+    if (options.debugMode) {
+        printBytecode(program, logStream(options));
+    }
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: Bytecode Generation took " << seconds << " seconds\n";
+
+    return program;
+}
+
+void printBytecode(const BytecodeProgram& program, std::ostream& stream) {
+    for (const BytecodeFunction& function : program.functions) {
+        stream << function.name << ": " << function.parameterCount << " parameters, " << function.registerCount
+               << " registers, " << function.arraySpace << " array elements\n";
+
+        for (std::size_t i = 0; i < function.code.size(); ++i) {
+            const Instruction& instruction = function.code[i];
+            stream << "  " << i << "\t" << opcodeToString(instruction.opcode) << " " << instruction.a << " "
+                   << instruction.b << " " << instruction.c << "\t(line " << function.lines[i] << ")\n";
+        }
+    }
+}
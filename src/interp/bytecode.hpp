@@ -0,0 +1,90 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../parser/parser.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+
+// Every instruction works on the registers of the current call, a, b and c are register numbers unless
+// noted otherwise. Jump targets are instruction indices in the same function.
+#define STARSHIP_OPCODES(X)                                                                              \
+    X(LOAD_INT)        /* a = the number b */                                                            \
+    X(LOAD_STRING)     /* a = string b of the program */                                                 \
+    X(MOVE)            /* a = b */                                                                       \
+    X(LOAD_GLOBAL)     /* a = global b */                                                                \
+    X(STORE_GLOBAL)    /* global a = b */                                                                \
+    X(ADD)             /* a = b + c, they all wrap around */                                             \
+    X(SUBTRACT)                                                                                          \
+    X(MULTIPLY)                                                                                          \
+    X(DIVIDE)                                                                                            \
+    X(ADD_INT)         /* a = b + the number c, for counters */                                          \
+    X(LESS)            /* a = b < c, comparisons give 0 or 1 */                                          \
+    X(LESS_EQUAL)                                                                                        \
+    X(GREATER)                                                                                           \
+    X(GREATER_EQUAL)                                                                                     \
+    X(EQUAL)                                                                                             \
+    X(NOT_EQUAL)                                                                                         \
+    X(JUMP)            /* to a */                                                                        \
+    X(JUMP_IF_ZERO)    /* to b if a is 0 */                                                              \
+    X(JUMP_IF_NOT_ZERO)                                                                                  \
+    X(JUMP_IF_LESS)    /* to c if a < b, the usual loop condition in one instruction */                  \
+    X(NEW_ARRAY)       /* a = a zeroed array at offset b of the call's array space, c elements */         \
+    X(CONSTANT_ARRAY)  /* a = the @comptime array at offset b of the program's array data */             \
+    X(LOAD_ELEMENT)    /* a = b[c] */                                                                    \
+    X(STORE_ELEMENT)   /* a[b] = c */                                                                    \
+    X(CALL)            /* a = function b, its arguments are in c and up, which become its registers */   \
+    X(RETURN)          /* returns a */                                                                   \
+    X(PRINT_INT)       /* print(a) */                                                                    \
+    X(PRINT_STRING)
+
+enum class Opcode : std::uint8_t {
+#define STARSHIP_OPCODE_ENUM(name) name,
+    STARSHIP_OPCODES(STARSHIP_OPCODE_ENUM)
+#undef STARSHIP_OPCODE_ENUM
+};
+
+struct Instruction {
+    Opcode opcode;
+    std::int32_t a = 0;
+    std::int32_t b = 0;
+    std::int32_t c = 0;
+};
+
+// What a register holds. Arrays point at their first element, the length is stored right before it.
+union Value {
+    std::int32_t integer;
+    std::int32_t string; // An index into BytecodeProgram::strings, strings never change
+    std::int32_t* array;
+};
+
+struct BytecodeFunction {
+    std::string name;
+    std::vector<Instruction> code;
+    std::vector<std::size_t> lines; // The source line of every instruction, for runtime errors
+
+    std::int32_t parameterCount = 0;
+    std::int32_t registerCount = 0; // Parameters first, then locals and temporaries
+    std::int32_t arraySpace = 0;    // Elements of every local array, plus one length each
+};
+
+struct BytecodeProgram {
+    std::vector<BytecodeFunction> functions;
+    std::vector<std::string> strings;
+    std::vector<Value> globals;           // Their initial values
+    std::vector<std::int32_t> arrayData;  // @comptime arrays, each one's length followed by the elements
+    std::int32_t mainFunction = -1;
+};
+
+// Lowers the parsed program to bytecode for `starship interp`, no LLVM involved
+BytecodeProgram compileBytecode(ASTTree* tree, const CompilerOptions& options, Diagnostics& diagnostics);
+
+// Writes the bytecode in a readable form, for -d
+void printBytecode(const BytecodeProgram& program, std::ostream& stream);
+
+const char* opcodeToString(Opcode opcode);
+
+#endif  // BYTECODE_HPP
@@ -0,0 +1,347 @@
+#include <chrono>
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "vm.hpp"
+
+// GCC and Clang can jump straight from one handler to the next, everything else gets a switch
+#if defined(__GNUC__)
+#define STARSHIP_COMPUTED_GOTO 1
+#else
+#define STARSHIP_COMPUTED_GOTO 0
+#endif
+
+// Registers of every active call, a call's registers start where its arguments are
+static const std::size_t registerStackSize = 1 << 20;
+
+// Local arrays of every active call, with the length in front of each
+static const std::size_t arrayStackSize = 1 << 22;
+
+static const std::size_t maxCallDepth = 1 << 16;
+
+// Same as the runtime, output is written in large pieces
+static const std::size_t outputBufferSize = 1 << 16;
+
+namespace {
+
+struct CallFrame {
+    const BytecodeFunction* function;
+    const Instruction* returnAddress;
+    Value* registers;
+    std::int32_t* arrays;
+    std::int32_t resultRegister; // Where the caller wants the result
+};
+
+class VirtualMachine {
+public:
+    explicit VirtualMachine(const BytecodeProgram& program)
+        : program(program), globals(program.globals), constantArrays(program.arrayData),
+          registerStack(new Value[registerStackSize]), arrayStack(new std::int32_t[arrayStackSize]) {
+        frames.reserve(64);
+    }
+
+    int run(int argc);
+
+private:
+    void flush() {
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        std::fflush(stdout);
+        output.clear();
+    }
+
+    void write(const char* data, std::size_t length) {
+        output.append(data, length);
+        if (output.size() >= outputBufferSize) {
+            flush();
+        }
+    }
+
+    // Whatever was printed before the error comes first, like in the runtime
+    int fail(const std::string& message, std::size_t line) {
+        flush();
+        std::string text = message + " (line " + std::to_string(line) + ")\n";
+        std::fwrite(text.data(), 1, text.size(), stderr);
+        return 1;
+    }
+
+    const BytecodeProgram& program;
+    std::vector<Value> globals;
+    std::vector<std::int32_t> constantArrays;
+    std::unique_ptr<Value[]> registerStack;
+    std::unique_ptr<std::int32_t[]> arrayStack;
+    std::vector<CallFrame> frames;
+    std::string output;
+};
+
+int VirtualMachine::run(int argc) {
+    const BytecodeFunction* function = &program.functions[program.mainFunction];
+    const Instruction* ip = function->code.data();
+    Value* registers = registerStack.get();
+    std::int32_t* arrays = arrayStack.get();
+
+    const Value* registerEnd = registerStack.get() + registerStackSize;
+    const std::int32_t* arrayEnd = arrayStack.get() + arrayStackSize;
+
+    if (static_cast<std::size_t>(function->registerCount) > registerStackSize ||
+        static_cast<std::size_t>(function->arraySpace) > arrayStackSize) {
+        return fail("Stack overflow", 0);
+    }
+
+    if (function->parameterCount > 0) {
+        registers[0].integer = argc;
+    }
+
+    // The line of the instruction ip is on
+#define LINE() (function->lines[ip - function->code.data()])
+
+#if STARSHIP_COMPUTED_GOTO
+    static void* const handlers[] = {
+#define STARSHIP_OPCODE_LABEL(name) &&handle_##name,
+        STARSHIP_OPCODES(STARSHIP_OPCODE_LABEL)
+#undef STARSHIP_OPCODE_LABEL
+    };
+#define DISPATCH() goto* handlers[static_cast<std::size_t>(ip->opcode)]
+#define HANDLER(name) handle_##name:
+#else
+#define DISPATCH() goto dispatch
+#define HANDLER(name) case Opcode::name:
+#endif
+
+// Wraps around like two's complement, the compiled program's overflow is undefined anyway
+#define ARITHMETIC(name, op)                                                                                    \
+    HANDLER(name) {                                                                                             \
+        registers[ip->a].integer = static_cast<std::int32_t>(static_cast<std::uint32_t>(registers[ip->b].integer) \
+                                                             op static_cast<std::uint32_t>(registers[ip->c].integer)); \
+        ++ip;                                                                                                   \
+        DISPATCH();                                                                                             \
+    }
+
+#define COMPARISON(name, op)                                                              \
+    HANDLER(name) {                                                                       \
+        registers[ip->a].integer = registers[ip->b].integer op registers[ip->c].integer; \
+        ++ip;                                                                             \
+        DISPATCH();                                                                       \
+    }
+
+#if STARSHIP_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    switch (ip->opcode) {
+#endif
+
+    HANDLER(LOAD_INT) {
+        registers[ip->a].integer = ip->b;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(LOAD_STRING) {
+        registers[ip->a].string = ip->b;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(MOVE) {
+        registers[ip->a] = registers[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(LOAD_GLOBAL) {
+        registers[ip->a] = globals[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(STORE_GLOBAL) {
+        globals[ip->a] = registers[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+
+    ARITHMETIC(ADD, +)
+    ARITHMETIC(SUBTRACT, -)
+    ARITHMETIC(MULTIPLY, *)
+
+    HANDLER(DIVIDE) {
+        std::int32_t left = registers[ip->b].integer;
+        std::int32_t right = registers[ip->c].integer;
+        if (right == 0) {
+            return fail("Division by zero", LINE());
+        }
+        if (left == INT_MIN && right == -1) {
+            return fail("Integer overflow in division", LINE());
+        }
+        registers[ip->a].integer = left / right;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(ADD_INT) {
+        registers[ip->a].integer = static_cast<std::int32_t>(static_cast<std::uint32_t>(registers[ip->b].integer) +
+                                                             static_cast<std::uint32_t>(ip->c));
+        ++ip;
+        DISPATCH();
+    }
+
+    COMPARISON(LESS, <)
+    COMPARISON(LESS_EQUAL, <=)
+    COMPARISON(GREATER, >)
+    COMPARISON(GREATER_EQUAL, >=)
+    COMPARISON(EQUAL, ==)
+    COMPARISON(NOT_EQUAL, !=)
+
+    HANDLER(JUMP) {
+        ip = function->code.data() + ip->a;
+        DISPATCH();
+    }
+
+    HANDLER(JUMP_IF_ZERO) {
+        ip = registers[ip->a].integer == 0 ? function->code.data() + ip->b : ip + 1;
+        DISPATCH();
+    }
+
+    HANDLER(JUMP_IF_NOT_ZERO) {
+        ip = registers[ip->a].integer != 0 ? function->code.data() + ip->b : ip + 1;
+        DISPATCH();
+    }
+
+    HANDLER(JUMP_IF_LESS) {
+        ip = registers[ip->a].integer < registers[ip->b].integer ? function->code.data() + ip->c : ip + 1;
+        DISPATCH();
+    }
+
+    HANDLER(NEW_ARRAY) {
+        // Zeroed every time the declaration runs
+        std::int32_t* elements = arrays + ip->b;
+        elements[-1] = ip->c;
+        std::memset(elements, 0, static_cast<std::size_t>(ip->c) * sizeof(std::int32_t));
+        registers[ip->a].array = elements;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(CONSTANT_ARRAY) {
+        registers[ip->a].array = constantArrays.data() + ip->b;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(LOAD_ELEMENT) {
+        std::int32_t* elements = registers[ip->b].array;
+        std::int32_t index = registers[ip->c].integer;
+
+        // Unsigned, so negative indices fail too
+        if (static_cast<std::uint32_t>(index) >= static_cast<std::uint32_t>(elements[-1])) {
+            return fail("Index " + std::to_string(index) + " is out of bounds for an array of length " +
+                        std::to_string(elements[-1]), LINE());
+        }
+
+        registers[ip->a].integer = elements[index];
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(STORE_ELEMENT) {
+        std::int32_t* elements = registers[ip->a].array;
+        std::int32_t index = registers[ip->b].integer;
+
+        if (static_cast<std::uint32_t>(index) >= static_cast<std::uint32_t>(elements[-1])) {
+            return fail("Index " + std::to_string(index) + " is out of bounds for an array of length " +
+                        std::to_string(elements[-1]), LINE());
+        }
+
+        elements[index] = registers[ip->c].integer;
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(CALL) {
+        const BytecodeFunction* callee = &program.functions[ip->b];
+        Value* calleeRegisters = registers + ip->c;
+        std::int32_t* calleeArrays = arrays + function->arraySpace;
+
+        if (frames.size() >= maxCallDepth || calleeRegisters + callee->registerCount > registerEnd ||
+            calleeArrays + callee->arraySpace > arrayEnd) {
+            return fail("Stack overflow in a call to " + callee->name, LINE());
+        }
+
+        frames.push_back({function, ip + 1, registers, arrays, ip->a});
+
+        function = callee;
+        registers = calleeRegisters;
+        arrays = calleeArrays;
+        ip = callee->code.data();
+        DISPATCH();
+    }
+
+    HANDLER(RETURN) {
+        Value result = registers[ip->a];
+
+        if (frames.empty()) {
+            flush();
+            return result.integer;
+        }
+
+        const CallFrame& frame = frames.back();
+        function = frame.function;
+        ip = frame.returnAddress;
+        registers = frame.registers;
+        arrays = frame.arrays;
+        registers[frame.resultRegister] = result;
+        frames.pop_back();
+        DISPATCH();
+    }
+
+    HANDLER(PRINT_INT) {
+        char digits[16];
+        auto [end, error] = std::to_chars(digits, digits + sizeof(digits), registers[ip->a].integer);
+        write(digits, end - digits);
+        ++ip;
+        DISPATCH();
+    }
+
+    HANDLER(PRINT_STRING) {
+        const std::string& text = program.strings[registers[ip->a].string];
+        write(text.data(), text.size());
+        ++ip;
+        DISPATCH();
+    }
+
+#if !STARSHIP_COMPUTED_GOTO
+    }
+#endif
+
+#undef COMPARISON
+#undef ARITHMETIC
+#undef HANDLER
+#undef DISPATCH
+#undef LINE
+
+    return fail("Invalid instruction", 0);
+}
+
+}  // namespace
+
+int runBytecode(const BytecodeProgram& program, int argc, const CompilerOptions& options) {
+    logStream(options) << "RUNNING: Starting Bytecode Execution\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    int status = VirtualMachine(program).run(argc);
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: Bytecode Execution took " << seconds << " seconds\n";
+
+    return status;
+}
@@ -0,0 +1,11 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include "bytecode.hpp"
+
+// Runs main, which gets argc like a compiled program would, and returns its exit status.
+// Failed bounds checks and divisions are reported the way the runtime does. Running out of stack,
+// where a compiled program would crash, is reported too, with status 1.
+int runBytecode(const BytecodeProgram& program, int argc, const CompilerOptions& options);
+
+#endif  // VM_HPP
@@ -5,9 +5,8 @@
 
 #include "token.hpp"
 #include "lexer.hpp"
-#include "../parser/parser.hpp"
 
-std::vector<Token> lex(const std::string& sourceCode) {
+std::vector<Token> lex(const std::string& sourceCode, Diagnostics& diagnostics) {
     std::vector<Token> tokens;
 
     std::size_t position = 0;
@@ -34,6 +33,14 @@ std::vector<Token> lex(const std::string& sourceCode) {
                 tokens.emplace_back(TokenType::RIGHT_BRACE, "}", line);
                 position++;
                 continue;
+            case '[':
+                tokens.emplace_back(TokenType::LEFT_BRACKET, "[", line);
+                position++;
+                continue;
+            case ']':
+                tokens.emplace_back(TokenType::RIGHT_BRACKET, "]", line);
+                position++;
+                continue;
             case ',':
                 tokens.emplace_back(TokenType::COMMA, ",", line);
                 position++;
@@ -47,9 +54,40 @@ std::vector<Token> lex(const std::string& sourceCode) {
                 position++;
                 continue;
             case '=':
+                if (position + 1 < sourceCode.size() && sourceCode[position + 1] == '=') {
+                    tokens.emplace_back(TokenType::EQUAL_EQUAL, "==", line);
+                    position += 2;
+                    continue;
+                }
                 tokens.emplace_back(TokenType::EQUAL, "=", line);
                 position++;
                 continue;
+            case '<':
+                if (position + 1 < sourceCode.size() && sourceCode[position + 1] == '=') {
+                    tokens.emplace_back(TokenType::LESS_EQUAL, "<=", line);
+                    position += 2;
+                    continue;
+                }
+                tokens.emplace_back(TokenType::LESS, "<", line);
+                position++;
+                continue;
+            case '>':
+                if (position + 1 < sourceCode.size() && sourceCode[position + 1] == '=') {
+                    tokens.emplace_back(TokenType::GREATER_EQUAL, ">=", line);
+                    position += 2;
+                    continue;
+                }
+                tokens.emplace_back(TokenType::GREATER, ">", line);
+                position++;
+                continue;
+            case '!':
+                // There is no logical not yet, only !=
+                if (position + 1 < sourceCode.size() && sourceCode[position + 1] == '=') {
+                    tokens.emplace_back(TokenType::BANG_EQUAL, "!=", line);
+                    position += 2;
+                    continue;
+                }
+                break;
             case '+':
                 tokens.emplace_back(TokenType::PLUS, "+", line);
                 position++;
@@ -93,6 +131,11 @@ std::vector<Token> lex(const std::string& sourceCode) {
                     tokens.emplace_back(TokenType::FLOAT, lexeme, line);
                     continue;
                 }
+
+                // Anything else is field access, like p.x
+                tokens.emplace_back(TokenType::DOT, ".", line);
+                position++;
+                continue;
             }
         }
 
@@ -146,6 +189,12 @@ std::vector<Token> lex(const std::string& sourceCode) {
                 type = TokenType::FLOAT;
             } else if (lexeme == "import") {
                 type = TokenType::IMPORT;
+            } else if (lexeme == "for") {
+                type = TokenType::FOR;
+            } else if (lexeme == "while") {
+                type = TokenType::WHILE;
+            } else if (lexeme == "struct") {
+                type = TokenType::STRUCT;
             }
             else {
                 type = TokenType::IDENTIFIER;
@@ -163,8 +212,7 @@ std::vector<Token> lex(const std::string& sourceCode) {
                 position++;
             }
             if (position == sourceCode.size()) {
-                std::cerr << "Unterminated string literal at line " << line << "\n";
-                break;
+                diagnostics.error("Unterminated string literal", line);
             }
             std::string lexeme = sourceCode.substr(stringStart, position - stringStart);
             tokens.emplace_back(TokenType::STRING, lexeme, line);
@@ -174,8 +222,7 @@ std::vector<Token> lex(const std::string& sourceCode) {
         
 
         // Handle unrecognized characters
-        std::cerr << "Unrecognized character '" << currentChar << "' at line " << line << "\n";
-        exit(1);
+        diagnostics.error(std::string("Unrecognized character '") + currentChar + "'", line);
     }
 
     tokens.emplace_back(TokenType::END_OF_FILE, "", line);
@@ -192,6 +239,10 @@ std::string tokenTypeToString(TokenType type) {
             return "LEFT_BRACE";
         case TokenType::RIGHT_BRACE:
             return "RIGHT_BRACE";
+        case TokenType::LEFT_BRACKET:
+            return "LEFT_BRACKET";
+        case TokenType::RIGHT_BRACKET:
+            return "RIGHT_BRACKET";
         case TokenType::COMMA:
             return "COMMA";
         case TokenType::SEMICOLON:
@@ -226,6 +277,28 @@ std::string tokenTypeToString(TokenType type) {
         case TokenType::SLASH:
             return "SLASH";
 
+        case TokenType::LESS:
+            return "LESS";
+        case TokenType::LESS_EQUAL:
+            return "LESS_EQUAL";
+        case TokenType::GREATER:
+            return "GREATER";
+        case TokenType::GREATER_EQUAL:
+            return "GREATER_EQUAL";
+        case TokenType::EQUAL_EQUAL:
+            return "EQUAL_EQUAL";
+        case TokenType::BANG_EQUAL:
+            return "BANG_EQUAL";
+
+        case TokenType::FOR:
+            return "FOR";
+        case TokenType::WHILE:
+            return "WHILE";
+        case TokenType::STRUCT:
+            return "STRUCT";
+        case TokenType::DOT:
+            return "DOT";
+
         case TokenType::END_OF_FILE:
             return "END_OF_FILE";
         case TokenType::RETURN:
@@ -279,25 +352,49 @@ TokenType stringToTokenType(std::string toke_string) {
         return TokenType::END_OF_FILE;
     } else if (toke_string == "RETURN") {
         return TokenType::RETURN;
+    } else if (toke_string == "LEFT_BRACKET") {
+        return TokenType::LEFT_BRACKET;
+    } else if (toke_string == "RIGHT_BRACKET") {
+        return TokenType::RIGHT_BRACKET;
+    } else if (toke_string == "LESS") {
+        return TokenType::LESS;
+    } else if (toke_string == "LESS_EQUAL") {
+        return TokenType::LESS_EQUAL;
+    } else if (toke_string == "GREATER") {
+        return TokenType::GREATER;
+    } else if (toke_string == "GREATER_EQUAL") {
+        return TokenType::GREATER_EQUAL;
+    } else if (toke_string == "EQUAL_EQUAL") {
+        return TokenType::EQUAL_EQUAL;
+    } else if (toke_string == "BANG_EQUAL") {
+        return TokenType::BANG_EQUAL;
+    } else if (toke_string == "FOR") {
+        return TokenType::FOR;
+    } else if (toke_string == "WHILE") {
+        return TokenType::WHILE;
+    } else if (toke_string == "STRUCT") {
+        return TokenType::STRUCT;
+    } else if (toke_string == "DOT") {
+        return TokenType::DOT;
     } else {
         return TokenType::END_OF_FILE;
     }
 }
 
-void printTokens(const std::vector<Token>& tokens) {
+void printTokens(const std::vector<Token>& tokens, std::ostream& stream) {
     for (const Token& token : tokens) {
-        std::cout << tokenTypeToString(token.type) << " " << token.lexeme << " " << token.position << "\n";
+        stream << tokenTypeToString(token.type) << " " << token.lexeme << " " << token.position << "\n";
     }
 }
 
-std::vector<Token> performLexicalAnalysis(const std::string& sourceCode) {
-    std::cout << "RUNNING: Starting Lexical Analysis\n";
+std::vector<Token> performLexicalAnalysis(const std::string& sourceCode, const CompilerOptions& options, Diagnostics& diagnostics) {
+    logStream(options) << "RUNNING: Starting Lexical Analysis\n";
 
     // Start the timer
     auto startTime = std::chrono::high_resolution_clock::now();
 
     // Perform lexical analysis
-    std::vector<Token> tokens = lex(sourceCode);
+    std::vector<Token> tokens = lex(sourceCode, diagnostics);
 
     // Stop the timer
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -305,8 +402,8 @@ std::vector<Token> performLexicalAnalysis(const std::string& sourceCode) {
 
     // Print the elapsed time
     double seconds = duration / 1e9;  // Convert nanoseconds to seconds
-    flushPrint();
-    std::cout << "DONE: Lexical Analysis took " << seconds << " seconds\n";
+    flushPrint(options);
+    logStream(options) << "DONE: Lexical Analysis took " << seconds << " seconds\n";
 
     return tokens;
 }
@@ -4,15 +4,17 @@
 #include <string>
 #include <vector>
 #include "token.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
 
 // Lexical analysis
-std::vector<Token> lex(const std::string& sourceCode);
-std::vector<Token> performLexicalAnalysis(const std::string& sourceCode);
+std::vector<Token> lex(const std::string& sourceCode, Diagnostics& diagnostics);
+std::vector<Token> performLexicalAnalysis(const std::string& sourceCode, const CompilerOptions& options, Diagnostics& diagnostics);
 
 // Utility functions
 std::string tokenTypeToString(TokenType type);
 TokenType stringToTokenType(std::string toke_string);
-void printTokens(const std::vector<Token>& tokens);
+void printTokens(const std::vector<Token>& tokens, std::ostream& stream);
 
 #endif // LEXER_HPP
 
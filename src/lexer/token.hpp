@@ -8,19 +8,27 @@ enum class TokenType {
     // Single-character tokens
     LEFT_PAREN, RIGHT_PAREN,
     LEFT_BRACE, RIGHT_BRACE,
+    LEFT_BRACKET, RIGHT_BRACKET,
     COMMA, SEMICOLON, COLON,
-    AT,
+    AT, DOT,
 
     // Expression tokens
     EQUAL, // =
     IDENTIFIER, // Variable name
     PLUS, MINUS, STAR, SLASH, // + - * /
 
+    // Comparison tokens
+    LESS, LESS_EQUAL, // < <=
+    GREATER, GREATER_EQUAL, // > >=
+    EQUAL_EQUAL, BANG_EQUAL, // == !=
+
     // Two-character tokens
     ARROW, // ->
 
     // Keywords
     FN, PRINT, IMPORT,
+    FOR, WHILE,
+    STRUCT,
 
     // Literals
     INT, // U64
@@ -0,0 +1,174 @@
+#include <filesystem>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+
+#include "cache.hpp"
+#include "emitter.hpp"
+#include "../parser/effects.hpp"
+
+// Bump when the generated code changes without the AST or options changing
+static const char* cacheVersion = "1";
+
+// Writes the AST in a form where two functions only come out the same if they compile the same.
+// Lines are included, failed bounds checks report them.
+static void serialize(ASTNodeBase* node, std::string& out) {
+    auto field = [&out](const std::string& value) {
+        out += std::to_string(value.size()) + ":" + value;
+    };
+
+    if (node == nullptr) {
+        out += "_";
+    } else if (LiteralNode* literal = dynamic_cast<LiteralNode*>(node)) {
+        out += "L" + std::to_string(static_cast<int>(literal->value.getType()));
+        if (literal->value.isInt()) {
+            field(std::to_string(literal->value.getInt()));
+        } else if (literal->value.isString()) {
+            field(literal->value.getString());
+        }
+    } else if (VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(node)) {
+        out += "R" + std::to_string(reference->arrayLength);
+        field(reference->name);
+        field(reference->structType ? reference->structType->name : "");
+    } else if (FieldNode* fieldNode = dynamic_cast<FieldNode*>(node)) {
+        out += "M";
+        field(fieldNode->name);
+        field(fieldNode->structType->name);
+        field(fieldNode->field->name);
+    } else if (IndexNode* indexNode = dynamic_cast<IndexNode*>(node)) {
+        out += "I" + std::to_string(indexNode->arrayLength) + "," + std::to_string(indexNode->line);
+        field(indexNode->name);
+        serialize(indexNode->index, out);
+    } else if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(node)) {
+        out += "B" + std::to_string(static_cast<int>(binaryNode->operatorType));
+        serialize(binaryNode->left, out);
+        serialize(binaryNode->right, out);
+    } else if (CallNode* callNode = dynamic_cast<CallNode*>(node)) {
+        out += "C" + std::to_string(callNode->arguments.size());
+        field(callNode->name);
+        for (ExpressionNode* argument : callNode->arguments) {
+            serialize(argument, out);
+        }
+    } else if (PrintNode* printNode = dynamic_cast<PrintNode*>(node)) {
+        out += "P" + std::to_string(static_cast<int>(printNode->type));
+        serialize(printNode->expression, out);
+    } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(node)) {
+        out += "D" + std::to_string(static_cast<int>(declaration->type)) + "," + std::to_string(declaration->arrayLength);
+        field(declaration->name);
+        field(declaration->structType ? declaration->structType->name : "");
+        serialize(declaration->value, out);
+        for (int value : declaration->values) {
+            out += std::to_string(value) + ",";
+        }
+    } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        out += "A" + std::to_string(assignment->arrayLength) + "," + std::to_string(assignment->line);
+        field(assignment->name);
+        field(assignment->field ? assignment->field->name : "");
+        serialize(assignment->index, out);
+        serialize(assignment->value, out);
+    } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(node)) {
+        out += "W" + std::to_string(whileNode->body.size());
+        serialize(whileNode->condition, out);
+        for (ASTNodeBase* statement : whileNode->body) {
+            serialize(statement, out);
+        }
+    } else if (ForNode* forNode = dynamic_cast<ForNode*>(node)) {
+        out += "F" + std::to_string(forNode->body.size());
+        serialize(forNode->initializer, out);
+        serialize(forNode->condition, out);
+        serialize(forNode->step, out);
+        for (ASTNodeBase* statement : forNode->body) {
+            serialize(statement, out);
+        }
+    } else if (FunctionNode* function = dynamic_cast<FunctionNode*>(node)) {
+        out += "N" + std::to_string(static_cast<int>(function->parameters.returnType)) + (function->exported ? "e" : "");
+        field(function->name);
+        for (Variable* parameter : function->parameters.parameters) {
+            out += "p" + std::to_string(static_cast<int>(parameter->type)) + "," + std::to_string(parameter->arrayLength);
+            field(parameter->name);
+            field(parameter->structType ? parameter->structType->name : "");
+        }
+        out += "b" + std::to_string(function->body->statements.size());
+        for (ASTNodeBase* statement : function->body->statements) {
+            serialize(statement, out);
+        }
+        serialize(function->returnValue, out);
+    } else {
+        out += "?";
+    }
+}
+
+FunctionCache::FunctionCache(std::string directory, ASTTree* tree, const CompilerOptions& options,
+                             Diagnostics& diagnostics)
+    : directory(std::move(directory)), functions(indexFunctions(tree)), diagnostics(diagnostics) {
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    if (error) {
+        diagnostics.error("Failed to create the function cache " + this->directory + ": " + error.message());
+    }
+
+    salt = std::string(cacheVersion) + "|" + LLVM_VERSION_STRING + "|" + std::to_string(options.optimizationLevel) +
+           "|" + std::to_string(options.sizeLevel) + "|" + getTargetCPU(options) + "|" + getTargetFeatures(options) + "|" +
+           std::to_string(options.instrumentFunctions) + "|";
+
+    // Their declarations decide which names are globals and how they're accessed
+    for (ASTNodeBase* statement : tree->statements) {
+        if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            salt += "G" + std::to_string(static_cast<int>(declaration->type));
+            salt += std::to_string(declaration->name.size()) + ":" + declaration->name;
+
+            // @comptime tables are compiled into every object
+            for (int value : declaration->values) {
+                salt += std::to_string(value) + ",";
+            }
+        }
+    }
+
+    // Struct layouts are in every function that uses the struct, so any change rebuilds them all
+    for (const StructLayout* layout : tree->structs) {
+        salt += "S" + std::to_string(layout->size) + "," + std::to_string(layout->alignment);
+        salt += std::to_string(layout->name.size()) + ":" + layout->name;
+        for (const StructField& field : layout->fields) {
+            salt += std::to_string(static_cast<int>(field.type)) + "," + std::to_string(field.offset) + "," +
+                    std::to_string(field.alignment) + ":" + field.name + ",";
+        }
+    }
+}
+
+std::string FunctionCache::fingerprint(FunctionNode* function) const {
+    std::string text = salt;
+    serialize(function, text);
+
+    // By name, moving functions around in the source doesn't change anything
+    for (const std::string& callee : findReachableFunctions(function, functions)) {
+        serialize(functions.at(callee), text);
+    }
+
+    llvm::SHA1 hasher;
+    hasher.update(text);
+    return llvm::toHex(hasher.final(), true);
+}
+
+bool FunctionCache::contains(const std::string& fingerprint) const {
+    return std::filesystem::exists(objectFilename(fingerprint));
+}
+
+std::string FunctionCache::objectFilename(const std::string& fingerprint) const {
+    return (std::filesystem::path(directory) / (fingerprint + ".o")).string();
+}
+
+std::string FunctionCache::temporaryFilename(const std::string& fingerprint) const {
+    return objectFilename(fingerprint) + ".tmp" + std::to_string(llvm::sys::Process::getProcessId());
+}
+
+void FunctionCache::store(const std::string& temporaryFilename, const std::string& fingerprint) {
+    std::error_code error;
+    std::filesystem::rename(temporaryFilename, objectFilename(fingerprint), error);
+    if (error) {
+        std::string message = error.message();
+        std::filesystem::remove(temporaryFilename, error);
+        diagnostics.error("Failed to store " + fingerprint + " in the function cache: " + message);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <map>
+#include <string>
+
+#include "../parser/parser.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+
+// --function-cache: every function is compiled into an object of its own and kept on disk, named after
+// a hash of everything that went into its code. A rebuild only compiles the functions whose hash changed.
+class FunctionCache {
+public:
+    FunctionCache(std::string directory, ASTTree* tree, const CompilerOptions& options, Diagnostics& diagnostics);
+
+    // The function's AST and those of the functions it can reach (they are compiled along for inlining),
+    // the global variable declarations and the options that change the generated code
+    std::string fingerprint(FunctionNode* function) const;
+
+    bool contains(const std::string& fingerprint) const;
+    std::string objectFilename(const std::string& fingerprint) const;
+
+    // Where to emit an object before it goes into the cache, unique per process
+    std::string temporaryFilename(const std::string& fingerprint) const;
+
+    // Moves a freshly emitted object into place. A rename, so another build never sees half a file.
+    void store(const std::string& temporaryFilename, const std::string& fingerprint);
+
+private:
+    std::string directory;
+
+    // The options and the global variable declarations, the same for every function
+    std::string salt;
+    std::map<std::string, FunctionNode*> functions;
+    Diagnostics& diagnostics;
+};
+
+#endif  // CACHE_HPP
@@ -1,53 +1,122 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
+
+#include "llvm/IR/MDBuilder.h"
+
 #include "codegen.hpp"
+#include "emitter.hpp"
+
+CodeGenerator::CodeGenerator(llvm::Module& module, const CompilerOptions& options, Diagnostics& diagnostics,
+                             CompilerStatistics* statistics)
+    : module(module), context(module.getContext()), builder(context), options(options), diagnostics(diagnostics),
+      statistics(statistics && statistics->getPerfCounters() ? statistics : nullptr), targetCPU(getTargetCPU(options)), targetFeatures(getTargetFeatures(options)) {}
+
+void CodeGenerator::generateIR(ASTTree* rootNode, int sourceIndex) {
+    definedSource = sourceIndex;
+    generateModuleIR(rootNode);
+}
+
+void CodeGenerator::generateFunctionIR(ASTTree* rootNode, FunctionNode* function) {
+    splitByFunction = true;
+    definedFunction = function;
+
+    // Only the functions in the module matter for its attributes
+    if (function) {
+        std::map<std::string, FunctionNode*> functions = indexFunctions(rootNode);
+        inlinableFunctions = findReachableFunctions(function, functions);
 
-void debugPrint(const std::string& message) {
-    if (debugMode) {
-        std::cout << "[DEBUG] " << message;
+        std::vector<FunctionNode*> definedFunctions = {function};
+        for (const std::string& name : inlinableFunctions) {
+            definedFunctions.push_back(functions.at(name));
+        }
+        functionEffects = inferFunctionEffects(definedFunctions);
     }
+
+    generateModuleIR(rootNode);
 }
 
+bool CodeGenerator::definesFunction(FunctionNode* functionNode) const {
+    if (splitByFunction) {
+        return functionNode == definedFunction || inlinableFunctions.count(functionNode->name);
+    }
 
-CodeGenerator::CodeGenerator(llvm::Module& module)
-    : module(module), context(module.getContext()), builder(context) {}
+    return definedSource == -1 || functionNode->sourceIndex == definedSource;
+}
 
-void CodeGenerator::generateIR(ASTTree* rootNode) {
-    std::cout << "RUNNING: Starting IR Generation\n";
+bool CodeGenerator::definesGlobal(VariableDeclarationNode* declarationNode) const {
+    if (splitByFunction) {
+        return definedFunction == nullptr && definedGroup.empty();
+    }
+
+    return definedSource == -1 || declarationNode->sourceIndex == definedSource;
+}
+
+// Only a module with the whole program in it can make its functions and variables internal
+bool CodeGenerator::isWholeProgram() const {
+    return !splitByFunction && definedSource == -1;
+}
+
+void CodeGenerator::generateModuleIR(ASTTree* rootNode) {
+    logStream(options) << "RUNNING: Starting IR Generation\n";
 
     // Start the timer
     auto startTime = std::chrono::high_resolution_clock::now();
 
+    declareRuntimeFunctions();
+    if (!splitByFunction) {
+        functionEffects = inferFunctionEffects(rootNode);
+    }
+
+    // Declare every function first so calls can refer to functions defined further down.
+    // A function's module only needs what the function can reach, and those are all defined.
+    // @comptime tables too, every module has its own copy
+    for (ASTNodeBase* child : rootNode->statements) {
+        if (FunctionNode* functionNode = dynamic_cast<FunctionNode*>(child)) {
+            if (!splitByFunction || definesFunction(functionNode)) {
+                generateFunctionPrototypeIR(functionNode);
+            }
+        } else if (VariableDeclarationNode* declarationNode = dynamic_cast<VariableDeclarationNode*>(child)) {
+            if (declarationNode->constant) {
+                globalArrays[declarationNode->name] = generateConstantArrayIR(declarationNode);
+            }
+        }
+    }
+
     // Visit the root node and generate IR code
     for (ASTNodeBase* child : rootNode->statements) {
-        std::cout << "Visiting " << typeid(*child).name() << "\n";
+        logStream(options) << "Visiting " << typeid(*child).name() << "\n";
 
         // These will be all the allowed top level statements
 
         const char* typeName = typeid(*child).name();
         if (strcmp(typeName, typeid(FunctionNode).name()) == 0) {
             FunctionNode* functionNode = static_cast<FunctionNode*>(child);
-            generateFunctionDeclarationIR(functionNode);
-        } else {
-            std::cerr << "ERROR: Invalid node type \"" << typeName << "\"\n";
-            exit(1);
-        }
 
-        flushPrint();
-    }
+            // Functions of other files only need the prototype
+            if (definesFunction(functionNode)) {
+                CompilerStatistics::Measurement measurement(statistics, functionNode->name, true);
+                llvm::Function* function = generateFunctionDeclarationIR(functionNode);
 
-    std::error_code errorCode;
-    llvm::raw_fd_ostream outputFile("output.ll", errorCode, llvm::sys::fs::OpenFlags::OF_None);
+                // Compiled along for inlining, the definition that gets linked is in its own object
+                if (splitByFunction && functionNode != definedFunction) {
+                    function->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+                }
+            }
+        } else if (strcmp(typeName, typeid(VariableDeclarationNode).name()) == 0) {
+            VariableDeclarationNode* declarationNode = static_cast<VariableDeclarationNode*>(child);
+            if (!declarationNode->constant) {
+                generateGlobalVariableIR(declarationNode);
+            }
+        } else {
+            diagnostics.error("Invalid node type \"" + std::string(typeName) + "\"");
+        }
 
-    // Check if the file was opened successfully
-    if (errorCode) {
-        std::cerr << "Failed to open output file: " << errorCode.message() << "\n";
-        return;
+        flushPrint(options);
     }
 
-    // Set the output stream for printing the module
-    module.print(outputFile, nullptr);
-
+    verifyModuleIR();
 
      // Stop the timer
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -55,177 +124,471 @@ void CodeGenerator::generateIR(ASTTree* rootNode) {
 
     // Print the elapsed time
     double seconds = duration / 1e9;  // Convert nanoseconds to seconds
-    std::cout << "DONE: IR Generation took " << seconds << " seconds\n";
+    logStream(options) << "DONE: IR Generation took " << seconds << " seconds\n";
 }
 
-llvm::Function* CodeGenerator::generateFunctionDeclarationIR(FunctionNode* functionNode) {
-    std::vector<llvm::Type*> argTypes;
+void CodeGenerator::generateDeclarationsIR(ASTTree* rootNode) {
+    declareRuntimeFunctions();
 
-    TokenType functionReturnType = functionNode->returnVariable->type;
+    // Every function gets its prototype now, calls can't wait until their callee's turn comes
+    for (ASTNodeBase* child : rootNode->statements) {
+        if (FunctionNode* functionNode = dynamic_cast<FunctionNode*>(child)) {
+            generateFunctionPrototypeIR(functionNode);
+            declaredFunctions.push_back(functionNode->name);
+        } else if (VariableDeclarationNode* declarationNode = dynamic_cast<VariableDeclarationNode*>(child)) {
+            if (declarationNode->constant) {
+                globalArrays[declarationNode->name] = generateConstantArrayIR(declarationNode);
+            } else {
+                generateGlobalVariableIR(declarationNode);
+            }
+        }
+    }
+}
 
-    // Collect argument types
-    // TODO: I don't like the double parameter thing.
-    debugPrint("Visiting " + std::to_string(functionNode->parameters.parameters.size()) + " parameters\n");
+void CodeGenerator::generateStreamedFunctionIR(FunctionNode* functionNode) {
+    CompilerStatistics::Measurement measurement(statistics, functionNode->name, true);
+    generateFunctionDeclarationIR(functionNode);
+}
 
-    // Goes through each parameter.
-    for (int i = 0; i < functionNode->parameters.parameters.size() - 1; i++) {
-        VariableBase* parameter = functionNode->parameters.parameters[i];
+void CodeGenerator::finishStreamedIR(ASTTree* rootNode) {
+    functionEffects = inferFunctionEffects(rootNode);
+
+    // The functions end up in the order of the source, like without --pipeline
+    std::set<std::string> keptFunctions;
+    for (ASTNodeBase* child : rootNode->statements) {
+        if (FunctionNode* functionNode = dynamic_cast<FunctionNode*>(child)) {
+            llvm::Function* function = module.getFunction(functionNode->name);
+            addEffectAttributes(function);
+            function->removeFromParent();
+            module.getFunctionList().push_back(function);
+            keptFunctions.insert(functionNode->name);
+        }
+    }
 
-        debugPrint("Visiting parameter " + parameter->name + "\n");
+    // Unreachable and @comptime functions were declared before the parser knew to drop them
+    for (const std::string& name : declaredFunctions) {
+        llvm::Function* function = module.getFunction(name);
+        if (!keptFunctions.count(name) && function && function->use_empty()) {
+            function->eraseFromParent();
+        }
+    }
 
-        // Parse out the type of the parameter
-        TokenType parameterType = parameter->type;
-        
-        llvm::Type* llvmType;
+    verifyModuleIR();
+}
 
-        if (parameterType == TokenType::INT) {
-            llvmType = llvm::Type::getInt32Ty(context);
-        } else if (parameterType == TokenType::STRING) {
-            llvmType = llvm::Type::getInt8PtrTy(context);
+void CodeGenerator::generateFunctionGroupIR(const std::vector<FunctionNode*>& group,
+                                            const std::map<std::string, FunctionNode*>& functions,
+                                            const std::vector<VariableDeclarationNode*>& globals,
+                                            const std::map<std::string, FunctionEffects>& effects) {
+    splitByFunction = true;
+    definedGroup = group;
+    functionEffects = effects;
+
+    declareRuntimeFunctions();
+
+    // The variables are defined in a module of their own, every group gets its own copy of the tables
+    for (VariableDeclarationNode* declarationNode : globals) {
+        if (declarationNode->constant) {
+            globalArrays[declarationNode->name] = generateConstantArrayIR(declarationNode);
         } else {
-            std::cerr << "ERROR: Invalid parameter type " << tokenTypeToString(parameterType) << "\n";
-            continue;
+            generateGlobalVariableIR(declarationNode);
         }
+    }
 
-        // Add the type to the list of argument types
-        argTypes.push_back(llvmType);
+    std::set<std::string> declared;
+    for (FunctionNode* function : group) {
+        generateFunctionPrototypeIR(function);
+        declared.insert(function->name);
+    }
 
-        if (!debugMode)
-        {
-            flushPrint();
+    for (FunctionNode* function : group) {
+        for (const std::string& callee : function->callees) {
+            if (!declared.count(callee) && functions.count(callee)) {
+                inlinableFunctions.insert(callee);
+            }
         }
+    }
 
-        // Debug print "done visiting parameter"
-        debugPrint("Done visiting parameter" + parameter->name + "\n");
+    auto declare = [&](const std::string& name) {
+        auto callee = functions.find(name);
+        if (callee != functions.end() && declared.insert(name).second) {
+            generateFunctionPrototypeIR(callee->second);
+        }
+    };
+    for (const std::string& name : inlinableFunctions) {
+        declare(name);
+        for (const std::string& callee : functions.at(name)->callees) {
+            declare(callee);
+        }
     }
 
-    debugPrint("Creating function type\n");
+    for (FunctionNode* function : group) {
+        CompilerStatistics::Measurement measurement(statistics, function->name, true);
+        generateFunctionDeclarationIR(function);
+    }
+    for (const std::string& name : inlinableFunctions) {
+        generateFunctionDeclarationIR(functions.at(name))->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+    }
 
-    // Create function type
-    // Switch through the return type to the llvm return type
-    llvm::Type* llvmReturnType;
+    verifyModuleIR();
+}
 
-    // Print the return type
-    debugPrint("Return type: " + tokenTypeToString(functionReturnType) + "\n");
+// Catch anything the parser let through that LLVM can't take
+void CodeGenerator::verifyModuleIR() {
+    std::string verifierOutput;
+    llvm::raw_string_ostream verifierStream(verifierOutput);
+    if (llvm::verifyModule(module, &verifierStream)) {
+        diagnostics.error("Generated invalid IR: " + verifierStream.str());
+    }
+}
 
-    if (functionReturnType == TokenType::INT) {
-        llvmReturnType = llvm::Type::getInt32Ty(context);
-    } else if (functionReturnType == TokenType::STRING) {
-        // Cast to string type
-        Variable<std::string>* stringVariable = dynamic_cast<Variable<std::string>*>(functionNode->returnVariable);
+llvm::ArrayType* CodeGenerator::getArrayType(std::size_t arrayLength) {
+    return llvm::ArrayType::get(llvm::Type::getInt32Ty(context), arrayLength);
+}
 
-        // Parse the return size of the string to correctly get the type
-        std::cout << "String size: " << stringVariable->value.size() << "\n";
-        int stringSize = stringVariable->value.size() + 1; // Figure out why this is +1
+// The parser decided where every field goes. The type is packed and spells out the padding as byte arrays,
+// so LLVM's own layout rules can't move anything and --print-layouts is exactly what gets generated.
+llvm::StructType* CodeGenerator::getStructType(const StructLayout* layout) {
+    auto known = structTypes.find(layout);
+    if (known != structTypes.end()) {
+        return known->second;
+    }
 
-        llvmReturnType = llvm::Type::getInt8Ty(context);
-        llvmReturnType = llvm::ArrayType::get(llvmReturnType, stringSize);
-        llvmReturnType = llvm::PointerType::get(llvmReturnType, 0);
-    } else {
-        std::cerr << "ERROR: Invalid return type \"" << tokenTypeToString(functionReturnType) << "\"\n";
-        exit(1);
+    llvm::Type* byteType = llvm::Type::getInt8Ty(context);
+    std::vector<llvm::Type*> elements;
+    std::size_t offset = 0;
+    for (const StructField& field : layout->fields) {
+        if (field.offset > offset) {
+            elements.push_back(llvm::ArrayType::get(byteType, field.offset - offset));
+        }
+        fieldElements[&field] = elements.size();
+        elements.push_back(getLLVMType(field.type));
+        offset = field.offset + field.size;
+    }
+    if (layout->size > offset) {
+        elements.push_back(llvm::ArrayType::get(byteType, layout->size - offset));
+    }
+
+    // Modules of one build share the context, and with it the named types
+    std::string typeName = "struct." + layout->name;
+    llvm::StructType* type = llvm::StructType::getTypeByName(context, typeName);
+    if (!type || !type->isPacked() || !type->elements().equals(elements)) {
+        type = llvm::StructType::create(context, elements, typeName, true);
+    }
+
+    structTypes[layout] = type;
+    return type;
+}
+
+// &variable.field
+llvm::Value* CodeGenerator::generateFieldPointerIR(const std::string& name, const StructLayout* layout,
+                                                   const StructField* field) {
+    llvm::StructType* type = getStructType(layout);
+    return builder.CreateStructGEP(type, localStructs.at(name), fieldElements.at(field), name + "." + field->name);
+}
+
+// Arrays and structs are passed by reference, so as a type they're a pointer to them
+llvm::Type* CodeGenerator::getLLVMType(TokenType type, std::size_t arrayLength, const StructLayout* structType) {
+    if (arrayLength > 0) {
+        return getArrayType(arrayLength)->getPointerTo();
+    }
+
+    if (structType) {
+        return getStructType(structType)->getPointerTo();
     }
 
+    switch (type) {
+        case TokenType::INT:
+            return llvm::Type::getInt32Ty(context);
+        case TokenType::STRING:
+            return llvm::Type::getInt8PtrTy(context);
+        default:
+            break;
+    }
+
+    diagnostics.error("Invalid type \"" + tokenTypeToString(type) + "\"");
+}
+
+llvm::Function* CodeGenerator::generateFunctionPrototypeIR(FunctionNode* functionNode) {
+    std::vector<llvm::Type*> argTypes;
+
+    TokenType functionReturnType = functionNode->parameters.returnType;
+
+    // Collect argument types
+    debugPrint(options, "Visiting " + std::to_string(functionNode->parameters.parameters.size()) + " parameters\n");
+
+    // Goes through each parameter.
+    for (Variable* parameter : functionNode->parameters.parameters) {
+        debugPrint(options, "Visiting parameter " + parameter->name + "\n");
+
+        // Add the type to the list of argument types
+        argTypes.push_back(getLLVMType(parameter->type, parameter->arrayLength, parameter->structType));
+
+        if (!options.debugMode)
+        {
+            flushPrint(options);
+        }
+
+        // Debug print "done visiting parameter"
+        debugPrint(options, "Done visiting parameter" + parameter->name + "\n");
+    }
+
+    debugPrint(options, "Creating function type\n");
+
+    // Print the return type
+    debugPrint(options, "Return type: " + tokenTypeToString(functionReturnType) + "\n");
+
+    llvm::Type* llvmReturnType = getLLVMType(functionReturnType);
     llvm::FunctionType* functionType = llvm::FunctionType::get(llvmReturnType, argTypes, false);
 
-    debugPrint("Creating function\n");
+    debugPrint(options, "Creating function\n");
     // Create the function
-    llvm::Function* function = llvm::Function::Create(
-        functionType, llvm::Function::ExternalLinkage, functionNode->name, &module);
-
-    debugPrint("Creating entry block\n");
-    // Create a new basic block for the function entry
-    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(context, "", function);
+    // Only main and exported functions are called from outside, the rest can be internal and use
+    // whatever calling convention suits the target. Split modules call each other's functions, there
+    // the LTO link does the internalizing.
+    bool visible = functionNode->name == "main" || functionNode->exported;
+    llvm::GlobalValue::LinkageTypes linkage = visible || !isWholeProgram() ? llvm::Function::ExternalLinkage
+                                                                           : llvm::Function::InternalLinkage;
+    llvm::Function* function = llvm::Function::Create(functionType, linkage, functionNode->name, &module);
+    if (!visible) {
+        function->setCallingConv(llvm::CallingConv::Fast);
+    }
 
+    // Nothing in the language throws
+    function->addFnAttr(llvm::Attribute::NoUnwind);
 
-    debugPrint("Creating builder\n");
-    // Set the insert point to the entry block
-    builder.SetInsertPoint(entryBlock);
+    addEffectAttributes(function);
 
-    // Create the function contents
-    // Loop through the statements and generate IR for each
-    if (functionNode->body->statements[0] != nullptr) {
-        for (ASTNodeBase* statement : functionNode->body->statements) {
-            if (statement == nullptr) {
-                if (debugMode) {
-                    std::cerr << "WARNING: Statement is nullptr\n";
-                }
-                continue;
-            }
+    // Name the arguments after the parameters, it makes the IR readable
+    for (std::size_t i = 0; i < function->arg_size(); ++i) {
+        Variable* parameter = functionNode->parameters.parameters[i];
+        function->getArg(i)->setName(parameter->name);
 
-            // Debug print the statement type and the function name
-            debugPrint("Visiting " + std::string(typeid(*statement).name()) + " in function " + functionNode->name + "\n");
+        // The parser never lets the same array be passed twice, arrays are 16 byte aligned allocas
+        // and nothing keeps the pointer, that's everything the vectorizer wants to know
+        if (parameter->arrayLength > 0) {
+            function->addParamAttr(i, llvm::Attribute::NoAlias);
+            function->addParamAttr(i, llvm::Attribute::NoCapture);
+            function->addParamAttr(i, llvm::Attribute::getWithAlignment(context, llvm::Align(16)));
+            function->addDereferenceableParamAttr(i, parameter->arrayLength * 4);
+        }
 
-            if (strcmp(typeid(*statement).name(), typeid(PrintNode).name()) == 0) {
-                debugPrint("Generating print statement IR\n");
-                generatePrintStatementIR(dynamic_cast<PrintNode *>(statement));
-            }
+        // The same goes for structs, at the alignment of their layout
+        if (parameter->structType) {
+            function->addParamAttr(i, llvm::Attribute::NoAlias);
+            function->addParamAttr(i, llvm::Attribute::NoCapture);
+            function->addParamAttr(i, llvm::Attribute::getWithAlignment(context, llvm::Align(parameter->structType->alignment)));
+            function->addDereferenceableParamAttr(i, parameter->structType->size);
         }
     }
-   
-    debugPrint("Creating return instruction for function \"" + functionNode->name + "\"\n");
 
-    // I don't know why this is needed, but it is, and it fixes the seg fault 
-    // TODO: Figure out why and remove it
-    llvm::IRBuilder<> builder(entryBlock);
+    return function;
+}
 
-    // As before, switch through the return type to the llvm return type
-    llvm::Type* llvmFunctionReturnType;
-    TokenType functionBottomReturnType = functionNode->returnVariable->type;
+void CodeGenerator::addEffectAttributes(llvm::Function* function) {
+    auto effects = functionEffects.find(function->getName().str());
+    if (effects == functionEffects.end()) {
+        return;
+    }
+
+    // The profile hooks write the runtime's counters, so an instrumented function always writes memory
+    if (!effects->second.writesMemory && !options.instrumentFunctions) {
+        function->addFnAttr(effects->second.readsMemory ? llvm::Attribute::ReadOnly : llvm::Attribute::ReadNone);
+    }
+    if (effects->second.onlyArgumentMemory && (effects->second.readsMemory || effects->second.writesMemory) &&
+        !options.instrumentFunctions) {
+        function->addFnAttr(llvm::Attribute::ArgMemOnly);
+    }
+    if (!effects->second.mayNotReturn) {
+        function->addFnAttr(llvm::Attribute::WillReturn);
+    }
+    if (!effects->second.recursive) {
+        function->addFnAttr(llvm::Attribute::NoRecurse);
+    }
+}
+
+llvm::Function* CodeGenerator::generateFunctionDeclarationIR(FunctionNode* functionNode) {
+    llvm::Function* function = module.getFunction(functionNode->name);
+
+    function->addFnAttr("target-cpu", targetCPU);
+    if (!targetFeatures.empty()) {
+        function->addFnAttr("target-features", targetFeatures);
+    }
+
+    // The Os/Oz pipelines only go so far, the inliner and the backend look at these per function
+    if (options.sizeLevel > 0) {
+        function->addFnAttr(llvm::Attribute::OptimizeForSize);
+    }
+    if (options.sizeLevel > 1) {
+        function->addFnAttr(llvm::Attribute::MinSize);
+    }
+
+    debugPrint(options, "Creating entry block\n");
+    // Create a new basic block for the function entry
+    llvm::BasicBlock* entryBlock = llvm::BasicBlock::Create(context, "entry", function);
+
+    debugPrint(options, "Creating builder\n");
+    // Set the insert point to the entry block
+    builder.SetInsertPoint(entryBlock);
 
-    VariableBase* returnVariable = functionNode->returnVariable;
-    llvm::Value* returnPointer;
+    // Before anything else, so the time of the whole body counts
+    llvm::Constant* profileRecord = nullptr;
+    if (options.instrumentFunctions) {
+        profileRecord = llvm::ConstantExpr::getBitCast(generateProfileRecordIR(functionNode),
+                                                       llvm::Type::getInt8PtrTy(context));
+        builder.CreateCall(profileEnterFunction, {profileRecord});
+    }
 
-    // Create a switch statement to handle different return types
-    if (functionBottomReturnType == TokenType::INT) {
-        Variable<int>* intReturnVariable = dynamic_cast<Variable<int>*>(returnVariable);
-        if (intReturnVariable != nullptr) {
-            int value = intReturnVariable->value;
-            returnPointer = llvm::ConstantInt::get(context, llvm::APInt(32, value, true));
+    // Every parameter gets a stack slot like any other variable, mem2reg turns them back into SSA values.
+    // Array and struct parameters are already pointers to the caller's.
+    localVariables.clear();
+    localArrays = globalArrays;
+    localStructs.clear();
+    for (llvm::Argument& argument : function->args()) {
+        if (functionNode->parameters.parameters[argument.getArgNo()]->arrayLength > 0) {
+            localArrays[argument.getName().str()] = &argument;
+            continue;
         }
-    } else if (functionBottomReturnType == TokenType::STRING) {
-        Variable<std::string>* stringReturnVariable = dynamic_cast<Variable<std::string>*>(returnVariable);
-        llvm::Value *stringConstant = createStringConstant(stringReturnVariable->value);
-        returnPointer = stringConstant;
-    } else {
-        // Handle other return types or error case
-        std::cerr << "Unsupported return type: " << tokenTypeToString(functionBottomReturnType) << "\n";
-        exit(1);
+        if (functionNode->parameters.parameters[argument.getArgNo()]->structType) {
+            localStructs[argument.getName().str()] = &argument;
+            continue;
+        }
+
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(argument.getName().str(), argument.getType());
+        builder.CreateStore(&argument, alloca);
+        localVariables[argument.getName().str()] = alloca;
     }
 
+    // Create the function contents
+    debugPrint(options, "Visiting the statements of function " + functionNode->name + "\n");
+    generateStatementsIR(functionNode->body->statements);
+
+    debugPrint(options, "Creating return instruction for function \"" + functionNode->name + "\"\n");
+
     // Create the return instruction
-    builder.CreateRet(returnPointer);
+    llvm::Value* returnValue = generateExpressionIR(functionNode->returnValue);
+    if (profileRecord) {
+        builder.CreateCall(profileExitFunction, {profileRecord});
+    }
+    builder.CreateRet(returnValue);
 
     // Verify the function
-    debugPrint("Verifying function\n");
+    debugPrint(options, "Verifying function\n");
     llvm::verifyFunction(*function);
-    
+
     return function;
 }
 
-llvm::Value* CodeGenerator::generatePrintStatementIR(PrintNode* printNode) {
-    VariableBase* printValue = printNode->expression;
-    std::string processedValue;
+// A StarshipProfileRecord, see runtime.h. Split modules can all have a copy of a function for inlining,
+// the linker keeps one record per function so the copies count together.
+llvm::GlobalVariable* CodeGenerator::generateProfileRecordIR(FunctionNode* functionNode) {
+    std::string recordName = "starship.profile." + functionNode->name;
+    if (llvm::GlobalVariable* record = module.getNamedGlobal(recordName)) {
+        return record;
+    }
 
-    // Switch through the different types the print value could be and dynamically cast it
-    switch (printValue->type) {
-        case TokenType::INT: {
-            processedValue = std::to_string(dynamic_cast<Variable<int>*>(printValue)->value);
-            break;
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(context);
+    llvm::StructType* recordType = llvm::StructType::get(context, {llvm::Type::getInt8PtrTy(context), int64Type});
+    llvm::Constant* initializer = llvm::ConstantStruct::get(recordType, {createStringConstant(functionNode->name),
+                                                                        llvm::ConstantInt::get(int64Type, 0)});
+
+    llvm::GlobalValue::LinkageTypes linkage = isWholeProgram() ? llvm::GlobalValue::InternalLinkage
+                                                               : llvm::GlobalValue::LinkOnceODRLinkage;
+    auto* record = new llvm::GlobalVariable(module, recordType, false, linkage, initializer, recordName);
+    record->setAlignment(llvm::Align(8));
+    return record;
+}
+
+llvm::GlobalVariable* CodeGenerator::generateGlobalVariableIR(VariableDeclarationNode* declarationNode) {
+    // A variable of another file is defined in that file's module, this one only refers to it
+    if (!definesGlobal(declarationNode)) {
+        auto* global = new llvm::GlobalVariable(module, getLLVMType(declarationNode->type), false,
+                                                llvm::GlobalValue::ExternalLinkage, nullptr, declarationNode->name);
+        globalVariables[declarationNode->name] = global;
+        return global;
+    }
+
+    // Top level variables have to be known at compile time
+    LiteralNode* literal = dynamic_cast<LiteralNode*>(declarationNode->value);
+    if (!literal) {
+        diagnostics.error("The value of top level variable " + declarationNode->name + " must be a constant",
+                          declarationNode->line);
+    }
+
+    llvm::Constant* initializer;
+    if (declarationNode->type == TokenType::INT) {
+        initializer = llvm::ConstantInt::get(context, llvm::APInt(32, literal->value.getInt(), true));
+    } else {
+        initializer = createStringConstant(literal->value.getString());
+    }
+
+    // Split modules share their variables, the LTO link internalizes them again
+    llvm::GlobalValue::LinkageTypes linkage = isWholeProgram() ? llvm::GlobalValue::InternalLinkage
+                                                               : llvm::GlobalValue::ExternalLinkage;
+    auto* global = new llvm::GlobalVariable(module, getLLVMType(declarationNode->type), false,
+                                            linkage, initializer, declarationNode->name);
+    globalVariables[declarationNode->name] = global;
+
+    return global;
+}
+
+void CodeGenerator::generateStatementsIR(const std::vector<ASTNodeBase*>& statements) {
+    // Text of consecutive constant prints, they are written with a single call
+    std::string constantPrintText;
+
+    // Loop through the statements and generate IR for each
+    for (ASTNodeBase* statement : statements) {
+        if (statement == nullptr) {
+            if (options.debugMode) {
+                diagnostics.warning("Statement is nullptr");
+            }
+            continue;
         }
-        case TokenType::STRING: {
-            processedValue = dynamic_cast<Variable<std::string>*>(printValue)->value;
-            break;
+
+        // Debug print the statement type
+        debugPrint(options, "Visiting " + std::string(typeid(*statement).name()) + "\n");
+
+        if (getConstantPrintText(statement, constantPrintText)) {
+            continue;
         }
+
+        generateConstantPrintIR(constantPrintText);
+        constantPrintText.clear();
+
+        generateStatementIR(statement);
     }
 
-    // Check if processedValue is empty
-    if (processedValue.empty()) {
-        std::cerr << "ERROR: Invalid print value\n";
-        exit(1);
+    generateConstantPrintIR(constantPrintText);
+}
+
+void CodeGenerator::generateStatementIR(ASTNodeBase* statement) {
+    if (PrintNode* printNode = dynamic_cast<PrintNode*>(statement)) {
+        debugPrint(options, "Generating print statement IR\n");
+        generatePrintStatementIR(printNode);
+    } else if (CallNode* callNode = dynamic_cast<CallNode*>(statement)) {
+        debugPrint(options, "Generating call statement IR\n");
+        generateCallIR(callNode);
+    } else if (VariableDeclarationNode* declarationNode = dynamic_cast<VariableDeclarationNode*>(statement)) {
+        debugPrint(options, "Generating variable declaration IR\n");
+        generateVariableDeclarationIR(declarationNode);
+    } else if (AssignmentNode* assignmentNode = dynamic_cast<AssignmentNode*>(statement)) {
+        debugPrint(options, "Generating assignment IR\n");
+        generateAssignmentIR(assignmentNode);
+    } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(statement)) {
+        debugPrint(options, "Generating while loop IR\n");
+        generateWhileIR(whileNode);
+    } else if (ForNode* forNode = dynamic_cast<ForNode*>(statement)) {
+        debugPrint(options, "Generating for loop IR\n");
+        generateForIR(forNode);
+    } else {
+        diagnostics.error("Invalid statement \"" + std::string(typeid(*statement).name()) + "\"");
     }
+}
 
-    debugPrint("Creating print statement\n");
+llvm::Value* CodeGenerator::generatePrintStatementIR(PrintNode* printNode) {
+    ExpressionNode* printValue = printNode->expression;
+
+    debugPrint(options, "Creating print statement\n");
 
     /* This will be used in the string case
     // handle different types of \ characters
@@ -255,37 +618,672 @@ llvm::Value* CodeGenerator::generatePrintStatementIR(PrintNode* printNode) {
     }
     */
 
-    llvm::Value* stringValue = createStringConstant(processedValue);
+    // Constants are turned into their text at compile time
+    std::string constantText;
+    if (getConstantPrintText(printNode, constantText)) {
+        generateConstantPrintIR(constantText);
+        return nullptr;
+    }
 
-    debugPrint("Creating printf function call\n");
-    llvm::FunctionType* printfType = llvm::FunctionType::get(
-        llvm::IntegerType::getInt32Ty(context),
-        {llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0)},
-        true
-    );
+    debugPrint(options, "Creating runtime print call\n");
 
-    llvm::FunctionCallee printCallee = module.getOrInsertFunction("printf", printfType);
+    llvm::Value* argumentValue = generateExpressionIR(printValue);
+    if (printValue->type == TokenType::INT) {
+        // The runtime formats 64 bit integers, so sign extend
+        llvm::Value* extendedValue = builder.CreateSExt(argumentValue, llvm::Type::getInt64Ty(context));
+        builder.CreateCall(printIntegerFunction, {extendedValue});
+    } else {
+        builder.CreateCall(printCStringFunction, {argumentValue});
+    }
 
-    debugPrint("Creating call instruction\n");
+    return nullptr;
+}
 
-    llvm::Value* zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 0);
-    llvm::Value* indices[] = {zero, zero};
+void CodeGenerator::declareRuntimeFunctions() {
+    llvm::Type* voidType = llvm::Type::getVoidTy(context);
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(context);
+    llvm::Type* stringType = llvm::Type::getInt8PtrTy(context);
 
-    llvm::Value* stringPointer = builder.CreateGEP(
-        llvm::cast<llvm::PointerType>(stringValue->getType()->getScalarType())->getElementType(),
-        stringValue,
-        indices
-    );
+    // See runtime/runtime.h, none of them return anything
+    printIntegerFunction = module.getOrInsertFunction("starship_print_i64", voidType, int64Type);
+    printStringFunction = module.getOrInsertFunction("starship_print_str", voidType, stringType, int64Type);
+    printCStringFunction = module.getOrInsertFunction("starship_print_cstr", voidType, stringType);
 
-    builder.CreateCall(printCallee, {stringPointer});
+    // Never return, so the checks they guard stay out of the hot path
+    llvm::Type* int32Type = llvm::Type::getInt32Ty(context);
+    boundsFailFunction = module.getOrInsertFunction("starship_bounds_fail", voidType, int64Type, int64Type, int32Type);
+    divisionFailFunction = module.getOrInsertFunction("starship_division_fail", voidType, int32Type, int32Type);
+    for (llvm::FunctionCallee hook : {boundsFailFunction, divisionFailFunction}) {
+        if (llvm::Function* function = llvm::dyn_cast<llvm::Function>(hook.getCallee())) {
+            function->addFnAttr(llvm::Attribute::NoReturn);
+            function->addFnAttr(llvm::Attribute::Cold);
+            function->addFnAttr(llvm::Attribute::NoUnwind);
+        }
+    }
 
-    return nullptr;
+    if (options.instrumentFunctions) {
+        llvm::Type* recordType = llvm::Type::getInt8PtrTy(context);
+        profileEnterFunction = module.getOrInsertFunction("starship_profile_enter", voidType, recordType);
+        profileExitFunction = module.getOrInsertFunction("starship_profile_exit", voidType, recordType);
+        for (llvm::FunctionCallee hook : {profileEnterFunction, profileExitFunction}) {
+            if (llvm::Function* function = llvm::dyn_cast<llvm::Function>(hook.getCallee())) {
+                function->addFnAttr(llvm::Attribute::NoUnwind);
+            }
+        }
+    }
+}
+
+bool CodeGenerator::getConstantPrintText(ASTNodeBase* statement, std::string& text) {
+    PrintNode* printNode = dynamic_cast<PrintNode*>(statement);
+    if (!printNode) {
+        return false;
+    }
+
+    LiteralNode* literal = dynamic_cast<LiteralNode*>(printNode->expression);
+    if (!literal) {
+        return false;
+    }
+
+    if (literal->type == TokenType::INT) {
+        text += std::to_string(literal->value.getInt());
+    } else {
+        text += literal->value.getString();
+    }
+
+    return true;
+}
+
+void CodeGenerator::generateConstantPrintIR(const std::string& text) {
+    if (text.empty()) {
+        return;
+    }
+
+    // The length is known here, so the runtime never has to look for the terminator
+    llvm::Value* length = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), text.size());
+    builder.CreateCall(printStringFunction, {createStringConstant(text), length});
+}
+
+// The elements of a @comptime array, it is never written so it can live in read-only data
+llvm::GlobalVariable* CodeGenerator::generateConstantArrayIR(VariableDeclarationNode* declarationNode) {
+    std::vector<uint32_t> elements(declarationNode->values.begin(), declarationNode->values.end());
+    llvm::Constant* initializer = llvm::ConstantDataArray::get(context, elements);
+
+    auto* global = new llvm::GlobalVariable(module, getArrayType(declarationNode->arrayLength), true,
+                                            llvm::GlobalValue::PrivateLinkage, initializer, declarationNode->name);
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    global->setAlignment(llvm::Align(16));
+
+    return global;
+}
+
+llvm::Value* CodeGenerator::generateVariableDeclarationIR(VariableDeclarationNode* declarationNode) {
+    if (declarationNode->constant) {
+        llvm::GlobalVariable* global = generateConstantArrayIR(declarationNode);
+        localArrays[declarationNode->name] = global;
+        return global;
+    }
+
+    // Arrays are zeroed every time the declaration runs, also inside of loops
+    if (declarationNode->arrayLength > 0) {
+        llvm::ArrayType* arrayType = getArrayType(declarationNode->arrayLength);
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(declarationNode->name, arrayType);
+        alloca->setAlignment(llvm::Align(16));
+
+        builder.CreateMemSet(alloca, builder.getInt8(0), declarationNode->arrayLength * 4, llvm::MaybeAlign(16));
+        localArrays[declarationNode->name] = alloca;
+
+        return alloca;
+    }
+
+    // So are structs, only their strings are set to "" so they can be printed right away
+    if (declarationNode->structType) {
+        const StructLayout* layout = declarationNode->structType;
+        llvm::AllocaInst* alloca = createEntryBlockAlloca(declarationNode->name, getStructType(layout));
+        alloca->setAlignment(llvm::Align(layout->alignment));
+        localStructs[declarationNode->name] = alloca;
+
+        builder.CreateMemSet(alloca, builder.getInt8(0), layout->size, llvm::MaybeAlign(layout->alignment));
+        for (const StructField& field : layout->fields) {
+            if (field.type == TokenType::STRING) {
+                builder.CreateAlignedStore(createStringConstant(""),
+                                           generateFieldPointerIR(declarationNode->name, layout, &field),
+                                           llvm::Align(field.alignment));
+            }
+        }
+
+        return alloca;
+    }
+
+    llvm::Value* value = generateExpressionIR(declarationNode->value);
+
+    llvm::AllocaInst* alloca = createEntryBlockAlloca(declarationNode->name, getLLVMType(declarationNode->type));
+    builder.CreateStore(value, alloca);
+    localVariables[declarationNode->name] = alloca;
+
+    return alloca;
+}
+
+llvm::Value* CodeGenerator::generateAssignmentIR(AssignmentNode* assignmentNode) {
+    if (assignmentNode->index) {
+        llvm::Value* element = generateElementPointerIR(assignmentNode->name, assignmentNode->index,
+                                                        assignmentNode->arrayLength, assignmentNode->line);
+        llvm::Value* value = generateExpressionIR(assignmentNode->value);
+        return builder.CreateStore(value, element);
+    }
+
+    // Fields of @packed structs can be anywhere, the store only assumes the alignment the layout gives it
+    if (assignmentNode->field) {
+        llvm::Value* value = generateExpressionIR(assignmentNode->value);
+        llvm::Value* field = generateFieldPointerIR(assignmentNode->name, assignmentNode->structType, assignmentNode->field);
+        return builder.CreateAlignedStore(value, field, llvm::Align(assignmentNode->field->alignment));
+    }
+
+    llvm::Value* value = generateExpressionIR(assignmentNode->value);
+    return builder.CreateStore(value, findVariableStorage(assignmentNode->name));
+}
+
+// Loops come out in the shape LLVM's loop passes expect: a preheader, a header with the condition,
+// the body, a latch with the step and a single exit. Rotation and the vectorizers take it from there.
+void CodeGenerator::generateWhileIR(WhileNode* whileNode) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+
+    llvm::BasicBlock* conditionBlock = llvm::BasicBlock::Create(context, "while.cond", function);
+    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(context, "while.body", function);
+    llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(context, "while.end", function);
+
+    builder.CreateBr(conditionBlock);
+
+    builder.SetInsertPoint(conditionBlock);
+    builder.CreateCondBr(generateConditionIR(whileNode->condition), bodyBlock, endBlock);
+
+    // Variables declared in the body are gone after it
+    auto savedVariables = localVariables;
+    auto savedArrays = localArrays;
+    auto savedStructs = localStructs;
+
+    builder.SetInsertPoint(bodyBlock);
+    generateStatementsIR(whileNode->body);
+    builder.CreateBr(conditionBlock);
+
+    localVariables = savedVariables;
+    localArrays = savedArrays;
+    localStructs = savedStructs;
+
+    builder.SetInsertPoint(endBlock);
+}
+
+void CodeGenerator::generateForIR(ForNode* forNode) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+
+    // The loop variable only lives as long as the loop
+    auto savedVariables = localVariables;
+    auto savedArrays = localArrays;
+    auto savedStructs = localStructs;
+
+    if (forNode->initializer) {
+        generateStatementIR(forNode->initializer);
+    }
+
+    // The loop is generated twice, without the checks hoistBoundsChecks covers when the whole range is in
+    // bounds and with every check otherwise. The checked copy fails at the same access as starship interp,
+    // after the same output and the same writes. Size optimized builds keep the one checked copy.
+    std::set<std::pair<std::string, std::string>> loopChecks;
+    llvm::Value* inBounds = options.sizeLevel > 0 ? nullptr : hoistBoundsChecks(forNode, loopChecks);
+    if (!inBounds) {
+        generateLoopIR(forNode, "for");
+    } else {
+        llvm::BasicBlock* fastBlock = llvm::BasicBlock::Create(context, "for.fast", function);
+        llvm::BasicBlock* checkedBlock = llvm::BasicBlock::Create(context, "for.checked", function);
+        llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(context, "for.versions.end", function);
+
+        llvm::MDBuilder metadataBuilder(context);
+        builder.CreateCondBr(inBounds, fastBlock, checkedBlock, metadataBuilder.createBranchWeights(1 << 20, 1));
+
+        auto savedChecks = hoistedBoundsChecks;
+        hoistedBoundsChecks.insert(loopChecks.begin(), loopChecks.end());
+        builder.SetInsertPoint(fastBlock);
+        generateLoopIR(forNode, "for.fast");
+        builder.CreateBr(endBlock);
+        hoistedBoundsChecks = savedChecks;
+
+        builder.SetInsertPoint(checkedBlock);
+        generateLoopIR(forNode, "for.checked");
+        builder.CreateBr(endBlock);
+
+        builder.SetInsertPoint(endBlock);
+    }
+
+    localVariables = savedVariables;
+    localArrays = savedArrays;
+    localStructs = savedStructs;
+}
+
+// The condition, body and step of a for loop, its initializer already ran. Leaves the builder after the loop.
+void CodeGenerator::generateLoopIR(ForNode* forNode, const std::string& name) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+
+    llvm::BasicBlock* conditionBlock = llvm::BasicBlock::Create(context, name + ".cond", function);
+    llvm::BasicBlock* bodyBlock = llvm::BasicBlock::Create(context, name + ".body", function);
+    llvm::BasicBlock* stepBlock = llvm::BasicBlock::Create(context, name + ".step", function);
+    llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(context, name + ".end", function);
+
+    builder.CreateBr(conditionBlock);
+
+    builder.SetInsertPoint(conditionBlock);
+    builder.CreateCondBr(generateConditionIR(forNode->condition), bodyBlock, endBlock);
+
+    builder.SetInsertPoint(bodyBlock);
+    auto bodyVariables = localVariables;
+    auto bodyArrays = localArrays;
+    auto bodyStructs = localStructs;
+    generateStatementsIR(forNode->body);
+    localVariables = bodyVariables;
+    localArrays = bodyArrays;
+    localStructs = bodyStructs;
+    builder.CreateBr(stepBlock);
+
+    builder.SetInsertPoint(stepBlock);
+    generateAssignmentIR(forNode->step);
+    builder.CreateBr(conditionBlock);
+
+    builder.SetInsertPoint(endBlock);
+}
+
+// Every name the statements declare or assign, nested loops included
+static void collectWrittenNames(const std::vector<ASTNodeBase*>& statements, std::set<std::string>& names) {
+    for (ASTNodeBase* statement : statements) {
+        if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            names.insert(declaration->name);
+        } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(statement)) {
+            // Writing an element or a field doesn't change what the name refers to
+            if (!assignment->index && !assignment->field) {
+                names.insert(assignment->name);
+            }
+        } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(statement)) {
+            collectWrittenNames(whileNode->body, names);
+        } else if (ForNode* forNode = dynamic_cast<ForNode*>(statement)) {
+            collectWrittenNames({forNode->initializer, forNode->step}, names);
+            collectWrittenNames(forNode->body, names);
+        }
+    }
+}
+
+// Arrays indexed with exactly the variable index somewhere in the expression
+static void collectIndexedArrays(ExpressionNode* expression, const std::string& index, std::set<std::string>& arrays) {
+    if (IndexNode* indexNode = dynamic_cast<IndexNode*>(expression)) {
+        VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(indexNode->index);
+        if (reference && reference->name == index) {
+            arrays.insert(indexNode->name);
+        }
+        collectIndexedArrays(indexNode->index, index, arrays);
+    } else if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(expression)) {
+        collectIndexedArrays(binaryNode->left, index, arrays);
+        collectIndexedArrays(binaryNode->right, index, arrays);
+    } else if (CallNode* callNode = dynamic_cast<CallNode*>(expression)) {
+        for (ExpressionNode* argument : callNode->arguments) {
+            collectIndexedArrays(argument, index, arrays);
+        }
+    }
+}
+
+// A for loop like for (i = A; i < B; i = i + c) with c > 0 only ever indexes with values in [A, B).
+// If the body uses array[i] on every iteration, one check in front of the loop covers every access
+// and the body is left without branches. Accesses that don't fit the pattern keep their own check.
+// Returns whether every such access is in bounds, nullptr when nothing could be hoisted, and adds the
+// (array, index variable) pairs the result covers to checks.
+llvm::Value* CodeGenerator::hoistBoundsChecks(ForNode* forNode, std::set<std::pair<std::string, std::string>>& checks) {
+    // The step has to be i = i + c
+    AssignmentNode* step = forNode->step;
+    const std::string& inductionName = step->name;
+    BinaryExpressionNode* increment = dynamic_cast<BinaryExpressionNode*>(step->value);
+    if (step->index || !increment || increment->operatorType != TokenType::PLUS) {
+        return nullptr;
+    }
+
+    VariableReferenceNode* incremented = dynamic_cast<VariableReferenceNode*>(increment->left);
+    LiteralNode* stride = dynamic_cast<LiteralNode*>(increment->right);
+    if (!incremented || incremented->name != inductionName || !stride ||
+        stride->value.getInt() <= 0) {
+        return nullptr;
+    }
+
+    // The condition has to be i < B or i <= B
+    BinaryExpressionNode* condition = dynamic_cast<BinaryExpressionNode*>(forNode->condition);
+    if (!condition || (condition->operatorType != TokenType::LESS && condition->operatorType != TokenType::LESS_EQUAL)) {
+        return nullptr;
+    }
+
+    VariableReferenceNode* compared = dynamic_cast<VariableReferenceNode*>(condition->left);
+    if (!compared || compared->name != inductionName) {
+        return nullptr;
+    }
+
+    // Calls can change globals, so i and B have to be locals the body leaves alone
+    std::set<std::string> writtenNames;
+    collectWrittenNames(forNode->body, writtenNames);
+
+    if (!localVariables.count(inductionName) || writtenNames.count(inductionName)) {
+        return nullptr;
+    }
+
+    VariableReferenceNode* boundReference = dynamic_cast<VariableReferenceNode*>(condition->right);
+    if (!dynamic_cast<LiteralNode*>(condition->right) &&
+        (!boundReference || !localVariables.count(boundReference->name) ||
+         writtenNames.count(boundReference->name) || boundReference->name == inductionName)) {
+        return nullptr;
+    }
+
+    // Only the statements directly in the body run on every iteration
+    std::set<std::string> indexedArrays;
+    for (ASTNodeBase* statement : forNode->body) {
+        if (PrintNode* printNode = dynamic_cast<PrintNode*>(statement)) {
+            collectIndexedArrays(printNode->expression, inductionName, indexedArrays);
+        } else if (CallNode* callNode = dynamic_cast<CallNode*>(statement)) {
+            collectIndexedArrays(callNode, inductionName, indexedArrays);
+        } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            collectIndexedArrays(declaration->value, inductionName, indexedArrays);
+        } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(statement)) {
+            VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(assignment->index);
+            if (reference && reference->name == inductionName) {
+                indexedArrays.insert(assignment->name);
+            }
+            collectIndexedArrays(assignment->index, inductionName, indexedArrays);
+            collectIndexedArrays(assignment->value, inductionName, indexedArrays);
+        }
+    }
+
+    // The shortest array decides, arrays the body redeclares are different arrays
+    std::size_t shortestLength = SIZE_MAX;
+    for (const std::string& array : indexedArrays) {
+        if (localArrays.count(array) && !writtenNames.count(array)) {
+            shortestLength = std::min(shortestLength, localArrays.at(array)->getType()->getPointerElementType()->getArrayNumElements());
+        }
+    }
+
+    if (shortestLength == SIZE_MAX) {
+        return nullptr;
+    }
+
+    // In bounds unless A < B && (A < 0 || last >= length). The loop stops at B - 1, or B itself for <=, but with a
+    // stride above 1 the last index it really uses is A + (B - 1 - A) / c * c. That's worked out in 64 bits,
+    // B - 1 - A doesn't always fit an int.
+    llvm::Type* intType = llvm::Type::getInt32Ty(context);
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(context);
+    llvm::Value* first = builder.CreateLoad(intType, localVariables.at(inductionName), inductionName + ".first");
+    llvm::Value* bound = generateExpressionIR(condition->right);
+
+    bool inclusive = condition->operatorType == TokenType::LESS_EQUAL;
+    llvm::Value* entered = inclusive ? builder.CreateICmpSLE(first, bound) : builder.CreateICmpSLT(first, bound);
+
+    llvm::Value* wideFirst = builder.CreateSExt(first, int64Type);
+    llvm::Value* wideBound = builder.CreateSExt(bound, int64Type);
+    llvm::Value* last = inclusive ? wideBound : builder.CreateSub(wideBound, llvm::ConstantInt::get(int64Type, 1));
+    int strideValue = stride->value.getInt();
+    if (strideValue > 1) {
+        // Only used once the loop is entered, so last >= A and the division rounds down
+        llvm::Value* wideStride = llvm::ConstantInt::get(int64Type, strideValue);
+        llvm::Value* steps = builder.CreateSDiv(builder.CreateSub(last, wideFirst), wideStride);
+        last = builder.CreateAdd(wideFirst, builder.CreateMul(steps, wideStride), inductionName + ".last");
+    }
+
+    llvm::Value* length = llvm::ConstantInt::get(int64Type, shortestLength);
+    llvm::Value* firstOutOfBounds = builder.CreateICmpSLT(first, llvm::ConstantInt::get(intType, 0));
+    llvm::Value* lastOutOfBounds = builder.CreateICmpSGE(last, length);
+    llvm::Value* failed = builder.CreateAnd(entered, builder.CreateOr(firstOutOfBounds, lastOutOfBounds));
+
+    for (const std::string& array : indexedArrays) {
+        if (localArrays.count(array) && !writtenNames.count(array)) {
+            checks.insert({array, inductionName});
+        }
+    }
+
+    return builder.CreateNot(failed, inductionName + ".inbounds");
 }
 
-llvm::Value* CodeGenerator::createStringConstant(const std::string& value) {
-    llvm::IRBuilder<> builder(context);
-    builder.SetInsertPoint(&module.getFunctionList().front().getEntryBlock(), module.getFunctionList().front().getEntryBlock().begin());
-    llvm::Value *valStr = builder.CreateGlobalString(value);
+// Loop conditions branch on the comparison directly instead of going through an int
+llvm::Value* CodeGenerator::generateConditionIR(ExpressionNode* condition) {
+    BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(condition);
+    if (binaryNode) {
+        switch (binaryNode->operatorType) {
+            case TokenType::LESS:
+                return builder.CreateICmpSLT(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            case TokenType::LESS_EQUAL:
+                return builder.CreateICmpSLE(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            case TokenType::GREATER:
+                return builder.CreateICmpSGT(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            case TokenType::GREATER_EQUAL:
+                return builder.CreateICmpSGE(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            case TokenType::EQUAL_EQUAL:
+                return builder.CreateICmpEQ(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            case TokenType::BANG_EQUAL:
+                return builder.CreateICmpNE(generateExpressionIR(binaryNode->left), generateExpressionIR(binaryNode->right));
+            default:
+                break;
+        }
+    }
+
+    return builder.CreateICmpNE(generateExpressionIR(condition), llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), 0));
+}
+
+// &array[index], with a bounds check unless a loop already did it for the whole range
+llvm::Value* CodeGenerator::generateElementPointerIR(const std::string& name, ExpressionNode* index,
+                                                     std::size_t arrayLength, std::size_t line) {
+    llvm::Value* array = localArrays.at(name);
+    llvm::Value* indexValue = generateExpressionIR(index);
+
+    VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(index);
+    bool checked = dynamic_cast<LiteralNode*>(index) != nullptr; // The parser checked constants
+    if (reference && hoistedBoundsChecks.count({name, reference->name})) {
+        checked = true;
+    }
+
+    llvm::Value* length = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), arrayLength);
+    if (!checked) {
+        // Unsigned, so negative indices fail too
+        generateBoundsCheckIR(builder.CreateICmpUGE(indexValue, length), indexValue, length, line);
+    }
+
+    // The index is known to be in bounds here, so the address is inbounds
+    llvm::Value* zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 0);
+    llvm::Value* wideIndex = builder.CreateSExt(indexValue, llvm::Type::getInt64Ty(context));
+    return builder.CreateInBoundsGEP(getArrayType(arrayLength), array, {zero, wideIndex}, name + ".address");
+}
+
+void CodeGenerator::generateBoundsCheckIR(llvm::Value* failed, llvm::Value* index, llvm::Value* length, std::size_t line) {
+    llvm::Function* function = builder.GetInsertBlock()->getParent();
+
+    llvm::BasicBlock* failBlock = llvm::BasicBlock::Create(context, "bounds.fail", function);
+    llvm::BasicBlock* continueBlock = llvm::BasicBlock::Create(context, "bounds.ok", function);
+
+    llvm::MDBuilder metadataBuilder(context);
+    builder.CreateCondBr(failed, failBlock, continueBlock, metadataBuilder.createBranchWeights(1, 1 << 20));
+
+    builder.SetInsertPoint(failBlock);
+    llvm::Type* int64Type = llvm::Type::getInt64Ty(context);
+    builder.CreateCall(boundsFailFunction, {builder.CreateSExt(index, int64Type), builder.CreateSExt(length, int64Type),
+                                            llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), line)});
+    builder.CreateUnreachable();
+
+    builder.SetInsertPoint(continueBlock);
+}
+
+llvm::Value* CodeGenerator::generateExpressionIR(ExpressionNode* expression) {
+    if (LiteralNode* literal = dynamic_cast<LiteralNode*>(expression)) {
+        return generateConstantIR(literal->value);
+    }
+
+    if (VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(expression)) {
+        // A whole array or struct is only ever passed to a function, by reference
+        if (reference->arrayLength > 0) {
+            return localArrays.at(reference->name);
+        }
+        if (reference->structType) {
+            return localStructs.at(reference->name);
+        }
+
+        return builder.CreateLoad(getLLVMType(reference->type), findVariableStorage(reference->name), reference->name);
+    }
+
+    if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(expression)) {
+        return generateBinaryExpressionIR(binaryNode);
+    }
+
+    if (IndexNode* indexNode = dynamic_cast<IndexNode*>(expression)) {
+        llvm::Value* element = generateElementPointerIR(indexNode->name, indexNode->index, indexNode->arrayLength, indexNode->line);
+        return builder.CreateLoad(llvm::Type::getInt32Ty(context), element, indexNode->name + ".element");
+    }
+
+    if (FieldNode* fieldNode = dynamic_cast<FieldNode*>(expression)) {
+        llvm::Value* field = generateFieldPointerIR(fieldNode->name, fieldNode->structType, fieldNode->field);
+        return builder.CreateAlignedLoad(getLLVMType(fieldNode->type), field, llvm::Align(fieldNode->field->alignment),
+                                         fieldNode->name + "." + fieldNode->field->name + ".value");
+    }
+
+    if (CallNode* callNode = dynamic_cast<CallNode*>(expression)) {
+        return generateCallIR(callNode);
+    }
+
+    diagnostics.error("Invalid expression \"" + std::string(typeid(*expression).name()) + "\"", expression->line);
+}
+
+// sdiv traps on a zero divisor and on INT_MIN / -1, the program would die without flushing its output.
+// Constant divisors other than 0 and -1 can't do either and need no check.
+llvm::Value* CodeGenerator::generateDivisionIR(llvm::Value* left, llvm::Value* right, std::size_t line) {
+    llvm::ConstantInt* constantDivisor = llvm::dyn_cast<llvm::ConstantInt>(right);
+    if (!constantDivisor || constantDivisor->isZero() || constantDivisor->isMinusOne()) {
+        llvm::Type* intType = llvm::Type::getInt32Ty(context);
+        llvm::Value* overflow = builder.CreateAnd(builder.CreateICmpEQ(left, llvm::ConstantInt::get(intType, INT32_MIN)),
+                                                  builder.CreateICmpEQ(right, llvm::ConstantInt::getSigned(intType, -1)));
+        llvm::Value* failed = builder.CreateOr(builder.CreateICmpEQ(right, llvm::ConstantInt::get(intType, 0)), overflow);
+
+        llvm::Function* function = builder.GetInsertBlock()->getParent();
+        llvm::BasicBlock* failBlock = llvm::BasicBlock::Create(context, "division.fail", function);
+        llvm::BasicBlock* continueBlock = llvm::BasicBlock::Create(context, "division.ok", function);
+
+        llvm::MDBuilder metadataBuilder(context);
+        builder.CreateCondBr(failed, failBlock, continueBlock, metadataBuilder.createBranchWeights(1, 1 << 20));
+
+        builder.SetInsertPoint(failBlock);
+        builder.CreateCall(divisionFailFunction, {right, llvm::ConstantInt::get(intType, line)});
+        builder.CreateUnreachable();
+
+        builder.SetInsertPoint(continueBlock);
+    }
+
+    return builder.CreateSDiv(left, right);
+}
+
+llvm::Value* CodeGenerator::generateBinaryExpressionIR(BinaryExpressionNode* binaryNode) {
+    llvm::Value* left = generateExpressionIR(binaryNode->left);
+    llvm::Value* right = generateExpressionIR(binaryNode->right);
+
+    // Signed overflow is undefined for int, so add, sub and mul can carry nsw
+    switch (binaryNode->operatorType) {
+        case TokenType::PLUS:
+            return builder.CreateNSWAdd(left, right);
+        case TokenType::MINUS:
+            return builder.CreateNSWSub(left, right);
+        case TokenType::STAR:
+            return builder.CreateNSWMul(left, right);
+        case TokenType::SLASH:
+            return generateDivisionIR(left, right, binaryNode->line);
+        default:
+            break;
+    }
+
+    // Comparisons give an int, 1 for true and 0 for false
+    llvm::Type* intType = llvm::Type::getInt32Ty(context);
+    switch (binaryNode->operatorType) {
+        case TokenType::LESS:
+            return builder.CreateZExt(builder.CreateICmpSLT(left, right), intType);
+        case TokenType::LESS_EQUAL:
+            return builder.CreateZExt(builder.CreateICmpSLE(left, right), intType);
+        case TokenType::GREATER:
+            return builder.CreateZExt(builder.CreateICmpSGT(left, right), intType);
+        case TokenType::GREATER_EQUAL:
+            return builder.CreateZExt(builder.CreateICmpSGE(left, right), intType);
+        case TokenType::EQUAL_EQUAL:
+            return builder.CreateZExt(builder.CreateICmpEQ(left, right), intType);
+        case TokenType::BANG_EQUAL:
+            return builder.CreateZExt(builder.CreateICmpNE(left, right), intType);
+        default:
+            break;
+    }
+
+    diagnostics.error("Invalid operator " + tokenTypeToString(binaryNode->operatorType), binaryNode->line);
+}
+
+llvm::Value* CodeGenerator::generateCallIR(CallNode* callNode) {
+    llvm::Function* callee = module.getFunction(callNode->name);
+
+    std::vector<llvm::Value*> arguments;
+    for (ExpressionNode* argument : callNode->arguments) {
+        arguments.push_back(generateExpressionIR(argument));
+    }
+
+    llvm::CallInst* call = builder.CreateCall(callee, arguments);
+    call->setCallingConv(callee->getCallingConv());
+    return call;
+}
+
+llvm::Value* CodeGenerator::generateConstantIR(const ConstValue& value) {
+    switch (value.getType()) {
+        case TokenType::INT: {
+            return llvm::ConstantInt::get(context, llvm::APInt(32, value.getInt(), true));
+        }
+        case TokenType::STRING: {
+            return createStringConstant(value.getString());
+        }
+        default:
+            break;
+    }
+
+    diagnostics.error("Unsupported value type: " + tokenTypeToString(value.getType()));
+}
+
+// Allocas go at the top of the entry block, that's where mem2reg looks for them
+llvm::AllocaInst* CodeGenerator::createEntryBlockAlloca(const std::string& name, llvm::Type* type) {
+    llvm::BasicBlock& entryBlock = builder.GetInsertBlock()->getParent()->getEntryBlock();
+
+    llvm::IRBuilder<> entryBuilder(&entryBlock, entryBlock.begin());
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+llvm::Value* CodeGenerator::findVariableStorage(const std::string& name) {
+    // Locals shadow globals
+    auto local = localVariables.find(name);
+    if (local != localVariables.end()) {
+        return local->second;
+    }
+
+    auto global = globalVariables.find(name);
+    if (global != globalVariables.end()) {
+        return global->second;
+    }
+
+    diagnostics.error("Variable " + name + " has no storage");
+}
+
+// Every literal with the same contents shares one global, the pool lives as long as the module
+llvm::Constant* CodeGenerator::createStringConstant(const std::string& value) {
+    auto pooled = stringConstants.find(value);
+    if (pooled != stringConstants.end()) {
+        return pooled->second;
+    }
+
+    // private unnamed_addr constant C strings go to the mergeable .rodata.str sections,
+    // so the linker can fold them with identical strings from other objects too
+    llvm::Constant* stringData = llvm::ConstantDataArray::getString(context, value);
+    auto* stringGlobal = new llvm::GlobalVariable(module, stringData->getType(), true,
+                                                  llvm::GlobalValue::PrivateLinkage, stringData, ".str");
+    stringGlobal->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    stringGlobal->setAlignment(llvm::Align(1));
+
+    // A constant GEP to the first character, it needs no insert point so globals can use it too
+    llvm::Constant* zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 0);
+    llvm::Constant* stringPointer = llvm::ConstantExpr::getInBoundsGetElementPtr(
+        stringData->getType(), stringGlobal, llvm::ArrayRef<llvm::Constant*>{zero, zero});
 
-    return valStr;
+    stringConstants[value] = stringPointer;
+    return stringPointer;
 }
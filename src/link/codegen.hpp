@@ -10,25 +10,156 @@
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 
+#include <map>
+#include <set>
 #include <utility>
 
 #include "../parser/parser.hpp"
-#include "../util/globals.hpp"
+#include "../parser/effects.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+#include "../util/stats.hpp"
 
 class CodeGenerator {
 public:
-    CodeGenerator(llvm::Module& module);
-    void generateIR(ASTTree* rootNode);
+    // With statistics that read hardware counters, every function's IR generation is measured
+    CodeGenerator(llvm::Module& module, const CompilerOptions& options, Diagnostics& diagnostics,
+                  CompilerStatistics* statistics = nullptr);
+    // With a sourceIndex only the functions and variables of that file are defined, everything else
+    // is declared. That's how every file gets a module of its own for ThinLTO.
+    void generateIR(ASTTree* rootNode, int sourceIndex = -1);
+
+    // Only defines function, the functions it can reach come along as available_externally so they can
+    // still be inlined. With nullptr only the global variables are defined. That's what --function-cache stores.
+    void generateFunctionIR(ASTTree* rootNode, FunctionNode* function);
+
+    // --pipeline, the module is generated while the tree is still being parsed. First the declarations,
+    // then every function the parser finished, then what needs the whole tree: the attributes from the
+    // function effects and dropping the prototypes of functions the parser threw away.
+    void generateDeclarationsIR(ASTTree* rootNode);
+    void generateStreamedFunctionIR(FunctionNode* functionNode);
+    void finishStreamedIR(ASTTree* rootNode);
+
+    // --low-memory, a module that only defines the functions of group. Their direct callees come along as
+    // available_externally for inlining and what those call is declared, so no module grows with the program.
+    // The effects are the whole program's, worked out before any bodies were released.
+    void generateFunctionGroupIR(const std::vector<FunctionNode*>& group, const std::map<std::string, FunctionNode*>& functions,
+                                 const std::vector<VariableDeclarationNode*>& globals,
+                                 const std::map<std::string, FunctionEffects>& effects);
 
 private:
+    void generateModuleIR(ASTTree* rootNode);
+    void verifyModuleIR();
+    bool definesFunction(FunctionNode* functionNode) const;
+    bool definesGlobal(VariableDeclarationNode* declarationNode) const;
+    bool isWholeProgram() const;
+
+    llvm::Function* generateFunctionPrototypeIR(FunctionNode* functionNode);
+    void addEffectAttributes(llvm::Function* function);
     llvm::Function* generateFunctionDeclarationIR(FunctionNode* functionNode);
+    llvm::GlobalVariable* generateProfileRecordIR(FunctionNode* functionNode);
+    llvm::GlobalVariable* generateGlobalVariableIR(VariableDeclarationNode* declarationNode);
+    llvm::GlobalVariable* generateConstantArrayIR(VariableDeclarationNode* declarationNode);
+
+    // Statements
+    void generateStatementsIR(const std::vector<ASTNodeBase*>& statements);
+    void generateStatementIR(ASTNodeBase* statement);
     llvm::Value* generatePrintStatementIR(PrintNode* printNode);
+    llvm::Value* generateVariableDeclarationIR(VariableDeclarationNode* declarationNode);
+    llvm::Value* generateAssignmentIR(AssignmentNode* assignmentNode);
+
+    // Loops and arrays
+    void generateWhileIR(WhileNode* whileNode);
+    void generateForIR(ForNode* forNode);
+    void generateLoopIR(ForNode* forNode, const std::string& name);
+    llvm::Value* hoistBoundsChecks(ForNode* forNode, std::set<std::pair<std::string, std::string>>& checks);
+    llvm::Value* generateConditionIR(ExpressionNode* condition);
+    llvm::Value* generateElementPointerIR(const std::string& name, ExpressionNode* index, std::size_t arrayLength, std::size_t line);
+    void generateBoundsCheckIR(llvm::Value* failed, llvm::Value* index, llvm::Value* length, std::size_t line);
+    llvm::ArrayType* getArrayType(std::size_t arrayLength);
+
+    // Structs
+    llvm::StructType* getStructType(const StructLayout* layout);
+    llvm::Value* generateFieldPointerIR(const std::string& name, const StructLayout* layout, const StructField* field);
 
-    llvm::Value* createStringConstant(const std::string& value);
+    // Expressions
+    llvm::Value* generateExpressionIR(ExpressionNode* expression);
+    llvm::Value* generateBinaryExpressionIR(BinaryExpressionNode* binaryNode);
+    llvm::Value* generateDivisionIR(llvm::Value* left, llvm::Value* right, std::size_t line);
+    llvm::Value* generateCallIR(CallNode* callNode);
+    llvm::Value* generateConstantIR(const ConstValue& value);
+
+    llvm::Type* getLLVMType(TokenType type, std::size_t arrayLength = 0, const StructLayout* structType = nullptr);
+    llvm::AllocaInst* createEntryBlockAlloca(const std::string& name, llvm::Type* type);
+    llvm::Value* findVariableStorage(const std::string& name);
+
+    llvm::Constant* createStringConstant(const std::string& value);
+
+    // Print support, the runtime's functions are declared once per module
+    void declareRuntimeFunctions();
+    bool getConstantPrintText(ASTNodeBase* statement, std::string& text);
+    void generateConstantPrintIR(const std::string& text);
 
     llvm::Module& module;
-    llvm::IRBuilder<> builder;
     llvm::LLVMContext& context;
+    llvm::IRBuilder<> builder;
+
+    // Where each variable lives, allocas of the current function and the module's globals
+    std::map<std::string, llvm::AllocaInst*> localVariables;
+    std::map<std::string, llvm::GlobalVariable*> globalVariables;
+
+    // Arrays of the current function, pointers to their [N x i32], locals are allocas and parameters are passed in
+    std::map<std::string, llvm::Value*> localArrays;
+
+    // Top level @comptime arrays, every function starts out seeing them
+    std::map<std::string, llvm::Value*> globalArrays;
+
+    // Structs of the current function like localArrays, allocas or parameters pointing to the caller's
+    std::map<std::string, llvm::Value*> localStructs;
+
+    // The type of each struct, with the element of the type every field is in. Padding takes elements too.
+    std::map<const StructLayout*, llvm::StructType*> structTypes;
+    std::map<const StructField*, unsigned> fieldElements;
+
+    // (array, index variable) pairs whose bounds the enclosing loops already checked, see generateForIR
+    std::set<std::pair<std::string, std::string>> hoistedBoundsChecks;
+
+    // String literal contents to the pointer of their pooled global
+    std::map<std::string, llvm::Constant*> stringConstants;
+
+    // What each function can do, decides the attributes of its prototype
+    std::map<std::string, FunctionEffects> functionEffects;
+
+    // The file this module defines, -1 for all of them
+    int definedSource = -1;
+
+    // Set by generateFunctionIR, the function the module defines and the ones it can reach.
+    // generateFunctionGroupIR leaves definedFunction alone, its functions are in definedGroup.
+    bool splitByFunction = false;
+    FunctionNode* definedFunction = nullptr;
+    std::vector<FunctionNode*> definedGroup;
+    std::set<std::string> inlinableFunctions;
+
+    // Set by generateDeclarationsIR, every function that got a prototype
+    std::vector<std::string> declaredFunctions;
+
+    llvm::FunctionCallee printIntegerFunction;
+    llvm::FunctionCallee printStringFunction;
+    llvm::FunctionCallee printCStringFunction;
+    llvm::FunctionCallee boundsFailFunction;
+    llvm::FunctionCallee divisionFailFunction;
+
+    // --instrument=functions
+    llvm::FunctionCallee profileEnterFunction;
+    llvm::FunctionCallee profileExitFunction;
+
+    const CompilerOptions& options;
+    Diagnostics& diagnostics;
+    CompilerStatistics* statistics;
+
+    // Attached to every function so the backend and inliner agree on the target
+    std::string targetCPU;
+    std::string targetFeatures;
 };
 
 #endif  // CODEGEN_HPP
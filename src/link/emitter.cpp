@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Bitcode/BitcodeWriterPass.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "emitter.hpp"
+
+// LLVM's target registry is process-wide, so only initialize it once no matter how many sessions there are
+static void initializeNativeTarget() {
+    static std::once_flag initialized;
+    std::call_once(initialized, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+std::string getTargetCPU(const CompilerOptions& options) {
+    if (options.targetCPU == "native") {
+        return llvm::sys::getHostCPUName().str();
+    }
+
+    return options.targetCPU;
+}
+
+std::string getTargetFeatures(const CompilerOptions& options) {
+    std::string features;
+
+    if (options.targetCPU == "native") {
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            for (const auto& feature : hostFeatures) {
+                if (!features.empty()) {
+                    features += ",";
+                }
+                features += (feature.getValue() ? "+" : "-") + feature.getKey().str();
+            }
+        }
+    }
+
+    // Explicit features come last so they win over the host's
+    if (!options.targetFeatures.empty()) {
+        if (!features.empty()) {
+            features += ",";
+        }
+        features += options.targetFeatures;
+    }
+
+    return features;
+}
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(llvm::Module& module, const CompilerOptions& options,
+                                                         Diagnostics& diagnostics) {
+    initializeNativeTarget();
+
+    std::string targetTriple = llvm::sys::getDefaultTargetTriple();
+
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
+    if (!target) {
+        diagnostics.error("Failed to find target " + targetTriple + ": " + error);
+    }
+
+    // Check the CPU name before LLVM warns about it and quietly falls back to generic
+    std::string cpu = getTargetCPU(options);
+    std::unique_ptr<llvm::MCSubtargetInfo> subtargetInfo(target->createMCSubtargetInfo(targetTriple, "generic", ""));
+    if (!subtargetInfo->isCPUStringValid(cpu)) {
+        diagnostics.error("Unknown CPU " + cpu + " for " + targetTriple);
+    }
+
+    // Same for -mattr. LLVM 14 keeps the feature table to itself, but toggling a feature it knows always
+    // changes the bits, an unknown one leaves them alone (LLVM still prints its warning about it first).
+    llvm::SmallVector<llvm::StringRef, 16> requestedFeatures;
+    llvm::StringRef(options.targetFeatures).split(requestedFeatures, ',', -1, false);
+    for (llvm::StringRef feature : requestedFeatures) {
+        if (feature[0] != '+' && feature[0] != '-') {
+            diagnostics.error("Target feature " + feature.str() + " needs a + or - in front of it");
+        }
+
+        llvm::FeatureBitset featureBits = subtargetInfo->getFeatureBits();
+        if (subtargetInfo->ToggleFeature(feature) == featureBits) {
+            diagnostics.error("Unknown target feature " + feature.drop_front().str() + " for " + targetTriple);
+        }
+        subtargetInfo->setFeatureBits(featureBits);
+    }
+
+    // A section per function and per global, string constants included, so the link can drop what's unused
+    llvm::TargetOptions targetOptions;
+    targetOptions.FunctionSections = options.sizeLevel > 0;
+    targetOptions.DataSections = options.sizeLevel > 0;
+    std::unique_ptr<llvm::TargetMachine> targetMachine(target->createTargetMachine(
+        targetTriple, cpu, getTargetFeatures(options), targetOptions, llvm::Reloc::PIC_));
+
+    if (!targetMachine) {
+        diagnostics.error("Failed to create target machine for " + targetTriple);
+    }
+
+    module.setTargetTriple(targetTriple);
+    module.setDataLayout(targetMachine->createDataLayout());
+
+    return targetMachine;
+}
+
+void writeIRFile(llvm::Module& module, const std::string& filename, Diagnostics& diagnostics) {
+    std::error_code errorCode;
+    llvm::raw_fd_ostream outputFile(filename, errorCode, llvm::sys::fs::OpenFlags::OF_None);
+
+    // Check if the file was opened successfully
+    if (errorCode) {
+        diagnostics.error("Failed to open output file " + filename + ": " + errorCode.message());
+    }
+
+    // Set the output stream for printing the module
+    module.print(outputFile, nullptr);
+}
+
+// The summary comes from ModuleSummaryIndexAnalysis, so the writer runs as a pass
+static void writeBitcode(llvm::Module& module, llvm::raw_ostream& stream) {
+    llvm::LoopAnalysisManager loopAnalysisManager;
+    llvm::FunctionAnalysisManager functionAnalysisManager;
+    llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+    llvm::ModuleAnalysisManager moduleAnalysisManager;
+
+    llvm::PassBuilder passBuilder;
+    passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+    passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+    passBuilder.registerLoopAnalyses(loopAnalysisManager);
+    passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager,
+                                     cgsccAnalysisManager, moduleAnalysisManager);
+
+    llvm::ModulePassManager modulePassManager;
+    modulePassManager.addPass(llvm::BitcodeWriterPass(stream, false, true));
+    modulePassManager.run(module, moduleAnalysisManager);
+}
+
+void writeBitcodeFile(llvm::Module& module, const std::string& filename, Diagnostics& diagnostics) {
+    std::error_code errorCode;
+    llvm::raw_fd_ostream outputFile(filename, errorCode, llvm::sys::fs::OpenFlags::OF_None);
+
+    if (errorCode) {
+        diagnostics.error("Failed to open output file " + filename + ": " + errorCode.message());
+    }
+
+    writeBitcode(module, outputFile);
+}
+
+void emitObjectFile(llvm::Module& module, llvm::TargetMachine& targetMachine, const std::string& filename,
+                    const CompilerOptions& options, Diagnostics& diagnostics) {
+    logStream(options) << "RUNNING: Starting Object Emission\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::error_code errorCode;
+    llvm::raw_fd_ostream outputFile(filename, errorCode, llvm::sys::fs::OpenFlags::OF_None);
+
+    if (errorCode) {
+        diagnostics.error("Failed to open object file " + filename + ": " + errorCode.message());
+    }
+
+    llvm::legacy::PassManager passManager;
+    if (targetMachine.addPassesToEmitFile(passManager, outputFile, nullptr, llvm::CGFT_ObjectFile)) {
+        diagnostics.error("The target can't emit object files");
+    }
+
+    passManager.run(module);
+    outputFile.flush();
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: Object Emission took " << seconds << " seconds\n";
+}
+
+std::string partitionFilename(const std::string& filename, unsigned partition) {
+    std::filesystem::path path(filename);
+    std::string extension = path.extension().string();
+    path.replace_extension(std::to_string(partition) + extension);
+    return path.string();
+}
+
+std::vector<std::string> emitObjectFilesInParallel(llvm::Module& module, unsigned partitionCount, const std::string& filename,
+                                                   const CompilerOptions& options, Diagnostics& diagnostics) {
+    logStream(options) << "RUNNING: Starting Parallel Object Emission\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // More partitions than function bodies would only produce empty objects
+    unsigned definedFunctions = 0;
+    for (llvm::Function& function : module) {
+        if (!function.isDeclaration()) {
+            ++definedFunctions;
+        }
+    }
+    partitionCount = std::max(1u, std::min(partitionCount, definedFunctions));
+
+    // A context can only be used by one thread at a time, so every partition is written to bitcode
+    // here and read back into a context of its own on the worker thread
+    std::vector<llvm::SmallVector<char, 0>> partitionBitcode;
+    llvm::SplitModule(module, partitionCount, [&](std::unique_ptr<llvm::Module> partition) {
+        partitionBitcode.emplace_back();
+        llvm::raw_svector_ostream bitcodeStream(partitionBitcode.back());
+        llvm::WriteBitcodeToFile(*partition, bitcodeStream);
+    });
+
+    // Workers report into their own diagnostics and stay quiet, the results are merged after the join
+    CompilerOptions workerOptions = options;
+    workerOptions.log = nullptr;
+
+    // Every name is there before the first worker starts, growing the vector would move them under its feet
+    std::vector<std::string> objectFilenames;
+    for (unsigned i = 0; i < partitionBitcode.size(); ++i) {
+        objectFilenames.push_back(partitionFilename(filename, i));
+    }
+
+    std::vector<Diagnostics> workerDiagnostics(partitionBitcode.size());
+    std::vector<std::thread> workers;
+
+    for (unsigned i = 0; i < partitionBitcode.size(); ++i) {
+        workers.emplace_back([&, i]() {
+            Diagnostics& partitionDiagnostics = workerDiagnostics[i];
+            try {
+                llvm::LLVMContext context;
+                llvm::MemoryBufferRef bitcode(llvm::StringRef(partitionBitcode[i].data(), partitionBitcode[i].size()),
+                                              objectFilenames[i]);
+
+                llvm::Expected<std::unique_ptr<llvm::Module>> partition = llvm::parseBitcodeFile(bitcode, context);
+                if (!partition) {
+                    partitionDiagnostics.error("Failed to read partition " + std::to_string(i) + ": " +
+                                               llvm::toString(partition.takeError()));
+                }
+
+                std::unique_ptr<llvm::TargetMachine> targetMachine = createTargetMachine(**partition, workerOptions,
+                                                                                                  partitionDiagnostics);
+                emitObjectFile(**partition, *targetMachine, objectFilenames[i], workerOptions, partitionDiagnostics);
+            } catch (const CompilationError&) {
+                // Already recorded in partitionDiagnostics
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    bool failed = false;
+    for (const Diagnostics& partitionDiagnostics : workerDiagnostics) {
+        for (const Diagnostic& diagnostic : partitionDiagnostics.getDiagnostics()) {
+            diagnostics.report(diagnostic.severity, diagnostic.message, diagnostic.line);
+        }
+        failed = failed || partitionDiagnostics.hasErrors();
+    }
+
+    if (failed) {
+        throw CompilationError("Parallel object emission failed");
+    }
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: Parallel Object Emission of " << objectFilenames.size() << " partitions took "
+                       << seconds << " seconds\n";
+
+    return objectFilenames;
+}
+
+std::vector<std::string> emitObjectFilesWithThinLTO(const std::vector<llvm::Module*>& modules,
+                                                    const std::vector<std::string>& preservedSymbols,
+                                                    const std::string& filename, const CompilerOptions& options,
+                                                    Diagnostics& diagnostics) {
+    logStream(options) << "RUNNING: Starting ThinLTO\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    initializeNativeTarget();
+
+    llvm::lto::Config config;
+    config.CPU = getTargetCPU(options);
+    std::string features = getTargetFeatures(options);
+    if (!features.empty()) {
+        llvm::SmallVector<llvm::StringRef, 16> attributes;
+        llvm::StringRef(features).split(attributes, ",");
+        for (llvm::StringRef attribute : attributes) {
+            config.MAttrs.push_back(attribute.str());
+        }
+    }
+    config.RelocModel = llvm::Reloc::PIC_;
+    config.Options.FunctionSections = options.sizeLevel > 0;
+    config.Options.DataSections = options.sizeLevel > 0;
+    config.OptLevel = options.optimizationLevel;
+    switch (options.optimizationLevel) {
+        case 0:
+            config.CGOptLevel = llvm::CodeGenOpt::None;
+            break;
+        case 1:
+            config.CGOptLevel = llvm::CodeGenOpt::Less;
+            break;
+        case 3:
+            config.CGOptLevel = llvm::CodeGenOpt::Aggressive;
+            break;
+        default:
+            config.CGOptLevel = llvm::CodeGenOpt::Default;
+            break;
+    }
+
+    llvm::lto::ThinBackend backend = llvm::lto::createInProcessThinBackend(
+        llvm::heavyweight_hardware_concurrency(options.codegenThreads));
+    llvm::lto::LTO lto(std::move(config), std::move(backend));
+
+    llvm::StringSet<> preserved;
+    for (const std::string& symbol : preservedSymbols) {
+        preserved.insert(symbol);
+    }
+
+    // The input files point into these buffers until the link is done
+    std::vector<llvm::SmallVector<char, 0>> moduleBitcode(modules.size());
+
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        llvm::raw_svector_ostream bitcodeStream(moduleBitcode[i]);
+        writeBitcode(*modules[i], bitcodeStream);
+
+        llvm::MemoryBufferRef bitcode(llvm::StringRef(moduleBitcode[i].data(), moduleBitcode[i].size()),
+                                      modules[i]->getModuleIdentifier());
+        llvm::Expected<std::unique_ptr<llvm::lto::InputFile>> input = llvm::lto::InputFile::create(bitcode);
+        if (!input) {
+            diagnostics.error("Failed to read module " + modules[i]->getModuleIdentifier() + ": " +
+                              llvm::toString(input.takeError()));
+        }
+
+        // Every module is the only definition of its symbols, the runtime's symbols stay undefined
+        std::vector<llvm::lto::SymbolResolution> resolutions;
+        for (const llvm::lto::InputFile::Symbol& symbol : (*input)->symbols()) {
+            llvm::lto::SymbolResolution resolution;
+            if (!symbol.isUndefined()) {
+                resolution.Prevailing = true;
+                resolution.FinalDefinitionInLinkageUnit = true;
+            }
+            resolution.VisibleToRegularObj = preserved.count(symbol.getName()) != 0;
+            resolutions.push_back(resolution);
+        }
+
+        if (llvm::Error error = lto.add(std::move(*input), resolutions)) {
+            diagnostics.error("Failed to add module " + modules[i]->getModuleIdentifier() + " to the link: " +
+                              llvm::toString(std::move(error)));
+        }
+    }
+
+    // Backends run in parallel, each task writes to its own slot
+    std::vector<std::string> taskFilenames(lto.getMaxTasks());
+    auto addStream = [&](unsigned task) -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+        taskFilenames[task] = partitionFilename(filename, task);
+
+        std::error_code errorCode;
+        auto stream = std::make_unique<llvm::raw_fd_ostream>(taskFilenames[task], errorCode,
+                                                             llvm::sys::fs::OpenFlags::OF_None);
+        if (errorCode) {
+            return llvm::errorCodeToError(errorCode);
+        }
+
+        return std::make_unique<llvm::CachedFileStream>(std::move(stream));
+    };
+
+    if (llvm::Error error = lto.run(addStream)) {
+        diagnostics.error("ThinLTO failed: " + llvm::toString(std::move(error)));
+    }
+
+    // Not every task produces an object, the regular LTO one stays empty
+    std::vector<std::string> objectFilenames;
+    for (const std::string& taskFilename : taskFilenames) {
+        if (!taskFilename.empty()) {
+            objectFilenames.push_back(taskFilename);
+        }
+    }
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: ThinLTO of " << modules.size() << " modules took " << seconds << " seconds\n";
+
+    return objectFilenames;
+}
+
+void linkExecutable(const std::vector<std::string>& objectFilenames, const std::string& outputFilename,
+                    const CompilerOptions& options, Diagnostics& diagnostics) {
+    // Run g++ to link the object code and create the executable
+    std::string objectList;
+    for (const std::string& objectFilename : objectFilenames) {
+        objectList += " " + objectFilename;
+    }
+
+    // One shell argument can only be so long, thousands of cached objects go through a response file
+    std::string responseFilename;
+    if (objectList.size() > 32 * 1024) {
+        responseFilename = outputFilename + ".objects";
+        std::ofstream responseFile(responseFilename);
+        responseFile << objectList << "\n";
+        if (!responseFile) {
+            diagnostics.error("Failed to write " + responseFilename);
+        }
+        objectList = " @" + responseFilename;
+    }
+
+    std::string gppCommand = "g++" + objectList;
+
+    // Freestanding programs get nothing from the toolchain, the runtime has _start, memcpy and friends.
+    // Static and without a dynamic loader, the kernel jumps right into _start. The session already
+    // rejected the flags that need libc, see CompilationSession::checkOptions.
+    if (options.freestanding) {
+        gppCommand += " " + options.freestandingRuntimeLibrary + " -static -nostdlib -nostartfiles";
+    } else {
+        gppCommand += " " + options.runtimeLibrary;
+    }
+
+    // Instrumented programs need LLVM's profile runtime, which clang would normally pull in. The session
+    // made sure it's there before the build started.
+    if (!options.profileGenerate.empty()) {
+        gppCommand += " -u__llvm_profile_runtime " + options.profileRuntimeLibrary;
+    }
+
+    // Unused sections go, gold can also fold functions that compiled to the same code
+    if (options.sizeLevel > 0) {
+        gppCommand += " -Wl,--gc-sections";
+        if (llvm::sys::findProgramByName("ld.gold")) {
+            gppCommand += " -fuse-ld=gold -Wl,--icf=all";
+        } else {
+            diagnostics.warning("ld.gold wasn't found, identical code folding is skipped");
+        }
+    }
+    gppCommand += " -o " + outputFilename;
+
+    debugPrint(options, "Linking with: " + gppCommand + "\n");
+
+    int gppResult = std::system(gppCommand.c_str());
+    if (!responseFilename.empty()) {
+        std::remove(responseFilename.c_str());
+    }
+    if (gppResult != 0) {
+        diagnostics.error("Failed to link object code using g++");
+    }
+}
+
+void reportBinarySize(const std::string& filename, const std::set<std::string>& functionNames,
+                      const CompilerOptions& options, Diagnostics& diagnostics) {
+    auto binary = llvm::object::ObjectFile::createObjectFile(filename);
+    if (!binary) {
+        diagnostics.error("Failed to read " + filename + ": " + llvm::toString(binary.takeError()));
+    }
+
+    auto* object = llvm::dyn_cast<llvm::object::ELFObjectFileBase>(binary->getBinary());
+    if (!object) {
+        diagnostics.error(filename + " is not an ELF file");
+    }
+
+    // Only what gets loaded counts, the symbol table is about to be stripped anyway
+    std::vector<std::pair<std::string, uint64_t>> sections;
+    uint64_t loadedSize = 0;
+    for (llvm::object::ELFSectionRef section : object->sections()) {
+        llvm::Expected<llvm::StringRef> name = section.getName();
+        if (!name || !(section.getFlags() & llvm::ELF::SHF_ALLOC) || section.getSize() == 0) {
+            llvm::consumeError(name.takeError());
+            continue;
+        }
+
+        sections.emplace_back(name->str(), section.getSize());
+        loadedSize += section.getSize();
+    }
+
+    // Functions by address, identical code folding leaves several names on one body.
+    // ThinLTO and -j give promoted functions a .llvm. suffix.
+    std::map<uint64_t, std::pair<uint64_t, std::vector<std::string>>> functions;
+    for (const llvm::object::ELFSymbolRef& symbol : object->symbols()) {
+        llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+        llvm::Expected<llvm::StringRef> name = symbol.getName();
+        llvm::Expected<uint64_t> address = symbol.getAddress();
+        if (!type || !name || !address || *type != llvm::object::SymbolRef::ST_Function) {
+            llvm::consumeError(type.takeError());
+            llvm::consumeError(name.takeError());
+            llvm::consumeError(address.takeError());
+            continue;
+        }
+
+        std::string functionName = name->split(".llvm.").first.str();
+        if (functionNames.count(functionName)) {
+            functions[*address].first = symbol.getSize();
+            functions[*address].second.push_back(functionName);
+        }
+    }
+
+    std::sort(sections.begin(), sections.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    std::vector<std::pair<uint64_t, std::string>> functionSizes;
+    uint64_t functionsSize = 0;
+    for (auto& [address, function] : functions) {
+        std::vector<std::string>& names = function.second;
+        std::sort(names.begin(), names.end());
+
+        std::string description = names[0];
+        for (std::size_t i = 1; i < names.size(); ++i) {
+            description += (i == 1 ? " (folded with " : ", ") + names[i];
+        }
+        if (names.size() > 1) {
+            description += ")";
+        }
+
+        functionSizes.emplace_back(function.first, description);
+        functionsSize += function.first;
+    }
+    std::sort(functionSizes.begin(), functionSizes.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::ostream& log = logStream(options);
+    log << "Size of " << filename << ", " << loadedSize << " bytes in memory:\n";
+    for (const auto& [name, size] : sections) {
+        log << "    " << name << " " << size << "\n";
+    }
+
+    log << "Functions, " << functionsSize << " bytes:\n";
+    for (const auto& [size, description] : functionSizes) {
+        log << "    " << description << " " << size << "\n";
+    }
+}
+
+void stripExecutable(const std::string& filename, const CompilerOptions& options, Diagnostics& diagnostics) {
+    std::string stripCommand = "strip --strip-all " + filename;
+    debugPrint(options, "Stripping with: " + stripCommand + "\n");
+
+    if (std::system(stripCommand.c_str()) != 0) {
+        diagnostics.error("Failed to strip " + filename);
+    }
+
+    logStream(options) << "Stripped " << filename << " to " << std::filesystem::file_size(filename) << " bytes\n";
+}
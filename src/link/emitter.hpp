@@ -0,0 +1,62 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+
+// Creates a TargetMachine for the host and stamps the module with its triple and data layout.
+// Target registration happens once per process, everything else is per call.
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(llvm::Module& module, const CompilerOptions& options,
+                                                         Diagnostics& diagnostics);
+
+// The CPU and feature string the options ask for, with "native" resolved to the host
+std::string getTargetCPU(const CompilerOptions& options);
+std::string getTargetFeatures(const CompilerOptions& options);
+
+// Writes the textual IR of the module
+void writeIRFile(llvm::Module& module, const std::string& filename, Diagnostics& diagnostics);
+
+// Writes the module as bitcode with a ThinLTO summary
+void writeBitcodeFile(llvm::Module& module, const std::string& filename, Diagnostics& diagnostics);
+
+// output.o becomes output.1.o for partition 1 and so on
+std::string partitionFilename(const std::string& filename, unsigned partition);
+
+// Runs the backend in-process instead of shelling out to llc
+void emitObjectFile(llvm::Module& module, llvm::TargetMachine& targetMachine, const std::string& filename,
+                    const CompilerOptions& options, Diagnostics& diagnostics);
+
+// Splits the module into partitionCount parts and emits each on its own thread, with its own
+// context and TargetMachine. Returns the object files in partition order.
+std::vector<std::string> emitObjectFilesInParallel(llvm::Module& module, unsigned partitionCount, const std::string& filename,
+                                                   const CompilerOptions& options, Diagnostics& diagnostics);
+
+// Runs a ThinLTO link over the modules: they are summarized, functions are imported across modules
+// and every module gets its own backend thread (up to options.codegenThreads). Only the
+// preserved symbols stay visible, everything else is internalized. Returns the object files.
+std::vector<std::string> emitObjectFilesWithThinLTO(const std::vector<llvm::Module*>& modules,
+                                                    const std::vector<std::string>& preservedSymbols,
+                                                    const std::string& filename, const CompilerOptions& options,
+                                                    Diagnostics& diagnostics);
+
+// Links the object files into an executable with g++
+void linkExecutable(const std::vector<std::string>& objectFilenames, const std::string& outputFilename,
+                    const CompilerOptions& options, Diagnostics& diagnostics);
+
+// Logs how big the linked binary is per loaded section and per function, functionNames are the
+// ones that came from .rk files. Needs the symbol table, so it has to run before stripping.
+void reportBinarySize(const std::string& filename, const std::set<std::string>& functionNames,
+                      const CompilerOptions& options, Diagnostics& diagnostics);
+
+// Removes the symbol table and everything else the program doesn't need to run
+void stripExecutable(const std::string& filename, const CompilerOptions& options, Diagnostics& diagnostics);
+
+#endif  // EMITTER_HPP
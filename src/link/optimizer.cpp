@@ -0,0 +1,95 @@
+#include <chrono>
+
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/PGOOptions.h"
+#include "llvm/Transforms/IPO/HotColdSplitting.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+#include "optimizer.hpp"
+
+// ThinLTO modules only get the pre-link half here, the rest runs after cross module importing
+static llvm::ModulePassManager buildPipeline(llvm::PassBuilder& passBuilder, llvm::OptimizationLevel level,
+                                             const CompilerOptions& options) {
+    if (options.lto == LTOMode::THIN) {
+        return passBuilder.buildThinLTOPreLinkDefaultPipeline(level);
+    }
+
+    return passBuilder.buildPerModuleDefaultPipeline(level);
+}
+
+void optimizeModule(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                    const CompilerOptions& options, Diagnostics& diagnostics) {
+    std::string levelName = options.sizeLevel == 0 ? std::to_string(options.optimizationLevel)
+                                                   : (options.sizeLevel == 1 ? "s" : "z");
+    logStream(options) << "RUNNING: Starting Optimization (-O" << levelName << ")\n";
+
+    // Start the timer
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    llvm::LoopAnalysisManager loopAnalysisManager;
+    llvm::FunctionAnalysisManager functionAnalysisManager;
+    llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+    llvm::ModuleAnalysisManager moduleAnalysisManager;
+
+    // IR level PGO: either instrument the program or apply a profile it wrote earlier. The session checked
+    // the level and the profile before it started, see CompilationSession::checkOptions.
+    llvm::Optional<llvm::PGOOptions> pgoOptions;
+    if (!options.profileGenerate.empty()) {
+        pgoOptions = llvm::PGOOptions(options.profileGenerate, "", "", llvm::PGOOptions::IRInstr);
+    } else if (!options.profileUse.empty()) {
+        pgoOptions = llvm::PGOOptions(options.profileUse, "", "", llvm::PGOOptions::IRUse);
+    }
+
+    llvm::PassBuilder passBuilder(&targetMachine, llvm::PipelineTuningOptions(), pgoOptions);
+    passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+    passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+    passBuilder.registerLoopAnalyses(loopAnalysisManager);
+    passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager,
+                                     cgsccAnalysisManager, moduleAnalysisManager);
+
+    llvm::ModulePassManager modulePassManager;
+
+    switch (options.optimizationLevel) {
+        case 0: {
+            llvm::FunctionPassManager functionPassManager;
+            functionPassManager.addPass(llvm::PromotePass());
+            modulePassManager.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(functionPassManager)));
+            break;
+        }
+        case 1:
+            modulePassManager = buildPipeline(passBuilder, llvm::OptimizationLevel::O1, options);
+            break;
+        case 2:
+            if (options.sizeLevel == 1) {
+                modulePassManager = buildPipeline(passBuilder, llvm::OptimizationLevel::Os, options);
+            } else if (options.sizeLevel == 2) {
+                modulePassManager = buildPipeline(passBuilder, llvm::OptimizationLevel::Oz, options);
+            } else {
+                modulePassManager = buildPipeline(passBuilder, llvm::OptimizationLevel::O2, options);
+            }
+            break;
+        case 3:
+            modulePassManager = buildPipeline(passBuilder, llvm::OptimizationLevel::O3, options);
+            break;
+        default:
+            diagnostics.error("Invalid optimization level " + std::to_string(options.optimizationLevel));
+    }
+
+    // With real counts, code that never ran moves out of the hot functions into .text.split ones.
+    // Branch weights, entry counts and the .text.hot/.text.unlikely placement come with the profile itself.
+    if (!options.profileUse.empty() && options.lto == LTOMode::NONE) {
+        modulePassManager.addPass(llvm::HotColdSplittingPass());
+    }
+
+    modulePassManager.run(module, moduleAnalysisManager);
+
+    // Stop the timer
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+
+    // Print the elapsed time
+    double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+    logStream(options) << "DONE: Optimization took " << seconds << " seconds\n";
+}
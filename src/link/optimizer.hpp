@@ -0,0 +1,15 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+
+// Runs the optimization pipeline for options.optimizationLevel over the module.
+// -O0 still runs mem2reg, codegen puts every variable on the stack and relies on it for SSA form.
+void optimizeModule(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                    const CompilerOptions& options, Diagnostics& diagnostics);
+
+#endif  // OPTIMIZER_HPP
@@ -1,18 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <cstdlib>
 #include <chrono>
 #include <filesystem>
 
-#include "lexer/lexer.hpp"
-#include "parser/parser.hpp"
-#include "link/codegen.hpp"
+#include <dlfcn.h>
 
-#include "util/globals.hpp"
-
-bool debugMode = false;
-bool verboseMode = false;
+#include "session/build.hpp"
+#include "session/frontend.hpp"
 
 void printUsage() {
     std::cout << "Usage: starship [options] <input-file>\n";
@@ -23,9 +18,54 @@ void printUsage() {
     std::cout << "    -d / --debug     Prints extra debug messages\n";
     std::cout << "    -v / --verbose   Prints extra build messages\n";
     std::cout << "    Example usage, either -dv or -d -v, both work\n";
+    std::cout << "    --stop-after=<stage>   Stop after lex, parse, ir, obj or link (default)\n";
+    std::cout << "    -O0 / -O1 / -O2 / -O3  Optimization level, -O2 is the default\n";
+    std::cout << "    -Os / -Oz              Optimize for size, link with section GC and identical code folding, strip and report sizes\n";
+    std::cout << "    -mcpu=<cpu>            Generate code for this CPU, -mcpu=native uses the host's CPU and features\n";
+    std::cout << "    -march=<cpu>           The same as -mcpu, like on x86 compilers\n";
+    std::cout << "    -mattr=<features>      Extra target features, like +avx2,-avx512f\n";
+    std::cout << "    --emit=bc              Write bitcode with a ThinLTO summary (output.bc) instead of output.ll\n";
+    std::cout << "    --lto=thin             One module per source file, linked with ThinLTO\n";
+    std::cout << "    --freestanding         Link a static binary without libc, print makes write system calls\n";
+    std::cout << "    --profile-generate[=<file>]  Instrument the program, it writes a raw profile (default.profraw) at exit\n";
+    std::cout << "    --profile-use=<file>   Optimize with a profile merged by llvm-profdata\n";
+    std::cout << "    --instrument=functions  Count calls and cycles of every function, the program writes starship-profile.txt at exit\n";
+    std::cout << "    -j <N>                 Split the module and emit N objects in parallel\n";
+    std::cout << "    --pipeline             Generate IR on a second thread, each function as soon as it is parsed\n";
+    std::cout << "    --low-memory[=<MiB>]   Compile a small group of functions at a time and free what's done, fail if the peak RSS goes over <MiB>\n";
+    std::cout << "    --function-cache[=<dir>]  Keep an object per function (in .starship-cache), only changed ones are rebuilt\n";
+    std::cout << "    --keep-exported        Keep @export functions even if main doesn't reach them\n";
+    std::cout << "    --print-layouts        Print the size, field offsets and padding of every struct\n";
+    std::cout << "    --watch                Stay running and rebuild when main.rk or an import changes\n";
+    std::cout << "    --stats                Print time, CPU time, heap allocations and peak RSS for every phase\n";
+    std::cout << "    --stats-file=<file>    The same, also written to <file> as JSON\n";
+    std::cout << "    --perf-counters        --stats with cycles, instructions, cache and branch misses and page faults\n";
+    std::cout << "  interp      Runs main.rk right away with a bytecode interpreter, no LLVM involved\n";
+    std::cout << "    Interp Flags:\n";
+    std::cout << "    -d / -v          Print the bytecode / build messages to stderr\n";
+    std::cout << "    -- <args>        Everything after -- goes to the program, main's argc counts them\n";
+    std::cout << "  check [<file>]  Only lexes and parses (main.rk by default), every function included, quiet unless there are errors\n";
+    std::cout << "    Check Flags:\n";
+    std::cout << "    -d / -v          Print tokens and the AST / build messages to stderr\n";
+    std::cout << "    --print-layouts  Print the size, field offsets and padding of every struct\n";
     std::cout << "  debug       A general debug tool for testing...\n";
 }
 
+// LLVM is only loaded when something gets built, everything else starts without it
+BuildFunction loadBackend() {
+    void* backend = dlopen(STARSHIP_BACKEND_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+    if (!backend) {
+        std::cerr << "Error: Failed to load the compiler backend: " << dlerror() << "\n";
+        return nullptr;
+    }
+
+    BuildFunction build = reinterpret_cast<BuildFunction>(dlsym(backend, buildFunctionName));
+    if (!build) {
+        std::cerr << "Error: The compiler backend " << STARSHIP_BACKEND_LIBRARY << " has no " << buildFunctionName << "\n";
+    }
+    return build;
+}
+
 void printVersion() {
     std::cout << "Starship Compiler v0.1\n";
     std::cout << "Made by David Rubin <daviru007@icloud.com>\n";
@@ -45,166 +85,247 @@ int main(int argc, char* argv[]) {
     }
 
     if (inputFilename == "build") {
+        CompilerOptions options;
 
         // Check for build flags
         for (int i = 2; i < argc; ++i) {
             std::string arg = argv[i];
             if (arg == "-d" || arg == "--debug") {
-                debugMode = true;
+                options.debugMode = true;
             } else if (arg == "-v" || arg == "--verbose") {
-                verboseMode = true;
+                options.verboseMode = true;
+            } else if (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "-O3") {
+                options.optimizationLevel = arg[2] - '0';
+                options.sizeLevel = 0;
+            } else if (arg == "-Os" || arg == "-Oz") {
+                options.optimizationLevel = 2;
+                options.sizeLevel = arg == "-Os" ? 1 : 2;
+            } else if (arg == "-j" || (arg.substr(0, 2) == "-j" && arg.size() > 2)) {
+                // Both -j 8 and -j8 work
+                std::string count = arg.size() > 2 ? arg.substr(2) : (i + 1 < argc ? argv[++i] : "");
+                if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos || std::stoul(count) == 0) {
+                    std::cerr << "Error: -j needs a positive thread count\n";
+                    return 1;
+                }
+                options.codegenThreads = std::stoul(count);
+            } else if (arg.substr(0, 6) == "-mcpu=" || arg.substr(0, 7) == "-march=") {
+                options.targetCPU = arg.substr(arg.find('=') + 1);
+            } else if (arg.substr(0, 7) == "-mattr=") {
+                options.targetFeatures = arg.substr(7);
+            } else if (arg == "--emit=bc") {
+                options.emitBitcode = true;
+                options.irFilename = "output.bc";
+            } else if (arg == "--emit=ll") {
+                options.emitBitcode = false;
+                options.irFilename = "output.ll";
+            } else if (arg == "--lto=thin") {
+                options.lto = LTOMode::THIN;
+            } else if (arg == "--lto=none") {
+                options.lto = LTOMode::NONE;
+            } else if (arg == "--profile-generate") {
+                options.profileGenerate = "default.profraw";
+            } else if (arg.substr(0, 19) == "--profile-generate=") {
+                options.profileGenerate = arg.substr(19);
+            } else if (arg.substr(0, 14) == "--profile-use=") {
+                options.profileUse = arg.substr(14);
+            } else if (arg.substr(0, 13) == "--instrument=") {
+                if (arg.substr(13) != "functions") {
+                    std::cerr << "Error: Unknown instrumentation: " << arg.substr(13) << "\n";
+                    return 1;
+                }
+                options.instrumentFunctions = true;
+            } else if (arg == "--freestanding") {
+                options.freestanding = true;
+            } else if (arg == "--function-cache") {
+                options.functionCacheDirectory = ".starship-cache";
+            } else if (arg.substr(0, 17) == "--function-cache=") {
+                options.functionCacheDirectory = arg.substr(17);
+            } else if (arg == "--watch") {
+                options.watch = true;
+            } else if (arg == "--pipeline") {
+                options.pipeline = true;
+            } else if (arg == "--low-memory") {
+                options.lowMemory = true;
+            } else if (arg.substr(0, 13) == "--low-memory=") {
+                std::string limit = arg.substr(13);
+                if (limit.empty() || limit.find_first_not_of("0123456789") != std::string::npos || std::stoull(limit) == 0) {
+                    std::cerr << "Error: --low-memory needs a positive limit in MiB\n";
+                    return 1;
+                }
+                options.lowMemory = true;
+                options.memoryLimitBytes = std::stoull(limit) * 1024 * 1024;
+            } else if (arg == "--stats") {
+                options.stats = true;
+            } else if (arg == "--perf-counters") {
+                options.stats = true;
+                options.perfCounters = true;
+            } else if (arg.substr(0, 13) == "--stats-file=") {
+                options.stats = true;
+                options.statsFilename = arg.substr(13);
+            } else if (arg == "--keep-exported") {
+                options.keepExportedFunctions = true;
+            } else if (arg == "--print-layouts") {
+                options.printLayouts = true;
+            } else if (arg.substr(0, 13) == "--stop-after=") {
+                if (!parseCompilationStage(arg.substr(13), options.stopAfter)) {
+                    std::cerr << "Error: Unknown stage: " << arg.substr(13) << "\n";
+                    return 1;
+                }
             } else if (arg.substr(0, 2) == "-d") {
                 // Handle joined debug flags
-                debugMode = true;
+                options.debugMode = true;
                 arg = arg.substr(2); // Remove the "-d" part
                 for (char c : arg) {
                     if (c == 'v') {
-                        verboseMode = true;
+                        options.verboseMode = true;
                     } else {
                         std::cerr << "Error: Unknown build flag: " << c << "\n";
-                        std::exit(1);
+                        return 1;
                     }
                 }
             } else if (arg.substr(0, 2) == "-v") {
                 // Handle joined verbose flags
-                verboseMode = true;
+                options.verboseMode = true;
                 arg = arg.substr(2); // Remove the "-v" part
                 for (char c : arg) {
                     if (c == 'd') {
-                        debugMode = true;
+                        options.debugMode = true;
                     } else {
                         std::cerr << "Error: Unknown build flag: " << c << "\n";
-                        std::exit(1);
+                        return 1;
                     }
                 }
             } else {
                 std::cerr << "Error: Unknown build flag: " << arg << "\n";
-                std::exit(1);
+                return 1;
             }
         }
 
+        // Debug builds keep output.ll and output.o around, like they always have
+        options.keepTemporaries = options.debugMode;
 
-        // Build tool
-        std::string sourceFilename = "main.rk";
-        std::string outputFilename = "main";
+        // Nothing else compiles in this process, the peak RSS is the build's own
+        options.ownsProcess = true;
 
-        std::ifstream sourceFile(sourceFilename);
+        auto startTime = std::chrono::high_resolution_clock::now();
 
-        if (!sourceFile) {
-            std::cout << "Error: Build Directory must contain a file named main.rk\n";
-            std::cout << "I am in the directory: " << std::filesystem::current_path() << "\n";
+        BuildFunction build = loadBackend();
+        if (!build) {
             return 1;
         }
 
-        auto startTime = std::chrono::high_resolution_clock::now();
+        int status = build(&options);
+        if (status != 0) {
+            return status;
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
 
-        std::string sourceCode((std::istreambuf_iterator<char>(sourceFile)),
-                               std::istreambuf_iterator<char>());
+        double seconds = duration / 1e9;  // Convert nanoseconds to seconds
+        std::cout << "Building took " << seconds << " seconds\n";
 
-        
-        // Lexical analysis
-        std::vector<Token> tokens = performLexicalAnalysis(sourceCode);
+        return 0;
+    }
 
-        if (debugMode) {
-            // Print tokens with all information
-            std::cout << "Tokens:\n";
-            for (Token token : tokens) {
-                std::cout << "[" << tokenTypeToString(token.type) << "] " << token.lexeme << "\n";
+    if (inputFilename == "interp") {
+        CompilerOptions options;
+
+        // Only the program itself writes to stdout
+        options.log = nullptr;
+
+        int programArgc = 1;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--") {
+                programArgc += argc - i - 1;
+                break;
+            } else if (arg == "-d" || arg == "--debug") {
+                options.debugMode = true;
+                options.log = &std::cerr;
+            } else if (arg == "-v" || arg == "--verbose") {
+                options.verboseMode = true;
+                options.log = &std::cerr;
+            } else {
+                std::cerr << "Error: Unknown interp flag: " << arg << "\n";
+                return 1;
             }
         }
 
-        // Parsing analysis
-        ASTTree* ast = performParserAnalysis(tokens);
+        FrontendSession session(options);
 
-        if (debugMode) {
-            std::cout << "\n";
-            printAST(reinterpret_cast<ASTNodeBase *>(ast), 0);
+        if (!session.loadSourceFile("main.rk")) {
+            session.getDiagnostics().print(std::cerr);
+            return 1;
         }
 
-        // Code generation
-        llvm::LLVMContext context;
-        llvm::Module module("main.rk", context);  
-
-        CodeGenerator codeGenerator(module);
-        codeGenerator.generateIR(ast);
+        int exitStatus = 0;
+        bool success = session.interpret(programArgc, exitStatus);
+        session.getDiagnostics().print(std::cerr);
 
-        // Clean up
-        delete ast;
+        return success ? exitStatus : 1;
+    }
 
-        std::string llcCommand = "llc -filetype=obj -relocation-model=pic output.ll";
-        int llcResult = std::system(llcCommand.c_str());
-        if (llcResult != 0) {
-            std::cerr << "Error: Failed to generate object code using llc\n";
-            return 1;
-        }
+    if (inputFilename == "check") {
+        CompilerOptions options;
 
-        // Run g++ to link the object code and create the executable
-        std::string gppCommand = "g++ output.o -o" + outputFilename;
-        int gppResult = std::system(gppCommand.c_str());
-        if (gppResult != 0) {
-            std::cerr << "Error: Failed to link object code using g++\n";
-            return 1;
-        }
+        // Silent unless something is wrong, it runs on every save
+        options.log = nullptr;
+        options.parseEveryFunction = true;
 
-        // Remove the temporary files
-        if (!debugMode)
-        {
-            std::string rmCommand = "rm output.ll output.o";
-            int rmResult = std::system(rmCommand.c_str());
-            if (rmResult != 0) {
-                std::cerr << "Error: Failed to remove temporary files\n";
+        std::string sourceFilename = "main.rk";
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-d" || arg == "--debug") {
+                options.debugMode = true;
+                options.log = &std::cerr;
+            } else if (arg == "-v" || arg == "--verbose") {
+                options.verboseMode = true;
+                options.log = &std::cerr;
+            } else if (arg == "--print-layouts") {
+                options.printLayouts = true;
+            } else if (arg.substr(0, 1) == "-") {
+                std::cerr << "Error: Unknown check flag: " << arg << "\n";
                 return 1;
+            } else {
+                sourceFilename = arg;
             }
         }
 
-        std::cout << "\nSuccessfully built: " << outputFilename << "\n";
+        FrontendSession session(options);
 
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+        if (!session.loadSourceFile(sourceFilename)) {
+            session.getDiagnostics().print(std::cerr);
+            return 1;
+        }
 
-        double seconds = duration / 1e9;  // Convert nanoseconds to seconds
-        std::cout << "Building took " << seconds << " seconds\n";
+        bool success = session.check();
+        session.getDiagnostics().print(std::cerr);
 
-        return 0;
+        return success ? 0 : 1;
     }
 
     // Debugging mode
     if (inputFilename == "debug") {
-        debugMode = true;
-        verboseMode = true;
-        
+        CompilerOptions options;
+        options.debugMode = true;
+        options.verboseMode = true;
+        options.stopAfter = CompilationStage::PARSE;
+
         // Source code
         std::string sourceFilename = "main.rk";
-        std::ifstream sourceFile(sourceFilename);
 
-        if (!sourceFile) {
+        FrontendSession session(options);
+
+        if (!session.loadSourceFile(sourceFilename)) {
             std::cout << "Error: Build Directory must contain a file named main.rk\n";
             return 1;
         }
 
-        // Read the source code
-        std::string sourceCode((std::istreambuf_iterator<char>(sourceFile)),
-                               std::istreambuf_iterator<char>());
-
-        // Lexical analysis
-        std::vector<Token> tokens = performLexicalAnalysis(sourceCode);
+        bool success = session.check();
+        session.getDiagnostics().print(std::cerr);
 
-        // Print tokens with all information
-        std::cout << "Tokens:\n";
-        for (const Token& token : tokens) {
-            std::cout << "[" << tokenTypeToString(token.type) << "] " << token.lexeme << "\n";
-        }
-
-        // Parsing analysis
-        ASTTree* ast = performParserAnalysis(tokens);
-
-        if (debugMode) {
-            std::cout << "\n";
-            printAST(reinterpret_cast<ASTNodeBase *>(ast), 0);
-        }
-
-
-        return 0;
+        return success ? 0 : 1;
     }
 
     // Normal execution
@@ -0,0 +1,276 @@
+#include <set>
+#include <vector>
+
+#include "effects.hpp"
+
+// A call made by a function, and whether it hands over any of the arrays the function was passed
+struct CallSite {
+    std::string callee;
+    bool passesArguments = false;
+};
+
+// Walks one function body. Scopes mirror the ones codegen uses, so a name that isn't found is a global.
+class EffectsWalker {
+public:
+    FunctionEffects effects;
+    std::vector<CallSite> calls;
+
+    explicit EffectsWalker(FunctionNode* function) {
+        scopes.emplace_back();
+        for (Variable* parameter : function->parameters.parameters) {
+            scopes.back()[parameter->name] = parameter->arrayLength > 0 || parameter->structType;
+        }
+
+        visitStatements(function->body->statements);
+        visitExpression(function->returnValue);
+    }
+
+private:
+    // Name to whether it is an array or struct parameter, those live in the caller's memory
+    std::vector<std::map<std::string, bool>> scopes;
+
+    const bool* findLocal(const std::string& name) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto local = scope->find(name);
+            if (local != scope->end()) {
+                return &local->second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void accessGlobal(bool write) {
+        (write ? effects.writesMemory : effects.readsMemory) = true;
+        effects.onlyArgumentMemory = false;
+    }
+
+    void accessElement(const std::string& array, ExpressionNode* index, bool write) {
+        visitExpression(index);
+
+        // Constant indices are checked by the parser, everything else can end up in starship_bounds_fail
+        if (!dynamic_cast<LiteralNode*>(index)) {
+            effects.writesMemory = true;
+            effects.onlyArgumentMemory = false;
+            effects.mayNotReturn = true;
+        }
+
+        // Writing a local array only touches this function's stack
+        const bool* isParameter = findLocal(array);
+        if (isParameter && *isParameter) {
+            (write ? effects.writesMemory : effects.readsMemory) = true;
+        }
+    }
+
+    // Fields of a local struct are on this function's stack, just like local arrays. Nothing to check either.
+    void accessField(const std::string& name, bool write) {
+        const bool* isParameter = findLocal(name);
+        if (isParameter && *isParameter) {
+            (write ? effects.writesMemory : effects.readsMemory) = true;
+        }
+    }
+
+    void visitStatements(const std::vector<ASTNodeBase*>& statements) {
+        for (ASTNodeBase* statement : statements) {
+            visitStatement(statement);
+        }
+    }
+
+    void visitStatement(ASTNodeBase* statement) {
+        if (PrintNode* printNode = dynamic_cast<PrintNode*>(statement)) {
+            visitExpression(printNode->expression);
+            effects.writesMemory = true;
+            effects.onlyArgumentMemory = false;
+        } else if (CallNode* callNode = dynamic_cast<CallNode*>(statement)) {
+            visitExpression(callNode);
+        } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            visitExpression(declaration->value);
+            scopes.back()[declaration->name] = false;
+        } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(statement)) {
+            visitExpression(assignment->value);
+            if (assignment->index) {
+                accessElement(assignment->name, assignment->index, true);
+            } else if (assignment->structType) {
+                accessField(assignment->name, true);
+            } else if (!findLocal(assignment->name)) {
+                accessGlobal(true);
+            }
+        } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(statement)) {
+            // Nothing bounds the number of iterations
+            effects.mayNotReturn = true;
+            visitExpression(whileNode->condition);
+            scopes.emplace_back();
+            visitStatements(whileNode->body);
+            scopes.pop_back();
+        } else if (ForNode* forNode = dynamic_cast<ForNode*>(statement)) {
+            effects.mayNotReturn = true;
+            scopes.emplace_back();
+            visitStatement(forNode->initializer);
+            visitExpression(forNode->condition);
+            visitStatement(forNode->step);
+            visitStatements(forNode->body);
+            scopes.pop_back();
+        }
+    }
+
+    void visitExpression(ExpressionNode* expression) {
+        if (VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(expression)) {
+            if (!findLocal(reference->name)) {
+                accessGlobal(false);
+            }
+        } else if (IndexNode* indexNode = dynamic_cast<IndexNode*>(expression)) {
+            accessElement(indexNode->name, indexNode->index, false);
+        } else if (FieldNode* fieldNode = dynamic_cast<FieldNode*>(expression)) {
+            accessField(fieldNode->name, false);
+        } else if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(expression)) {
+            visitExpression(binaryNode->left);
+            visitExpression(binaryNode->right);
+
+            // Any divisor but a constant other than 0 and -1 can end up in starship_division_fail
+            if (binaryNode->operatorType == TokenType::SLASH) {
+                LiteralNode* divisor = dynamic_cast<LiteralNode*>(binaryNode->right);
+                if (!divisor || divisor->value.getInt() == 0 || divisor->value.getInt() == -1) {
+                    effects.writesMemory = true;
+                    effects.onlyArgumentMemory = false;
+                    effects.mayNotReturn = true;
+                }
+            }
+        } else if (CallNode* callNode = dynamic_cast<CallNode*>(expression)) {
+            CallSite call;
+            call.callee = callNode->name;
+
+            for (ExpressionNode* argument : callNode->arguments) {
+                visitExpression(argument);
+
+                // Passing a whole array or struct hands its memory to the callee
+                VariableReferenceNode* array = dynamic_cast<VariableReferenceNode*>(argument);
+                if (array && (array->arrayLength > 0 || array->structType)) {
+                    const bool* isParameter = findLocal(array->name);
+                    call.passesArguments |= isParameter && *isParameter;
+                }
+            }
+
+            calls.push_back(call);
+        }
+    }
+};
+
+// Does function reach target through calls, visited keeps the search from going in circles
+static bool reaches(const std::string& function, const std::string& target,
+                    const std::map<std::string, std::vector<CallSite>>& callGraph, std::set<std::string>& visited) {
+    auto calls = callGraph.find(function);
+    if (calls == callGraph.end()) {
+        return false;
+    }
+
+    for (const CallSite& call : calls->second) {
+        if (call.callee == target) {
+            return true;
+        }
+
+        if (visited.insert(call.callee).second && reaches(call.callee, target, callGraph, visited)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::map<std::string, FunctionNode*> indexFunctions(ASTTree* tree) {
+    std::map<std::string, FunctionNode*> functions;
+    for (ASTNodeBase* statement : tree->statements) {
+        FunctionNode* function = dynamic_cast<FunctionNode*>(statement);
+        if (function && function->body) {
+            functions[function->name] = function;
+        }
+    }
+
+    return functions;
+}
+
+std::map<std::string, FunctionEffects> inferFunctionEffects(ASTTree* tree) {
+    std::vector<FunctionNode*> functions;
+    for (auto& [name, function] : indexFunctions(tree)) {
+        functions.push_back(function);
+    }
+
+    return inferFunctionEffects(functions);
+}
+
+std::map<std::string, FunctionEffects> inferFunctionEffects(const std::vector<FunctionNode*>& functions) {
+    std::map<std::string, FunctionEffects> functionEffects;
+    std::map<std::string, std::vector<CallSite>> callGraph;
+
+    // What each body does by itself
+    for (FunctionNode* function : functions) {
+        EffectsWalker walker(function);
+        functionEffects[function->name] = walker.effects;
+        callGraph[function->name] = std::move(walker.calls);
+    }
+
+    for (auto& [name, effects] : functionEffects) {
+        std::set<std::string> visited;
+        effects.recursive = reaches(name, name, callGraph, visited);
+        effects.mayNotReturn |= effects.recursive;
+    }
+
+    // Add what the callees do until nothing changes, effects only ever get added so this settles
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto& [name, effects] : functionEffects) {
+            FunctionEffects merged = effects;
+
+            for (const CallSite& call : callGraph[name]) {
+                auto callee = functionEffects.find(call.callee);
+                if (callee == functionEffects.end()) {
+                    // Unknown callee, assume the worst
+                    merged.readsMemory = merged.writesMemory = merged.mayNotReturn = true;
+                    merged.onlyArgumentMemory = false;
+                    continue;
+                }
+
+                const FunctionEffects& calleeEffects = callee->second;
+                merged.mayNotReturn |= calleeEffects.mayNotReturn;
+
+                // A callee that only touches the arrays it gets and only gets our local arrays stays invisible
+                if (calleeEffects.onlyArgumentMemory && !call.passesArguments) {
+                    continue;
+                }
+
+                merged.readsMemory |= calleeEffects.readsMemory;
+                merged.writesMemory |= calleeEffects.writesMemory;
+                merged.onlyArgumentMemory &= calleeEffects.onlyArgumentMemory;
+            }
+
+            if (merged.readsMemory != effects.readsMemory || merged.writesMemory != effects.writesMemory ||
+                merged.onlyArgumentMemory != effects.onlyArgumentMemory || merged.mayNotReturn != effects.mayNotReturn) {
+                effects = merged;
+                changed = true;
+            }
+        }
+    }
+
+    return functionEffects;
+}
+
+std::set<std::string> findReachableFunctions(FunctionNode* function,
+                                             const std::map<std::string, FunctionNode*>& functions) {
+    std::set<std::string> reachable;
+    std::vector<FunctionNode*> worklist = {function};
+    while (!worklist.empty()) {
+        EffectsWalker walker(worklist.back());
+        worklist.pop_back();
+
+        for (const CallSite& call : walker.calls) {
+            auto callee = functions.find(call.callee);
+            if (callee != functions.end() && reachable.insert(call.callee).second) {
+                worklist.push_back(callee->second);
+            }
+        }
+    }
+
+    reachable.erase(function->name);
+    return reachable;
+}
@@ -0,0 +1,33 @@
+#ifndef EFFECTS_HPP
+#define EFFECTS_HPP
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "parser.hpp"
+
+// What a call to a function can do, as far as its caller can tell
+struct FunctionEffects {
+    bool readsMemory = false;        // Globals, or arrays it was passed
+    bool writesMemory = false;       // Globals, arrays it was passed, or output through print and failed bounds checks
+    bool onlyArgumentMemory = true;  // Everything it reads or writes is an array it was passed
+    bool mayNotReturn = false;       // Loops, recursion and failed bounds checks
+    bool recursive = false;          // Can end up calling itself
+};
+
+// Works out the effects of every function with a body from the AST, calls included.
+// Codegen turns them into readnone/readonly, argmemonly, willreturn and norecurse.
+std::map<std::string, FunctionEffects> inferFunctionEffects(ASTTree* tree);
+
+// The same for just these functions, they have to include every function they call
+std::map<std::string, FunctionEffects> inferFunctionEffects(const std::vector<FunctionNode*>& functions);
+
+// Every function of the tree that has a body, by name
+std::map<std::string, FunctionNode*> indexFunctions(ASTTree* tree);
+
+// The names of the functions function calls, directly or through other functions, not counting itself
+std::set<std::string> findReachableFunctions(FunctionNode* function,
+                                             const std::map<std::string, FunctionNode*>& functions);
+
+#endif  // EFFECTS_HPP
@@ -0,0 +1,252 @@
+#include "interpreter.hpp"
+
+// Far more than any table needs, low enough that a loop that never ends gets reported in seconds
+static const std::size_t maxSteps = 10000000;
+
+// Every call also recurses in the compiler, this keeps it well within the stack
+static const std::size_t maxCallDepth = 1000;
+
+Interpreter::Interpreter(Diagnostics& diagnostics, StringPool& strings, FunctionLoader loadFunction, ArrayLookup findArray)
+    : diagnostics(diagnostics), strings(strings), loadFunction(std::move(loadFunction)), lookupArray(std::move(findArray)) {}
+
+LiteralNode* Interpreter::evaluate(ExpressionNode* expression) {
+    frames.clear();
+    frames.emplace_back(1);
+    steps = 0;
+
+    Value value = evaluateExpression(expression);
+    if (value.type == TokenType::STRING) {
+        return createStringLiteral(strings, value.text, expression->line);
+    }
+
+    return createIntLiteral(value.integer, expression->line);
+}
+
+std::vector<int> Interpreter::generateArray(const std::string& generator, std::size_t arrayLength, std::size_t line) {
+    frames.clear();
+    frames.emplace_back(1);
+    steps = 0;
+
+    FunctionNode* function = loadFunction(generator, line);
+    const std::vector<Variable*>& parameters = function->parameters.parameters;
+
+    // Filled in by the function, it sees the elements it already wrote
+    if (parameters.size() == 1 && parameters[0]->arrayLength == arrayLength) {
+        Value table;
+        table.array = std::make_shared<std::vector<int>>(arrayLength, 0);
+        callFunction(function, {table}, line);
+        return *table.array;
+    }
+
+    // One call per element
+    if (parameters.size() == 1 && parameters[0]->arrayLength == 0 && parameters[0]->type == TokenType::INT &&
+        function->parameters.returnType == TokenType::INT) {
+        std::vector<int> elements(arrayLength);
+        for (std::size_t i = 0; i < arrayLength; ++i) {
+            Value index;
+            index.integer = static_cast<int>(i);
+            elements[i] = callFunction(function, {index}, line).integer;
+        }
+        return elements;
+    }
+
+    diagnostics.error("Function " + generator + " can't generate an int[" + std::to_string(arrayLength) +
+                      "], it has to take an index: int and return an int, or take the whole int[" +
+                      std::to_string(arrayLength) + "]", line);
+}
+
+Interpreter::Value Interpreter::callFunction(FunctionNode* function, std::vector<Value> arguments, std::size_t line) {
+    if (frames.size() > maxCallDepth) {
+        diagnostics.error("Compile-time calls nest more than " + std::to_string(maxCallDepth) + " deep in " +
+                          function->name, line);
+    }
+
+    frames.emplace_back(1);
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        frames.back().back()[function->parameters.parameters[i]->name] = std::move(arguments[i]);
+    }
+
+    runStatements(function->body->statements);
+    Value result = evaluateExpression(function->returnValue);
+
+    frames.pop_back();
+    return result;
+}
+
+void Interpreter::runStatements(const std::vector<ASTNodeBase*>& statements) {
+    for (ASTNodeBase* statement : statements) {
+        runStatement(statement);
+    }
+}
+
+void Interpreter::runStatement(ASTNodeBase* statement) {
+    if (PrintNode* printNode = dynamic_cast<PrintNode*>(statement)) {
+        diagnostics.error("print can't run at compile time", printNode->expression->line);
+    } else if (CallNode* callNode = dynamic_cast<CallNode*>(statement)) {
+        evaluateExpression(callNode);
+    } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+        step(declaration->line);
+
+        // Their fields would need a layout of their own here, the compiled program has the real one
+        if (declaration->structType) {
+            diagnostics.error("Struct " + declaration->name + " can't be used at compile time", declaration->line);
+        }
+
+        Value value;
+        if (declaration->arrayLength > 0) {
+            // @comptime arrays start out as their elements, the others are zeroed every time the declaration runs
+            value.array = declaration->constant
+                              ? std::make_shared<std::vector<int>>(declaration->values)
+                              : std::make_shared<std::vector<int>>(declaration->arrayLength, 0);
+        } else {
+            value = evaluateExpression(declaration->value);
+        }
+
+        frames.back().back()[declaration->name] = std::move(value);
+    } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(statement)) {
+        step(assignment->line);
+
+        Value value = evaluateExpression(assignment->value);
+
+        // Only locals are known, a name the function doesn't have is a global
+        Value* local = findLocal(assignment->name);
+        if (!local) {
+            diagnostics.error("Global variable " + assignment->name + " can't be changed at compile time",
+                              assignment->line);
+        }
+
+        if (!assignment->index) {
+            *local = std::move(value);
+            return;
+        }
+
+        int index = evaluateExpression(assignment->index).integer;
+        if (index < 0 || static_cast<std::size_t>(index) >= local->array->size()) {
+            diagnostics.error("Index " + std::to_string(index) + " is out of bounds for " + assignment->name +
+                              " of length " + std::to_string(local->array->size()), assignment->line);
+        }
+        (*local->array)[index] = value.integer;
+    } else if (WhileNode* whileNode = dynamic_cast<WhileNode*>(statement)) {
+        while (evaluateCondition(whileNode->condition)) {
+            frames.back().emplace_back();
+            runStatements(whileNode->body);
+            frames.back().pop_back();
+        }
+    } else if (ForNode* forNode = dynamic_cast<ForNode*>(statement)) {
+        frames.back().emplace_back();
+
+        if (forNode->initializer) {
+            runStatement(forNode->initializer);
+        }
+
+        while (evaluateCondition(forNode->condition)) {
+            frames.back().emplace_back();
+            runStatements(forNode->body);
+            frames.back().pop_back();
+
+            runStatement(forNode->step);
+        }
+
+        frames.back().pop_back();
+    }
+}
+
+bool Interpreter::evaluateCondition(ExpressionNode* condition) {
+    return evaluateExpression(condition).integer != 0;
+}
+
+Interpreter::Value Interpreter::evaluateExpression(ExpressionNode* expression) {
+    step(expression->line);
+
+    if (LiteralNode* literal = dynamic_cast<LiteralNode*>(expression)) {
+        Value value;
+        value.type = literal->type;
+        if (literal->value.isInt()) {
+            value.integer = literal->value.getInt();
+        } else if (literal->value.isString()) {
+            value.text = literal->value.getString();
+        }
+        return value;
+    }
+
+    if (VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(expression)) {
+        Value* local = findLocal(reference->name);
+        if (!local) {
+            diagnostics.error("Variable " + reference->name + " is not known at compile time", reference->line);
+        }
+        return *local;
+    }
+
+    if (IndexNode* indexNode = dynamic_cast<IndexNode*>(expression)) {
+        const std::vector<int>& array = findArray(indexNode->name, indexNode->line);
+
+        int index = evaluateExpression(indexNode->index).integer;
+        if (index < 0 || static_cast<std::size_t>(index) >= array.size()) {
+            diagnostics.error("Index " + std::to_string(index) + " is out of bounds for " + indexNode->name +
+                              " of length " + std::to_string(array.size()), indexNode->line);
+        }
+
+        Value value;
+        value.integer = array[index];
+        return value;
+    }
+
+    if (BinaryExpressionNode* binaryNode = dynamic_cast<BinaryExpressionNode*>(expression)) {
+        int left = evaluateExpression(binaryNode->left).integer;
+        int right = evaluateExpression(binaryNode->right).integer;
+
+        // Runtime would silently wrap or trap, at compile time both are mistakes worth stopping for
+        Value value;
+        if (!performOperation(binaryNode->operatorType, left, right, value.integer)) {
+            if (binaryNode->operatorType == TokenType::SLASH && right == 0) {
+                diagnostics.error("Division by zero at compile time", binaryNode->line);
+            }
+            diagnostics.error("Integer overflow at compile time", binaryNode->line);
+        }
+        return value;
+    }
+
+    if (CallNode* callNode = dynamic_cast<CallNode*>(expression)) {
+        std::vector<Value> arguments;
+        for (ExpressionNode* argument : callNode->arguments) {
+            arguments.push_back(evaluateExpression(argument));
+        }
+
+        return callFunction(loadFunction(callNode->name, callNode->line), std::move(arguments), callNode->line);
+    }
+
+    diagnostics.error("Expression can't be evaluated at compile time", expression->line);
+}
+
+Interpreter::Value* Interpreter::findLocal(const std::string& name) {
+    // Inner scopes shadow outer ones, a call only sees its own frame
+    std::vector<std::map<std::string, Value>>& scopes = frames.back();
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto local = scope->find(name);
+        if (local != scope->end()) {
+            return &local->second;
+        }
+    }
+
+    return nullptr;
+}
+
+const std::vector<int>& Interpreter::findArray(const std::string& name, std::size_t line) {
+    Value* local = findLocal(name);
+    if (local && local->array) {
+        return *local->array;
+    }
+
+    const std::vector<int>* constant = lookupArray(name, frames.size() == 1);
+    if (!constant) {
+        diagnostics.error("Array " + name + " is not known at compile time", line);
+    }
+
+    return *constant;
+}
+
+void Interpreter::step(std::size_t line) {
+    if (++steps > maxSteps) {
+        diagnostics.error("Compile-time evaluation didn't finish within " + std::to_string(maxSteps) + " steps", line);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+
+// Runs @comptime code on the AST while it is being parsed. Everything it touches has to be known at
+// compile time: literals, the parameters and locals of the functions it calls and other @comptime values.
+class Interpreter {
+public:
+    // Hands out a function with its body parsed, bodies are normally only parsed once they turn out to be reachable
+    using FunctionLoader = std::function<FunctionNode*(const std::string& name, std::size_t line)>;
+
+    // The elements of a @comptime array the interpreter didn't declare itself, nullptr if there is none.
+    // outermost is set for names in the expression the @comptime was written on, those see the parser's scopes.
+    using ArrayLookup = std::function<const std::vector<int>*(const std::string& name, bool outermost)>;
+
+    // String results go into strings, the pool of the tree they end up in
+    Interpreter(Diagnostics& diagnostics, StringPool& strings, FunctionLoader loadFunction, ArrayLookup findArray);
+
+    // The value of expression as a literal
+    LiteralNode* evaluate(ExpressionNode* expression);
+
+    // The elements of a @comptime int[N] table. generator either takes an index: int and returns the element,
+    // or takes the whole int[N] table and fills it in.
+    std::vector<int> generateArray(const std::string& generator, std::size_t arrayLength, std::size_t line);
+
+private:
+    struct Value {
+        TokenType type = TokenType::INT;
+        int integer = 0;
+        std::string text;
+        std::shared_ptr<std::vector<int>> array; // Arrays are passed by reference, like at runtime
+    };
+
+    Value callFunction(FunctionNode* function, std::vector<Value> arguments, std::size_t line);
+    void runStatements(const std::vector<ASTNodeBase*>& statements);
+    void runStatement(ASTNodeBase* statement);
+    Value evaluateExpression(ExpressionNode* expression);
+    bool evaluateCondition(ExpressionNode* condition);
+
+    Value* findLocal(const std::string& name);
+    const std::vector<int>& findArray(const std::string& name, std::size_t line);
+    void step(std::size_t line);
+
+    Diagnostics& diagnostics;
+    StringPool& strings;
+    FunctionLoader loadFunction;
+    ArrayLookup lookupArray;
+
+    // One frame per call, every frame has its scopes
+    std::vector<std::vector<std::map<std::string, Value>>> frames;
+
+    // Counts statements and expressions, so a loop that never ends stops the compiler with an error
+    std::size_t steps = 0;
+};
+
+#endif  // INTERPRETER_HPP
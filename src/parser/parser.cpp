@@ -1,651 +1,1847 @@
+#include <algorithm>
+#include <climits>
+#include <set>
 #include <iostream>
 #include <thread>
 #include <chrono>
-#include <stack>
 
 #include "parser.hpp"
+#include "interpreter.hpp"
 
-#include "../util/globals.hpp"
+// Helper functions
+
+bool isTypeToken(TokenType type) {
+    return type == TokenType::INT || type == TokenType::STRING || type == TokenType::FLOAT;
+}
+
+// fn, import, struct and attributes start declarations. Of those only @comptime variables can be inside of functions.
+bool startsDeclaration(const std::vector<Token>& tokens, int current) {
+    if (tokens[current].type == TokenType::AT) {
+        return tokens[current + 1].lexeme != "comptime" || !isTypeToken(tokens[current + 2].type);
+    }
+
+    return tokens[current].type == TokenType::FN || tokens[current].type == TokenType::IMPORT ||
+           tokens[current].type == TokenType::STRUCT;
+}
+
+// The attributes that only go on structs
+bool isLayoutAttribute(const std::string& attribute) {
+    return attribute == "packed" || attribute == "align" || attribute == "reorder";
+}
+
+bool isComparisonOperator(TokenType type) {
+    return type == TokenType::LESS || type == TokenType::LESS_EQUAL ||
+           type == TokenType::GREATER || type == TokenType::GREATER_EQUAL ||
+           type == TokenType::EQUAL_EQUAL || type == TokenType::BANG_EQUAL;
+}
+
+// Binding strength of a binary operator, -1 for anything that isn't one
+int getOperatorPrecedence(TokenType type) {
+    if (type == TokenType::STAR || type == TokenType::SLASH) {
+        return 20;
+    } else if (type == TokenType::PLUS || type == TokenType::MINUS) {
+        return 10;
+    } else if (isComparisonOperator(type)) {
+        return 5;
+    } else {
+        return -1;
+    }
+}
+
+std::string operatorToString(TokenType type) {
+    switch (type) {
+        case TokenType::PLUS:
+            return "+";
+        case TokenType::MINUS:
+            return "-";
+        case TokenType::STAR:
+            return "*";
+        case TokenType::SLASH:
+            return "/";
+        case TokenType::LESS:
+            return "<";
+        case TokenType::LESS_EQUAL:
+            return "<=";
+        case TokenType::GREATER:
+            return ">";
+        case TokenType::GREATER_EQUAL:
+            return ">=";
+        case TokenType::EQUAL_EQUAL:
+            return "==";
+        case TokenType::BANG_EQUAL:
+            return "!=";
+        default:
+            return "?";
+    }
+}
+
+// Perform an operation on two constant operands. Returns false when the result isn't defined
+// (overflow or division by zero), the operation is then left for runtime.
+bool performOperation(TokenType operatorType, int left, int right, int& result) {
+    switch (operatorType) {
+        case TokenType::PLUS:
+            return !__builtin_add_overflow(left, right, &result);
+        case TokenType::MINUS:
+            return !__builtin_sub_overflow(left, right, &result);
+        case TokenType::STAR:
+            return !__builtin_mul_overflow(left, right, &result);
+        case TokenType::SLASH:
+            if (right == 0 || (left == INT_MIN && right == -1)) {
+                return false;
+            }
+            result = left / right;
+            return true;
+        case TokenType::LESS:
+            result = left < right;
+            return true;
+        case TokenType::LESS_EQUAL:
+            result = left <= right;
+            return true;
+        case TokenType::GREATER:
+            result = left > right;
+            return true;
+        case TokenType::GREATER_EQUAL:
+            result = left >= right;
+            return true;
+        case TokenType::EQUAL_EQUAL:
+            result = left == right;
+            return true;
+        case TokenType::BANG_EQUAL:
+            result = left != right;
+            return true;
+        default:
+            return false;
+    }
+}
+
+LiteralNode* createLiteral(ConstValue value, std::size_t line) {
+    auto* node = new LiteralNode();
+    node->type = value.getType();
+    node->line = line;
+    node->value = value;
+    return node;
+}
+
+LiteralNode* createIntLiteral(int value, std::size_t line) {
+    return createLiteral(ConstValue::fromInt(value), line);
+}
+
+LiteralNode* createStringLiteral(StringPool& pool, const std::string& value, std::size_t line) {
+    return createLiteral(ConstValue::fromString(pool, value), line);
+}
+
+Parser::Parser(const CompilerOptions& options, Diagnostics& diagnostics, ImportLoader importLoader,
+               ParserListener* listener)
+    : options(options), diagnostics(diagnostics), importLoader(std::move(importLoader)), listener(listener) {}
+
+FunctionNode* Parser::findFunction(const std::string& name) {
+    for (FunctionNode* function : functions) {
+        if (function->name == name) {
+            return function;
+        }
+    }
+
+    return nullptr;
+}
+
+void Parser::expect(const std::vector<Token>& tokens, int& current, TokenType type, const std::string& what) {
+    if (tokens[current].type != type) {
+        diagnostics.error("Expected " + what, tokens[current].position);
+    }
+
+    ++current;
+}
+
+void Parser::pushScope() {
+    scopes.emplace_back();
+}
+
+void Parser::popScope() {
+    // Warn about unused variables
+    for (auto& variable : scopes.back()) {
+        if (!variable->used) {
+            diagnostics.warning("Unused variable: " + variable->name);
+        }
+    }
+
+    scopes.pop_back();
+}
+
+Variable* Parser::declareVariable(const std::string& name, TokenType type, std::size_t line, std::size_t arrayLength) {
+    auto variable = std::make_unique<Variable>();
+    variable->name = name;
+    variable->type = type;
+    variable->arrayLength = arrayLength;
+
+    return addVariable(std::move(variable), line);
+}
+
+Variable* Parser::addVariable(std::unique_ptr<Variable> variable, std::size_t line) {
+    for (auto& declared : scopes.back()) {
+        if (declared->name == variable->name) {
+            diagnostics.error("Variable " + variable->name + " is already declared", line);
+        }
+    }
+
+    scopes.back().push_back(std::move(variable));
+
+    return scopes.back().back().get();
+}
+
+Variable* Parser::findVariable(const std::string& name) {
+    // Inner scopes shadow outer ones
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        for (auto& variable : *scope) {
+            if (variable->name == name) {
+                return variable.get();
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+ExpressionNode* Parser::parseExpression(const std::vector<Token>& tokens, int& current) {
+    ExpressionNode* left = parsePrimary(tokens, current);
+    return parseBinaryExpression(tokens, current, 0, left);
+}
+
+// Precedence climbing, keeps folding operators that bind at least as tight as precedence into left
+ExpressionNode* Parser::parseBinaryExpression(const std::vector<Token>& tokens, int& current, int precedence, ExpressionNode* left) {
+    while (true) {
+        TokenType operatorType = tokens[current].type;
+        int operatorPrecedence = getOperatorPrecedence(operatorType);
+
+        if (operatorPrecedence < precedence) {
+            return left;
+        }
+
+        std::size_t line = tokens[current].position;
+
+        // Consume the operator
+        ++current;
+
+        ExpressionNode* right;
+        try {
+            right = parsePrimary(tokens, current);
+
+            // If the next operator binds tighter, it takes the right operand first
+            int nextPrecedence = getOperatorPrecedence(tokens[current].type);
+            if (operatorPrecedence < nextPrecedence) {
+                right = parseBinaryExpression(tokens, current, operatorPrecedence + 1, right);
+            }
+        } catch (const CompilationError&) {
+            delete left;
+            throw;
+        }
+
+        left = createBinaryExpression(operatorType, left, right, line);
+    }
+}
+
+ExpressionNode* Parser::createBinaryExpression(TokenType operatorType, ExpressionNode* left, ExpressionNode* right, std::size_t line) {
+    if (left->type != TokenType::INT || right->type != TokenType::INT) {
+        delete left;
+        delete right;
+        diagnostics.error("Operator " + operatorToString(operatorType) + " needs int operands", line);
+    }
+
+    // Fold constant operands right away, codegen only sees what's left for runtime
+    LiteralNode* leftLiteral = dynamic_cast<LiteralNode*>(left);
+    LiteralNode* rightLiteral = dynamic_cast<LiteralNode*>(right);
+    if (leftLiteral && rightLiteral) {
+        int leftValue = leftLiteral->value.getInt();
+        int rightValue = rightLiteral->value.getInt();
+
+        int result;
+        if (performOperation(operatorType, leftValue, rightValue, result)) {
+            delete left;
+            delete right;
+            return createIntLiteral(result, line);
+        }
+
+        if (operatorType == TokenType::SLASH && rightValue == 0) {
+            delete left;
+            delete right;
+            diagnostics.error("Division by zero", line);
+        }
+
+        diagnostics.warning("Integer overflow in constant expression", line);
+    }
+
+    auto* node = new BinaryExpressionNode();
+    node->type = TokenType::INT;
+    node->line = line;
+    node->operatorType = operatorType;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+ExpressionNode* Parser::parsePrimary(const std::vector<Token>& tokens, int& current) {
+    const Token& token = tokens[current];
+
+    switch (token.type) {
+        case TokenType::INT: {
+            ++current;
+
+            long long value;
+            try {
+                value = std::stoll(token.lexeme);
+            } catch (const std::exception&) {
+                value = LLONG_MAX;
+            }
+
+            if (value > INT_MAX) {
+                diagnostics.error("Integer literal " + token.lexeme + " is too large", token.position);
+            }
+
+            return createIntLiteral(static_cast<int>(value), token.position);
+        }
+
+        case TokenType::STRING: {
+            ++current;
+            return createStringLiteral(tree->strings, token.lexeme, token.position);
+        }
+
+        case TokenType::IDENTIFIER: {
+            // A name followed by a parenthesis is a call
+            if (tokens[current + 1].type == TokenType::LEFT_PAREN) {
+                std::size_t calls = calledFunctions.size();
+                CallNode* call = parseCall(tokens, current);
+                if (isComptimeCall(call)) {
+                    // The calls in its arguments only run in the compiler too
+                    calledFunctions.resize(calls);
+                    return evaluateAtCompileTime(call);
+                }
+                return call;
+            }
+
+            Variable* variable = findVariable(token.lexeme);
+            if (!variable) {
+                diagnostics.error("Variable " + token.lexeme + " does not exist", token.position);
+            }
+            variable->used = true;
+
+            if (variable->arrayLength > 0) {
+                if (tokens[current + 1].type != TokenType::LEFT_BRACKET) {
+                    diagnostics.error("Array " + token.lexeme + " can only be indexed or passed to a function", token.position);
+                }
+                IndexNode* element = parseIndex(tokens, current, variable);
+
+                // A constant element of a @comptime array is just a number
+                LiteralNode* index = dynamic_cast<LiteralNode*>(element->index);
+                if (variable->constant && index) {
+                    int value = variable->values[index->value.getInt()];
+                    delete element;
+                    return createIntLiteral(value, token.position);
+                }
+                return element;
+            }
+
+            if (variable->structType) {
+                if (tokens[current + 1].type != TokenType::DOT) {
+                    diagnostics.error("Struct " + token.lexeme + " can only be used through its fields or passed to a function",
+                                      token.position);
+                }
+
+                auto* node = new FieldNode();
+                node->line = token.position;
+                node->name = token.lexeme;
+                node->structType = variable->structType;
+                node->field = parseField(tokens, current, variable);
+                node->type = node->field->type;
+                return node;
+            }
+
+            ++current;
+
+            if (variable->constant) {
+                return createLiteral(variable->value, token.position);
+            }
+
+            auto* node = new VariableReferenceNode();
+            node->type = variable->type;
+            node->line = token.position;
+            node->name = token.lexeme;
+            return node;
+        }
+
+        case TokenType::LEFT_PAREN: {
+            ++current;
+
+            ExpressionNode* node = parseExpression(tokens, current);
+
+            if (tokens[current].type != TokenType::RIGHT_PAREN) {
+                delete node;
+                diagnostics.error("Expected ')'", tokens[current].position);
+            }
+            ++current;
+
+            return node;
+        }
+
+        case TokenType::MINUS: {
+            ++current;
+
+            // -x is 0 - x, which folds back into a literal for constants
+            ExpressionNode* operand = parsePrimary(tokens, current);
+            return createBinaryExpression(TokenType::MINUS, createIntLiteral(0, token.position), operand, token.position);
+        }
+
+        case TokenType::AT: {
+            // @comptime operand, runs in the compiler and leaves just the value
+            if (tokens[current + 1].lexeme != "comptime") {
+                diagnostics.error("Only @comptime can be used in expressions", token.position);
+            }
+            current += 2;
+
+            // Nothing it calls has to be in the program
+            std::size_t calls = calledFunctions.size();
+            ExpressionNode* operand = parsePrimary(tokens, current);
+            calledFunctions.resize(calls);
+
+            return evaluateAtCompileTime(operand);
+        }
+
+        default:
+            break;
+    }
+
+    diagnostics.error("Expected an expression but got " + tokenTypeToString(token.type), token.position);
+}
+
+// array[index], current is on the array's name
+IndexNode* Parser::parseIndex(const std::vector<Token>& tokens, int& current, Variable* array) {
+    std::size_t line = tokens[current].position;
+
+    // Consume the IDENTIFIER and LEFT_BRACKET tokens
+    current += 2;
+
+    ExpressionNode* index = parseExpression(tokens, current);
+
+    auto* node = new IndexNode();
+    node->type = array->type;
+    node->line = line;
+    node->name = array->name;
+    node->arrayLength = array->arrayLength;
+    node->index = index;
+
+    if (index->type != TokenType::INT) {
+        delete node;
+        diagnostics.error("The index into " + array->name + " must be an int", line);
+    }
+
+    // Constant indices are checked right here, codegen checks the rest at runtime
+    if (LiteralNode* literal = dynamic_cast<LiteralNode*>(index)) {
+        int value = literal->value.getInt();
+        if (value < 0 || static_cast<std::size_t>(value) >= array->arrayLength) {
+            delete node;
+            diagnostics.error("Index " + std::to_string(value) + " is out of bounds for " + array->name +
+                              " of length " + std::to_string(array->arrayLength), line);
+        }
+    }
+
+    if (tokens[current].type != TokenType::RIGHT_BRACKET) {
+        delete node;
+        diagnostics.error("Expected ']'", tokens[current].position);
+    }
+    ++current;
+
+    return node;
+}
+
+// A type is int, string, int[N] for arrays or the name of a struct. current ends up after the type.
+void Parser::parseType(const std::vector<Token>& tokens, int& current, TokenType& type, std::size_t& arrayLength,
+                       const StructLayout** structType) {
+    type = tokens[current].type;
+    arrayLength = 0;
+
+    if (structType && type == TokenType::IDENTIFIER && findStruct(tokens[current].lexeme)) {
+        *structType = findStruct(tokens[current].lexeme);
+        type = TokenType::STRUCT;
+        ++current;
+        return;
+    }
+
+    if (type != TokenType::INT && type != TokenType::STRING) {
+        diagnostics.error("Unknown or unsupported type " + tokens[current].lexeme, tokens[current].position);
+    }
+    ++current;
+
+    if (tokens[current].type != TokenType::LEFT_BRACKET) {
+        return;
+    }
+
+    if (type != TokenType::INT) {
+        diagnostics.error("Only int arrays are supported", tokens[current].position);
+    }
+    ++current;
+
+    if (tokens[current].type != TokenType::INT || tokens[current].lexeme.empty() ||
+        !isdigit(tokens[current].lexeme[0]) || tokens[current].lexeme.size() > 9 ||
+        std::stoi(tokens[current].lexeme) == 0) {
+        diagnostics.error("Expected a positive array length", tokens[current].position);
+    }
+    arrayLength = std::stoul(tokens[current].lexeme);
+    ++current;
+
+    expect(tokens, current, TokenType::RIGHT_BRACKET, "']' after the array length");
+}
+
+VariableDeclarationNode* Parser::parseEquation(const std::vector<Token>& tokens, int& current, TokenType variable_type,
+                                               std::size_t arrayLength) {
+
+    // Variable Name
+    std::string variable_name = tokens[current].lexeme;
+    std::size_t line = tokens[current].position;
+
+    // Arrays start out zeroed, there is nothing to assign
+    if (arrayLength > 0) {
+        ++current;
+        expect(tokens, current, TokenType::SEMICOLON, "semicolon after array " + variable_name);
+
+        declareVariable(variable_name, variable_type, line, arrayLength);
+
+        auto* node = new VariableDeclarationNode();
+        node->name = variable_name;
+        node->type = variable_type;
+        node->arrayLength = arrayLength;
+        node->line = line;
+        return node;
+    }
+
+    if (tokens[current + 1].type != TokenType::EQUAL) {
+        diagnostics.error("Expected '=' after " + variable_name, line);
+    }
+
+    current += 2; // Eat the IDENTIFIER and EQUAL tokens
+
+    // Parse the value before declaring, so it can't refer to the variable itself
+    ExpressionNode* value = parseExpression(tokens, current);
+
+    // Check if the variable type matches the result type
+    if (variable_type != value->type) {
+        delete value;
+        diagnostics.error("Type mismatch for variable " + variable_name, line);
+    }
+
+    if (tokens[current].type != TokenType::SEMICOLON) {
+        delete value;
+        diagnostics.error("Expected semicolon", tokens[current].position);
+    }
+
+    // Consume the semicolon
+    ++current;
+
+    // Create and add the variable to the list.
+    try {
+        declareVariable(variable_name, variable_type, line);
+    } catch (const CompilationError&) {
+        delete value;
+        throw;
+    }
+
+    auto* node = new VariableDeclarationNode();
+    node->name = variable_name;
+    node->type = variable_type;
+    node->value = value;
+    node->line = line;
+    return node;
+}
+
+// Update existing variables
+AssignmentNode* Parser::updateVariable(const std::vector<Token>& tokens, int& current) {
+    AssignmentNode* node = parseAssignment(tokens, current);
+
+    if (tokens[current].type != TokenType::SEMICOLON) {
+        delete node;
+        diagnostics.error("Expected semicolon", tokens[current].position);
+    }
+
+    // Consume the semicolon
+    ++current;
+
+    return node;
+}
+
+// x = value or x[index] = value, without the semicolon so for loops can use it as their step
+AssignmentNode* Parser::parseAssignment(const std::vector<Token>& tokens, int& current) {
+
+    // Variable Name
+    std::string variable_name = tokens[current].lexeme;
+    std::size_t line = tokens[current].position;
+
+    // Check if the variable exists
+    Variable* varPointer = findVariable(variable_name);
+
+    if (!varPointer) {
+        diagnostics.error("Variable " + variable_name + " does not exist", line);
+    }
+
+    if (varPointer->constant) {
+        diagnostics.error("@comptime variable " + variable_name + " can't be changed", line);
+    }
+
+    auto* node = new AssignmentNode();
+    node->name = variable_name;
+    node->line = line;
+
+    // A field has a type of its own
+    TokenType type = varPointer->type;
+
+    try {
+        if (varPointer->structType) {
+            if (tokens[current + 1].type != TokenType::DOT) {
+                diagnostics.error("Struct " + variable_name + " can only be assigned field by field", line);
+            }
+
+            node->structType = varPointer->structType;
+            node->field = parseField(tokens, current, varPointer);
+            type = node->field->type;
+        } else if (varPointer->arrayLength > 0) {
+            if (tokens[current + 1].type != TokenType::LEFT_BRACKET) {
+                diagnostics.error("Array " + variable_name + " can only be assigned element by element", line);
+            }
+
+            // The index is parsed like an element read, the node just takes it over
+            IndexNode* element = parseIndex(tokens, current, varPointer);
+            node->index = element->index;
+            node->arrayLength = element->arrayLength;
+            element->index = nullptr;
+            delete element;
+
+            // Writing an element counts as using the array
+            varPointer->used = true;
+        } else {
+            ++current; // Eat the IDENTIFIER token
+        }
+
+        if (tokens[current].type != TokenType::EQUAL) {
+            diagnostics.error("Expected '=' after " + variable_name, line);
+        }
+
+        ++current; // Eat the EQUAL token
+
+        // Read the value of the expression
+        node->value = parseExpression(tokens, current);
+
+        // Check if the variable type matches the result type
+        if (type != node->value->type) {
+            diagnostics.error("Type mismatch for variable " + variable_name, line);
+        }
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
+
+    return node;
+}
+
+// The parenthesized condition of a loop, any int counts and non-zero is true
+ExpressionNode* Parser::parseCondition(const std::vector<Token>& tokens, int& current) {
+    expect(tokens, current, TokenType::LEFT_PAREN, "'(' before the condition");
+
+    ExpressionNode* condition = parseExpression(tokens, current);
+
+    if (condition->type != TokenType::INT) {
+        std::size_t line = condition->line;
+        delete condition;
+        diagnostics.error("A condition must be an int", line);
+    }
+
+    if (tokens[current].type != TokenType::RIGHT_PAREN) {
+        delete condition;
+        diagnostics.error("Expected ')' after the condition", tokens[current].position);
+    }
+    ++current;
+
+    return condition;
+}
+
+// { statements }, the statements get a scope of their own
+void Parser::parseBlock(const std::vector<Token>& tokens, int& current, std::vector<ASTNodeBase*>& statements) {
+    expect(tokens, current, TokenType::LEFT_BRACE, "left brace");
+
+    pushScope();
+
+    while (tokens[current].type != TokenType::RIGHT_BRACE) {
+        if (tokens[current].type == TokenType::RETURN) {
+            diagnostics.error("Return statement must be last statement in function body", tokens[current].position);
+        }
+
+        if (startsDeclaration(tokens, current)) {
+            diagnostics.error("Declarations can't be inside of functions", tokens[current].position);
+        }
+
+        if (tokens[current].type == TokenType::END_OF_FILE) {
+            diagnostics.error("Expected right brace", tokens[current].position);
+        }
+
+        ASTNodeBase* statement = parseStatement(tokens, current);
+        if (statement) {
+            statements.push_back(statement);
+        }
+    }
+
+    popScope();
+
+    // Consume the right brace
+    ++current;
+}
+
+WhileNode* Parser::parseWhile(const std::vector<Token>& tokens, int& current) {
+    // Consume the WHILE token
+    ++current;
+
+    auto* node = new WhileNode();
+
+    try {
+        node->condition = parseCondition(tokens, current);
+        parseBlock(tokens, current, node->body);
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
+
+    return node;
+}
+
+ForNode* Parser::parseFor(const std::vector<Token>& tokens, int& current) {
+    // Consume the FOR token
+    ++current;
+
+    auto* node = new ForNode();
+
+    // A variable declared by the initializer only lives as long as the loop
+    pushScope();
+
+    try {
+        expect(tokens, current, TokenType::LEFT_PAREN, "'(' after for");
+
+        if (isTypeToken(tokens[current].type)) {
+            TokenType type;
+            std::size_t arrayLength;
+            parseType(tokens, current, type, arrayLength);
+
+            if (tokens[current].type != TokenType::IDENTIFIER) {
+                diagnostics.error("Expected a variable name", tokens[current].position);
+            }
+
+            node->initializer = parseEquation(tokens, current, type, arrayLength);
+        } else if (tokens[current].type == TokenType::IDENTIFIER) {
+            node->initializer = updateVariable(tokens, current);
+        } else {
+            expect(tokens, current, TokenType::SEMICOLON, "an initializer or ';'");
+        }
+
+        node->condition = parseExpression(tokens, current);
+        if (node->condition->type != TokenType::INT) {
+            diagnostics.error("A condition must be an int", node->condition->line);
+        }
+
+        expect(tokens, current, TokenType::SEMICOLON, "semicolon after the condition");
 
-// Global Lists
-std::vector<std::unique_ptr<VariableBase>> variables;
+        if (tokens[current].type != TokenType::IDENTIFIER) {
+            diagnostics.error("Expected an assignment as the step of the loop", tokens[current].position);
+        }
+        node->step = parseAssignment(tokens, current);
 
-// Global Functions
-std::vector<FunctionNode> functions;
+        expect(tokens, current, TokenType::RIGHT_PAREN, "')' after the step");
 
-// Helper functions
+        parseBlock(tokens, current, node->body);
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
 
-// Check if a string is in regulation with the variable naming rules
-bool validStringName(std::string& name) {
-if (!name.empty()) {
-        if (name[0] >= '0' && name[0] <= '9') {
-            return false;
+    popScope();
+
+    return node;
+}
+
+ParameterNode* Parser::parseParameters(const std::vector<Token>& tokens, int& current) {
+    // Parameters node
+    auto* node = new ParameterNode();
+
+    try {
+        // Consume the left parenthesis
+        expect(tokens, current, TokenType::LEFT_PAREN, "'(' after the function name");
+
+        // Parse the identifiers inside the parentheses
+        while (tokens[current].type != TokenType::RIGHT_PAREN) {
+
+            if (tokens[current].type != TokenType::IDENTIFIER) {
+                diagnostics.error("Expected variable identifier", tokens[current].position);
+            }
+
+            // Consume the identifier
+            ++current;
+
+            std::string name = tokens[current - 1].lexeme;
+
+            // If the next token is a colon, parse the type
+            if (tokens[current].type == TokenType::COLON) {
+                // Consume the colon
+                ++current;
+
+                // Parse the type, arrays and structs are passed by reference
+                TokenType type;
+                std::size_t arrayLength;
+                const StructLayout* structType = nullptr;
+                parseType(tokens, current, type, arrayLength, &structType);
+
+                // Declare the variable
+                auto* variable = new Variable();
+                variable->name = name;
+                variable->type = type;
+                variable->arrayLength = arrayLength;
+                variable->structType = structType;
+
+                node->parameters.push_back(variable);
+            } else {
+                diagnostics.error("Expected colon after variable identifier for: " + name, tokens[current].position);
+            }
+
+            // If the next token is a comma, consume it
+            if (tokens[current].type == TokenType::COMMA) {
+                ++current;
+            }
+        }
+
+        // Consume the right parenthesis
+        ++current;
+
+        // Check if the next token is an arrow (return type indicator)
+        if (tokens[current].type == TokenType::ARROW) {
+            ++current;
+
+            // Parse the return type
+            TokenType returnType = tokens[current].type;
+
+            if (returnType != TokenType::INT && returnType != TokenType::STRING) {
+                diagnostics.error("Unknown or unsupported return type " + tokens[current].lexeme, tokens[current].position);
+            }
+
+            node->returnType = returnType;
+
+            // Consume the return type
+            ++current;
         } else {
-            for (char c : name) {
-                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '_')) {
-                    return false;
+            diagnostics.error("Function has no return type.", tokens[current].position);
+        }
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
+
+    return node;
+}
+
+ExpressionNode* Parser::parseReturn(const std::vector<Token>& tokens, int& current) {
+
+    // Consume the return token
+    if (tokens[current].type == TokenType::RETURN) {
+        ++current;
+    } else {
+        diagnostics.error("Expected function return.", tokens[current].position);
+    }
+
+    // Parse the expression
+    ExpressionNode* value = parseExpression(tokens, current);
+
+    // Consume the semicolon
+    if (tokens[current].type == TokenType::SEMICOLON) {
+        ++current;
+    } else {
+        delete value;
+        diagnostics.error("Expected semicolon", tokens[current].position);
+    }
+
+    return value;
+}
+
+FunctionBodyNode* Parser::parseFunctionBody(const std::vector<Token>& tokens, int& current, FunctionNode* functionNode) {
+    // Code to parse function body goes here
+    // This will use recursive descent parsing to parse the statements inside the function body
+
+    // Function body node
+    auto* node = new FunctionBodyNode();
+
+    // Consume the left brace
+    if (tokens[current].type == TokenType::LEFT_BRACE) {
+        ++current;
+    } else {
+        delete node;
+        diagnostics.error("Expected left brace", tokens[current].position);
+    }
+
+    // The parameters are the first variables of the function's scope
+    pushScope();
+    for (Variable* parameter : functionNode->parameters.parameters) {
+        Variable* variable = declareVariable(parameter->name, parameter->type, tokens[current].position,
+                                                 parameter->arrayLength);
+        variable->structType = parameter->structType;
+        variable->used = true; // Don't warn about parameters
+    }
+
+    try {
+        // Parse the statements inside the function body
+        while (tokens[current].type != TokenType::RIGHT_BRACE) {
+            // Exception keywords
+            if (tokens[current].type == TokenType::RETURN) {
+                std::size_t line = tokens[current].position;
+
+                // Parse the return statement
+                functionNode->returnValue = parseReturn(tokens, current);
+
+                // Check that the return statement is the last statement in the function body
+                if (tokens[current].type != TokenType::RIGHT_BRACE) {
+                    diagnostics.error("Return statement must be last statement in function body", tokens[current].position);
+                }
+
+                // Check that the return statement type matches the function return type
+                if (functionNode->returnValue->type != functionNode->parameters.returnType) {
+                    diagnostics.error("Return type " + tokenTypeToString(functionNode->returnValue->type) +
+                                      " does not match function return type " + tokenTypeToString(functionNode->parameters.returnType),
+                                      line);
                 }
+
+                continue;
+            }
+
+            if (startsDeclaration(tokens, current)) {
+                diagnostics.error("Declarations can't be inside of functions", tokens[current].position);
+            }
+
+            // Parse each statement and add it as a child of the function body node
+            ASTNodeBase* statement = parseStatement(tokens, current);
+
+            // Check for null because a lot of junk will be processed by other functions.
+            // And I just have it return nullptr if it's not used as a general statement
+            if (statement) {
+                node->statements.push_back(statement);
             }
         }
-    } else {
-        return false;
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
     }
 
-    return true;
+    popScope();
+
+    // Consume the right brace
+    ++current;
+
+    return node;
 }
 
-bool isTypeToken(TokenType type) {
-    return type == TokenType::INT || type == TokenType::STRING || type == TokenType::FLOAT;
+FunctionNode* Parser::parseFunction(const std::vector<Token>& tokens, int& current) {
+    auto* node = new FunctionNode();
+
+    // Consume the FN token
+    ++current;
+
+    // Parse the function name
+    node->name = tokens[current].lexeme;
+    ++current;
+
+    if (findFunction(node->name)) {
+        std::string name = node->name;
+        delete node;
+        diagnostics.error("Function " + name + " is already defined", tokens[current - 1].position);
+    }
+
+    // The node owns its parameters, so move them out of the parsed list
+    ParameterNode* parameters;
+    try {
+        parameters = parseParameters(tokens, current);
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
+    node->parameters.parameters = std::move(parameters->parameters);
+    node->parameters.returnType = parameters->returnType;
+    delete parameters;
+
+    // Only remember where the body is, it gets parsed once the function turns out to be reachable
+    if (tokens[current].type != TokenType::LEFT_BRACE) {
+        delete node;
+        diagnostics.error("Expected left brace", tokens[current].position);
+    }
+
+    node->bodyTokens = &tokens;
+    node->bodyStart = current;
+
+    int depth = 0;
+    do {
+        if (tokens[current].type == TokenType::LEFT_BRACE) {
+            ++depth;
+        } else if (tokens[current].type == TokenType::RIGHT_BRACE) {
+            --depth;
+        } else if (tokens[current].type == TokenType::END_OF_FILE) {
+            delete node;
+            diagnostics.error("Expected right brace", tokens[current].position);
+        }
+        ++current;
+    } while (depth > 0);
+
+    node->bodyEnd = current - 1;
+
+    functions.push_back(node);
+
+    return node;
+}
+
+CallNode* Parser::parseCall(const std::vector<Token>& tokens, int& current) {
+    std::size_t line = tokens[current].position;
+
+    FunctionNode* callee = findFunction(tokens[current].lexeme);
+    if (!callee) {
+        diagnostics.error("Function " + tokens[current].lexeme + " does not exist", line);
+    }
+
+    auto* node = new CallNode();
+    node->name = callee->name;
+    node->type = callee->parameters.returnType;
+    node->line = line;
+
+    // Consume the IDENTIFIER and LEFT_PAREN tokens
+    current += 2;
+
+    try {
+        std::vector<Variable*>& parameters = callee->parameters.parameters;
+
+        // Arguments are separated by commas
+        while (tokens[current].type != TokenType::RIGHT_PAREN) {
+            std::size_t argumentIndex = node->arguments.size();
+
+            if (argumentIndex < parameters.size() &&
+                (parameters[argumentIndex]->arrayLength > 0 || parameters[argumentIndex]->structType)) {
+                node->arguments.push_back(parseReferenceArgument(tokens, current, node, parameters[argumentIndex]));
+            } else {
+                node->arguments.push_back(parseExpression(tokens, current));
+            }
+
+            if (tokens[current].type == TokenType::COMMA) {
+                ++current;
+            } else if (tokens[current].type != TokenType::RIGHT_PAREN) {
+                diagnostics.error("Expected ')'", tokens[current].position);
+            }
+        }
+
+        // Consume the right parenthesis
+        ++current;
+
+        // Check the arguments against the parameters
+        if (node->arguments.size() != parameters.size()) {
+            diagnostics.error("Function " + node->name + " expects " + std::to_string(parameters.size()) +
+                              " arguments but got " + std::to_string(node->arguments.size()), line);
+        }
+
+        for (std::size_t i = 0; i < parameters.size(); ++i) {
+            if (node->arguments[i]->type != parameters[i]->type) {
+                diagnostics.error("Type mismatch for argument " + parameters[i]->name + " of " + node->name, line);
+            }
+        }
+    } catch (const CompilationError&) {
+        delete node;
+        throw;
+    }
+
+    // @comptime functions never run in the program, they don't make anything reachable
+    if (!callee->comptime) {
+        calledFunctions.push_back(node->name);
+    }
+
+    return node;
+}
+
+// Arrays and structs are passed by reference. The same one can't be passed twice in one call,
+// so those parameters never alias and codegen can mark them noalias.
+VariableReferenceNode* Parser::parseReferenceArgument(const std::vector<Token>& tokens, int& current, CallNode* call,
+                                                      Variable* parameter) {
+    const Token& token = tokens[current];
+
+    Variable* variable = token.type == TokenType::IDENTIFIER ? findVariable(token.lexeme) : nullptr;
+    if (!variable || variable->arrayLength != parameter->arrayLength || variable->structType != parameter->structType ||
+        (tokens[current + 1].type != TokenType::COMMA && tokens[current + 1].type != TokenType::RIGHT_PAREN)) {
+        std::string expected = parameter->structType ? "a " + parameter->structType->name + " struct"
+                                                     : "an int[" + std::to_string(parameter->arrayLength) + "] array";
+        diagnostics.error("Argument " + parameter->name + " of " + call->name + " must be " + expected, token.position);
+    }
+
+    // The callee could write to it
+    if (variable->constant) {
+        diagnostics.error("@comptime array " + variable->name + " can only be indexed", token.position);
+    }
+
+    for (ExpressionNode* argument : call->arguments) {
+        VariableReferenceNode* reference = dynamic_cast<VariableReferenceNode*>(argument);
+        if (reference && (reference->arrayLength > 0 || reference->structType) && reference->name == variable->name) {
+            diagnostics.error((variable->structType ? "Struct " : "Array ") + variable->name + " is passed to " +
+                              call->name + " more than once", token.position);
+        }
+    }
+
+    variable->used = true;
+    ++current;
+
+    auto* node = new VariableReferenceNode();
+    node->type = variable->type;
+    node->line = token.position;
+    node->name = variable->name;
+    node->arrayLength = variable->arrayLength;
+    node->structType = variable->structType;
+    return node;
 }
 
-bool isOperator(TokenType type) {
-    return type == TokenType::PLUS || type == TokenType::MINUS || type == TokenType::STAR || type == TokenType::SLASH;
+// Fields are laid out for the 64 bit targets starship builds for, an int takes 4 bytes and a string is a pointer
+static std::size_t getFieldSize(TokenType type) {
+    return type == TokenType::STRING ? 8 : 4;
 }
 
-// Check if the operator on top of the stack has higher precedence than the current operator
-bool hasHigherPrecedence(TokenType op1, TokenType op2) {
-    if (op1 == TokenType::STAR || op1 == TokenType::SLASH) {
-        return true;
-    } else if (op1 == TokenType::PLUS || op1 == TokenType::MINUS) {
-        if (op2 == TokenType::STAR || op2 == TokenType::SLASH) {
-            return false;
+static std::size_t alignTo(std::size_t offset, std::size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Gives every field its offset in the order they are in, returns the end of the last one.
+// A field is aligned to its size, or not at all when packed.
+static std::size_t placeFields(std::vector<StructField>& fields, bool packed, std::size_t& alignment) {
+    std::size_t offset = 0;
+    alignment = 1;
+    for (StructField& field : fields) {
+        std::size_t fieldAlignment = packed ? 1 : field.size;
+        offset = alignTo(offset, fieldAlignment);
+        field.offset = offset;
+        offset += field.size;
+        alignment = std::max(alignment, fieldAlignment);
+    }
+
+    return offset;
+}
+
+static void layOutStruct(StructLayout* layout) {
+    std::size_t alignment;
+    std::size_t sourceOrderEnd = placeFields(layout->fields, layout->packed, alignment);
+    layout->sourceOrderSize = alignTo(sourceOrderEnd, std::max(alignment, layout->requestedAlignment));
+
+    // Sizes are powers of two, so going from the largest alignment down every field starts right where
+    // the one before ended. Only the padding at the end can be left.
+    if (layout->reordered && !layout->packed) {
+        std::stable_sort(layout->fields.begin(), layout->fields.end(),
+                         [](const StructField& left, const StructField& right) { return left.size > right.size; });
+    }
+
+    std::size_t end = placeFields(layout->fields, layout->packed, alignment);
+    layout->alignment = std::max(alignment, layout->requestedAlignment);
+    layout->size = alignTo(end, layout->alignment);
+
+    // The struct starts on its alignment, so a field can count on as much of it as its offset keeps
+    for (StructField& field : layout->fields) {
+        field.alignment = layout->alignment;
+        while (field.offset % field.alignment != 0) {
+            field.alignment /= 2;
+        }
+    }
+}
+
+void Parser::parseStruct(const std::vector<Token>& tokens, int& current) {
+    auto layout = std::make_unique<StructLayout>();
+
+    while (tokens[current].type == TokenType::AT) {
+        std::string attribute = tokens[current + 1].lexeme;
+        std::size_t line = tokens[current].position;
+        current += 2;
+
+        if (attribute == "packed") {
+            layout->packed = true;
+        } else if (attribute == "reorder") {
+            layout->reordered = true;
+        } else if (attribute == "align") {
+            expect(tokens, current, TokenType::LEFT_PAREN, "'(' after @align");
+
+            // A power of two, up to a page
+            const std::string& lexeme = tokens[current].lexeme;
+            std::size_t alignment = 0;
+            if (tokens[current].type == TokenType::INT && !lexeme.empty() && isdigit(lexeme[0]) && lexeme.size() <= 4) {
+                alignment = std::stoul(lexeme);
+            }
+            if (alignment == 0 || alignment > 4096 || (alignment & (alignment - 1)) != 0) {
+                diagnostics.error("@align needs a power of two up to 4096", tokens[current].position);
+            }
+            layout->requestedAlignment = alignment;
+            ++current;
+
+            expect(tokens, current, TokenType::RIGHT_PAREN, "')' after the alignment");
         } else {
-            return true;
+            diagnostics.error("Unknown attribute @" + attribute, line);
         }
-    } else {
-        return false;
     }
+
+    if (tokens[current].type != TokenType::STRUCT) {
+        diagnostics.error("@packed, @align and @reorder can only be used on structs", tokens[current].position);
+    }
+    ++current;
+
+    if (tokens[current].type != TokenType::IDENTIFIER) {
+        diagnostics.error("Expected a name after struct", tokens[current].position);
+    }
+    layout->name = tokens[current].lexeme;
+    layout->line = tokens[current].position;
+    ++current;
+
+    if (findStruct(layout->name)) {
+        diagnostics.error("Struct " + layout->name + " is already defined", layout->line);
+    }
+
+    expect(tokens, current, TokenType::LEFT_BRACE, "'{' after struct " + layout->name);
+
+    // int name; or string name; one after the other
+    while (tokens[current].type != TokenType::RIGHT_BRACE) {
+        if (tokens[current].type == TokenType::END_OF_FILE) {
+            diagnostics.error("Expected right brace", tokens[current].position);
+        }
+
+        StructField field;
+        std::size_t arrayLength;
+        parseType(tokens, current, field.type, arrayLength);
+        if (arrayLength > 0) {
+            diagnostics.error("Struct fields can only be int or string", tokens[current - 1].position);
+        }
+        field.size = getFieldSize(field.type);
+
+        if (tokens[current].type != TokenType::IDENTIFIER) {
+            diagnostics.error("Expected a field name", tokens[current].position);
+        }
+        field.name = tokens[current].lexeme;
+        if (layout->findField(field.name)) {
+            diagnostics.error("Struct " + layout->name + " already has a field " + field.name, tokens[current].position);
+        }
+        ++current;
+
+        expect(tokens, current, TokenType::SEMICOLON, "semicolon after field " + field.name);
+
+        layout->fields.push_back(field);
+    }
+
+    // Consume the right brace
+    ++current;
+
+    if (layout->fields.empty()) {
+        diagnostics.error("Struct " + layout->name + " has no fields", layout->line);
+    }
+
+    if (layout->reordered && layout->packed) {
+        diagnostics.warning("@reorder does nothing for @packed struct " + layout->name + ", it has no padding", layout->line);
+    }
+
+    layOutStruct(layout.get());
+
+    if (layout->requestedAlignment > 0 && layout->requestedAlignment < layout->alignment) {
+        diagnostics.warning("@align(" + std::to_string(layout->requestedAlignment) + ") is less than the " +
+                            std::to_string(layout->alignment) + " bytes struct " + layout->name + " needs anyway",
+                            layout->line);
+    }
+
+    tree->structs.push_back(layout.release());
 }
 
-// Perform an operation on two operands
-Token performOperation(const Token& left_operand, const Token& right_operand, const Token& operator_token) {
-   // Use braced initialization to avoid "narrowing conversion" warnings
+const StructLayout* Parser::findStruct(const std::string& name) {
+    for (const StructLayout* structType : tree->structs) {
+        if (structType->name == name) {
+            return structType;
+        }
+    }
+
+    return nullptr;
+}
 
-    if (operator_token.type == TokenType::PLUS) {
-        return {TokenType::INT, std::to_string(std::stoi(left_operand.lexeme) + std::stoi(right_operand.lexeme)), 0};
-    } else if (operator_token.type == TokenType::MINUS) {
-        return {TokenType::INT, std::to_string(std::stoi(left_operand.lexeme) - std::stoi(right_operand.lexeme)), 0};
-    } else if (operator_token.type == TokenType::STAR) {
-        return {TokenType::INT, std::to_string(std::stoi(left_operand.lexeme) * std::stoi(right_operand.lexeme)), 0};
-    } else if (operator_token.type == TokenType::SLASH) {
-        return {TokenType::INT, std::to_string(std::stoi(left_operand.lexeme) / std::stoi(right_operand.lexeme)), 0};
-    } else {
-        return {TokenType::INT, "0", 0};
+// Name variable; structs start out zeroed like arrays, so there is nothing to assign
+VariableDeclarationNode* Parser::parseStructVariable(const std::vector<Token>& tokens, int& current) {
+    const StructLayout* structType = findStruct(tokens[current].lexeme);
+    if (!structType) {
+        diagnostics.error("Unknown type " + tokens[current].lexeme, tokens[current].position);
+    }
+    ++current;
+
+    std::string name = tokens[current].lexeme;
+    std::size_t line = tokens[current].position;
+    ++current;
+
+    expect(tokens, current, TokenType::SEMICOLON, "semicolon after struct " + name);
+
+    Variable* variable = declareVariable(name, TokenType::STRUCT, line);
+    variable->structType = structType;
+
+    auto* node = new VariableDeclarationNode();
+    node->name = name;
+    node->type = TokenType::STRUCT;
+    node->structType = structType;
+    node->line = line;
+    return node;
+}
+
+// .field, current is on the variable's name and ends up after the field
+const StructField* Parser::parseField(const std::vector<Token>& tokens, int& current, Variable* variable) {
+    // Consume the IDENTIFIER and DOT tokens
+    current += 2;
+
+    const StructField* field = nullptr;
+    if (tokens[current].type == TokenType::IDENTIFIER) {
+        field = variable->structType->findField(tokens[current].lexeme);
+    }
+    if (!field) {
+        diagnostics.error("Struct " + variable->structType->name + " has no field " + tokens[current].lexeme,
+                          tokens[current].position);
     }
+    ++current;
+
+    // Reading or writing a field counts as using the struct
+    variable->used = true;
+
+    return field;
 }
 
-// An actual expression parser
-Token calculateExpression(const std::vector<Token>& expression_tokens) {
-    std::stack<Token> operator_stack;
-    std::stack<Token> operand_stack;
+ASTNodeBase* Parser::parseStatement(const std::vector<Token>& tokens, int& current) {
+    // Print type of current token
+    logStream(options) << "Current token type: " << tokenTypeToString(tokens[current].type) << "\n";
+
+    flushPrint(options);
+
+    // LEFT_PAREN Token
+    if (tokens[current].type == TokenType::LEFT_PAREN) {
+        // Something is wrong if we get here
+        diagnostics.error("Unexpected '('", tokens[current].position);
+    }
+
+    // RIGHT_PAREN Token
+    if (tokens[current].type == TokenType::RIGHT_PAREN) {
+        // Something is wrong if we get here
+        diagnostics.error("Unexpected ')'", tokens[current].position);
+    }
+
+    // LEFT_BRACE Token
+    if (tokens[current].type == TokenType::LEFT_BRACE) {
+        // Something is wrong if we get here
+        diagnostics.error("Unexpected '{'", tokens[current].position);
+    }
+
+    // RIGHT_BRACE Token
+    if (tokens[current].type == TokenType::RIGHT_BRACE) {
+        // Something is wrong if we get here
+        diagnostics.error("Unexpected '}'", tokens[current].position);
+    }
+
+    // COMMA Token
+    if (tokens[current].type == TokenType::COMMA) {
+        // Something is wrong if we get here
+        diagnostics.error("Unexpected ','", tokens[current].position);
+    }
+
+    // SEMICOLON Token
+    if (tokens[current].type == TokenType::SEMICOLON) {
+        ++current;
+        return nullptr;
+    }
 
-    if (expression_tokens.size() == 1) {
-        return expression_tokens[0];
+    // FN Token
+    if (tokens[current].type == TokenType::FN) {
+        return parseFunction(tokens, current);
     }
 
-    for (const Token& token : expression_tokens) {
-        if (token.type == TokenType::INT) {
-            operand_stack.push(token);
-        } else if (token.type == TokenType::PLUS || token.type == TokenType::MINUS ||
-                   token.type == TokenType::STAR || token.type == TokenType::SLASH) {
-            while (!operator_stack.empty() && hasHigherPrecedence(operator_stack.top().type, token.type)) {
-                Token operator_token = operator_stack.top();
-                operator_stack.pop();
+    // Struct declarations, with or without attributes in front
+    if (tokens[current].type == TokenType::STRUCT ||
+        (tokens[current].type == TokenType::AT && isLayoutAttribute(tokens[current + 1].lexeme))) {
+        parseStruct(tokens, current);
+        return nullptr;
+    }
 
-                Token right_operand = operand_stack.top();
-                operand_stack.pop();
+    // AT Token, attributes in front of declarations
+    if (tokens[current].type == TokenType::AT) {
+        // Consume the AT token
+        ++current;
 
-                Token left_operand = operand_stack.top();
-                operand_stack.pop();
+        std::string attribute = tokens[current].lexeme;
+        ++current;
 
-                Token result = performOperation(left_operand, right_operand, operator_token);
-                operand_stack.push(result);
+        if (attribute == "export") {
+            if (tokens[current].type != TokenType::FN) {
+                diagnostics.error("@export can only be used on functions", tokens[current].position);
             }
 
-            operator_stack.push(token);
+            FunctionNode* node = parseFunction(tokens, current);
+            node->exported = true;
+            return node;
         }
-    }
 
-    while (!operator_stack.empty()) {
-        Token operator_token = operator_stack.top();
-        operator_stack.pop();
+        if (attribute == "comptime") {
+            if (tokens[current].type == TokenType::FN) {
+                FunctionNode* node = parseFunction(tokens, current);
+                node->comptime = true;
+                return node;
+            }
 
-        Token right_operand = operand_stack.top();
-        operand_stack.pop();
+            if (isTypeToken(tokens[current].type)) {
+                return parseConstant(tokens, current);
+            }
 
-        Token left_operand = operand_stack.top();
-        operand_stack.pop();
+            diagnostics.error("@comptime can only be used on functions, variables and expressions", tokens[current].position);
+        }
 
-        Token result = performOperation(left_operand, right_operand, operator_token);
-        operand_stack.push(result);
+        diagnostics.error("Unknown attribute @" + attribute, tokens[current - 1].position);
     }
 
-    return operand_stack.top();
-}
-
-VariableBase parseEquation(const std::vector<Token>& tokens, int& current) {
-
-    // Variable Name
-    std::string variable_name = tokens[current].lexeme;
-
-    // Read the type of variable this will be. (It's the previous token)
-    TokenType variable_type = tokens[current - 1].type;
+    // IMPORT Token
+    if (tokens[current].type == TokenType::IMPORT) {
+        // Consume the IMPORT token
+        ++current;
 
-    current += 2; // Eat the IDENTIFIER and EQUAL tokens
+        if (tokens[current].type != TokenType::STRING) {
+            diagnostics.error("Expected a file name after import", tokens[current].position);
+        }
 
-    // Calculate the value of the expression
-    std::vector<Token> expression_tokens;
-    while (tokens[current].type != TokenType::SEMICOLON) {
-        expression_tokens.push_back(tokens[current]);
+        std::string path = tokens[current].lexeme;
+        std::size_t line = tokens[current].position;
         ++current;
-    }
 
-    Token result = calculateExpression(expression_tokens);
-    // Check if the variable type matches the result type
-    if (variable_type != result.type) {
-        std::cerr << "Type mismatch for variable " << variable_name << " on line " << tokens[current].position << "\n";
-        exit(1);
-    }
+        expect(tokens, current, TokenType::SEMICOLON, "semicolon");
 
+        if (!importLoader) {
+            diagnostics.error("Imports are not available here", line);
+        }
 
-    // Consume the semicolon
-    ++current;
+        // The imported declarations go straight into the tree
+        const std::vector<Token>* importedTokens = importLoader(path, line);
+        if (importedTokens) {
+            parseDeclarations(*importedTokens);
+        }
 
-    // Create and add the variable to the list.
-    if (variable_type == TokenType::INT) {
-        std::unique_ptr<Variable<int>> variable = std::make_unique<Variable<int>>();
-        variable->name = variable_name;
-        variable->value = std::stoi(result.lexeme);
-        variable->type = TokenType::INT;
-        variables.push_back(std::move(variable));
-
-        return *variables.back();
-    } else {
-        // Impossible, there must be an error
-        std::cerr << "Unknown variable type\n";
-        exit(1);
+        return nullptr;
     }
-}
-
-// Update existing variables
-void updateVariable(const std::vector<Token>& tokens, int& current) {
 
-    // Variable Name
-    std::string variable_name = tokens[current].lexeme;
+    // PRINT Token
+    if (tokens[current].type == TokenType::PRINT) {
+        ++current;
 
-    // Check if the variable exists
-    bool found = false;
+        // The contents of the print statement are one expression inside parentheses
+        expect(tokens, current, TokenType::LEFT_PAREN, "'(' after print");
 
-    // TODO: Later add virtual constructor to make the variables more generic
-    VariableBase* varPointer = nullptr;
+        ExpressionNode* expression = parseExpression(tokens, current);
 
-    for (const auto& variable : variables) {
-        if (variable->name == tokens[current].lexeme) {
-            found = true;
-            // Get pointer
-            varPointer = variable.get();
-            break;
+        if (tokens[current].type != TokenType::RIGHT_PAREN || tokens[current + 1].type != TokenType::SEMICOLON) {
+            delete expression;
+            diagnostics.error("Expected ');' after print", tokens[current].position);
         }
-    }
+        current += 2;
 
-    if (!found) {
-        std::cerr << "\033[1;31m" << "Variable " << variable_name << " on line " << tokens[current].position << " does not exist\n" << "\033[0m";
-        exit(1);
-    }
-
-    current += 2; // Eat the IDENTIFIER and EQUAL tokens
-
-    // Read the value of the expression
-    // It might be a literal or a variable
-    std::vector<Token> expression_tokens;
-    while (tokens[current].type != TokenType::SEMICOLON) {
-        expression_tokens.push_back(tokens[current]);
-        ++current;
-    }
+        // Debug print the print contents
+        logStream(options) << "Print contents: " << tokenTypeToString(expression->type) << "\n";
 
-    Token result = calculateExpression(expression_tokens);
+        auto* node = new PrintNode();
+        node->expression = expression;
+        node->type = expression->type;
 
-    // Check if the variable type matches the result type
-    if (varPointer->type != result.type) {
-        std::cerr << "\033[1;31m" << "Type mismatch for variable " << variable_name << " on line " << tokens[current].position << "\n" << "\033[0m";
-        exit(1);
+        return node;
     }
 
-    // Update the variable
-    dynamic_cast<Variable<int>*>(varPointer)->value = std::stoi(result.lexeme);
-}
-
-ParameterNode* parseParameters(const std::vector<Token>& tokens, int& current) {
-    // Parameters node
-    auto* node = new ParameterNode();
-
-    // Consume the left parenthesis
-    ++current;
-
-    // Parse the identifiers inside the parentheses
-    while (tokens[current].type != TokenType::RIGHT_PAREN) {
+    // Type tokens start a variable declaration
+    if (isTypeToken(tokens[current].type)) {
+        TokenType type;
+        std::size_t arrayLength;
+        parseType(tokens, current, type, arrayLength);
 
         if (tokens[current].type != TokenType::IDENTIFIER) {
-            std::cerr << "Expected variable identifier\n";
-            exit(1);
+            diagnostics.error("Expected a variable name after " + tokens[current - 1].lexeme, tokens[current].position);
         }
 
-        // Consume the identifier
-        ++current;
+        return parseEquation(tokens, current, type, arrayLength);
+    }
 
-        // Declare the variable
-        VariableBase* variable = new VariableBase();
-        variable->name = tokens[current - 1].lexeme;
+    // Loops
+    if (tokens[current].type == TokenType::WHILE) {
+        return parseWhile(tokens, current);
+    }
 
-        // If the next token is a colon, parse the type
-        if (tokens[current].type == TokenType::COLON) {
-            // Consume the colon
-            ++current;
+    if (tokens[current].type == TokenType::FOR) {
+        return parseFor(tokens, current);
+    }
 
-            // Parse the type
-            TokenType type = tokens[current].type;
+    // END_OF_FILE Token
+    if (tokens[current].type == TokenType::END_OF_FILE) {
+        current++;
+        return nullptr;
+    }
 
-            // Create the variable
-            if (type == TokenType::INT) {
-                variable = new Variable<int>();
-                variable->type = TokenType::INT;
+    // IDENTIFIER Token
+    if (tokens[current].type == TokenType::IDENTIFIER) {
+        // A name followed by a parenthesis is a call
+        if (tokens[current + 1].type == TokenType::LEFT_PAREN) {
+            std::size_t calls = calledFunctions.size();
+            CallNode* node = parseCall(tokens, current);
+
+            if (tokens[current].type != TokenType::SEMICOLON) {
+                delete node;
+                diagnostics.error("Expected semicolon", tokens[current].position);
+            }
+            ++current;
 
-                node->parameters.push_back(variable);
-            } else {
-                std::cerr << "Unknown or unsupported type of variable\n";
-                exit(1);
+            // Only its result would be left, and nothing uses it
+            if (isComptimeCall(node)) {
+                calledFunctions.resize(calls);
+                delete evaluateAtCompileTime(node);
+                return nullptr;
             }
 
-            // Consume the type
-            ++current;
-        } else {
-            std::cerr << "Expected colon after variable identifier for: " << variable->name << "\n";
-            exit(1);
+            return node;
         }
 
-        // If the next token is a comma, consume it
-        if (tokens[current].type == TokenType::COMMA) {
-            ++current;
+        // Two names are a struct type and a variable of it
+        if (tokens[current + 1].type == TokenType::IDENTIFIER) {
+            return parseStructVariable(tokens, current);
         }
+
+        // Anything else that starts with a name is a "variable update"
+        return updateVariable(tokens, current);
     }
 
-    // Consume the right parenthesis
-    ++current;
+    // If we don't recognize the token, return nullptr
+    diagnostics.error("Unrecognized token type: " + tokenTypeToString(tokens[current].type), tokens[current].position);
+}
 
-    // Check if the next token is an arrow (return type indicator)
-    if (tokens[current].type == TokenType::ARROW) {
-        ++current;
+ASTTree* Parser::parse(const std::vector<Token>& tokens) {
+    tree = new ASTTree();
 
-        // Parse the return type
-        TokenType returnType = stringToTokenType(tokens[current].lexeme);
+    try {
+        // The top level scope
+        pushScope();
 
-        node->returnType = returnType;
+        parseDeclarations(tokens);
+        if (listener) {
+            listener->declarationsParsed(tree);
+        }
+        parseReachableFunctions();
 
-        // Consume the return type
-        ++current;
-    } else {
-        std::cerr << "Function has no return type.\n";
-        exit(1);
+        popScope();
+    } catch (const CompilationError&) {
+        if (listener) {
+            listener->parsingDone(false);
+        }
+        delete tree;
+        tree = nullptr;
+        throw;
     }
 
-    return node;
+    if (listener) {
+        listener->parsingDone(true);
+    }
+
+    ASTTree* root = tree;
+    tree = nullptr;
+    return root;
 }
 
-VariableBase* parseReturn(const std::vector<Token>& tokens, int& current) {
+void Parser::parseDeclarations(const std::vector<Token>& tokens) {
+    // Imports recurse into here, so every call is one file
+    int sourceIndex = tree->sourceCount++;
 
-    VariableBase* variable;
+    int current = 0;
+    while (current < tokens.size()) {
+        std::size_t line = tokens[current].position;
 
-    // Consume the return token
-    if (tokens[current].type == TokenType::RETURN) {
-        ++current;
-    } else {
-        std::cerr << "Expected function return.\n";
-        exit(1);
-    }
+        ASTNodeBase* statement = parseStatement(tokens, current);
 
-    // Parse the expression
-    std::vector<Token> expression_tokens;
-    while (tokens[current].type != TokenType::SEMICOLON) {
-        expression_tokens.push_back(tokens[current]);
-        ++current;
-    }
+        // If the statement is null, we just skip it
+        if (statement == nullptr) {
+            continue;
+        }
 
-    Token result = calculateExpression(expression_tokens);
+        // Only functions and variables can live at the top level
+        if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+            function->sourceIndex = sourceIndex;
+        } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            declaration->sourceIndex = sourceIndex;
 
-    // Debug print the result of the expression
-    std::cout << "Result of expression: " << result.lexeme << "\n";
+            if (declaration->arrayLength > 0 && !declaration->constant) {
+                delete statement;
+                diagnostics.error("Arrays can only be declared inside of functions, unless they are @comptime", line);
+            }
 
-    // Set the value of the variable
-    if (result.type == TokenType::INT) {
-        // Set the variable to be an <int>
-        variable = new Variable<int>();
-        dynamic_cast<Variable<int>*>(variable)->value = std::stoi(result.lexeme); // Improve this. Shouldn't need to dynamic cast
-        dynamic_cast<Variable<int>*>(variable)->type = result.type; // More secure than just setting TokenType::INT
-    } else if (result.type == TokenType::STRING) {
-        variable = new Variable<std::string>();
-        dynamic_cast<Variable<std::string>*>(variable)->value = result.lexeme;
-        dynamic_cast<Variable<std::string>*>(variable)->type = result.type;
-    } else {
-        std::cerr << "Unknown or unsupported type of variable\n";
-        exit(1);
-    }
+            if (declaration->structType) {
+                delete statement;
+                diagnostics.error("Struct variables can only be declared inside of functions", line);
+            }
+        } else {
+            delete statement;
+            diagnostics.error("Only functions and variable declarations are allowed outside of functions", line);
+        }
 
-    // Consume the semicolon
-    if (tokens[current].type == TokenType::SEMICOLON) {
-        ++current;
-    } else {
-        std::cerr << "Expected semicolon\n";
-        exit(1);
+        tree->statements.push_back(statement);
     }
-
-    return variable;
 }
 
-FunctionBodyNode* parseFunctionBody(const std::vector<Token>& tokens, int& current, FunctionNode* functionNode) {
-    // Code to parse function body goes here
-    // This will use recursive descent parsing to parse the statements inside the function body
-
-    // Function body node
-    auto* node = new FunctionBodyNode();
+void Parser::parseReachableFunctions() {
+    // Everything starts at main, exported functions are roots too if they have to be kept
+    std::vector<FunctionNode*> worklist;
 
-    // Consume the left brace
-    if (tokens[current].type == TokenType::LEFT_BRACE) {
-        ++current;
-    } else {
-        std::cerr << "Expected left brace\n";
-        exit(1);
+    FunctionNode* mainFunction = findFunction("main");
+    if (mainFunction) {
+        worklist.push_back(mainFunction);
     }
 
-    // Parse the statements inside the function body
-    while (tokens[current].type != TokenType::RIGHT_BRACE) {
-        // Exception keywords
-        if (tokens[current].type == TokenType::RETURN) {
-            // Parse the return statement
-            VariableBase* returnNode = parseReturn(tokens, current);
-
-            functionNode->returnVariable = returnNode;
-            // For some reason the functionNode->returnVariable is drifting, so this sets it back to the correct value
-            // TODO: Fix function return variable drifting
-
-            // Check that the return statement is the last statement in the function body
-            if (tokens[current].type != TokenType::RIGHT_BRACE) {
-                std::cerr << "Return statement must be last statement in function body\n";
-                exit(1);
+    if (options.keepExportedFunctions) {
+        for (FunctionNode* function : functions) {
+            if (function->exported && function != mainFunction) {
+                worklist.push_back(function);
             }
+        }
+    }
 
-            // Check that the return statement type matches the function return type
-            // TODO: Very ugly, fix later...
-            if (returnNode->type != functionNode->returnVariable->type) {
-                std::cerr << "Return type does not match function return type\n";
-
-                std::cerr << "\n";
-                printAST(functionNode, 0);
-                std::cerr << "\n";
+    if (worklist.empty()) {
+        diagnostics.warning("There is no main function, so no function is reachable");
+    }
 
-                std::cerr << "Return type: " << tokenTypeToString(returnNode->type) << "\n";
-                std::cerr << "Function return type " << tokenTypeToString(functionNode->returnVariable->type) << "\n";
-                exit(1);
-            }
+    // Parse the bodies, every call found along the way adds its callee to the worklist.
+    // @comptime may have parsed some bodies already, their calls still count.
+    std::set<FunctionNode*> reached;
+    while (!worklist.empty()) {
+        FunctionNode* function = worklist.back();
+        worklist.pop_back();
 
-            functionNode->returnVariable->type = returnNode->type;
+        if (!reached.insert(function).second) {
             continue;
         }
 
-        // Parse each statement and add it as a child of the function body node
-        ASTNodeBase* statement = parseStatement(tokens, current);
+        parseBody(function, 0);
+        if (listener && !function->comptime) {
+            listener->functionParsed(function);
+        }
 
-        // Check for null because a lot of junk will be processed by other functions.
-        // And I just have it return nullptr if it's not used as a general statement
-        if (statement) {
-            node->statements.push_back(statement);
+        for (const std::string& name : function->callees) {
+            FunctionNode* callee = findFunction(name);
+            if (!reached.count(callee)) {
+                worklist.push_back(callee);
+            }
         }
     }
 
-    // Consume the right brace
-    if (tokens[current].type == TokenType::RIGHT_BRACE) {
-        ++current;
-    } else {
-        std::cerr << "Expected right brace\n";
-        exit(1);
+    if (options.parseEveryFunction) {
+        for (FunctionNode* function : functions) {
+            parseBody(function, 0);
+        }
     }
 
-    return node;
-}
-
-ASTNodeBase* parseStatement(const std::vector<Token>& tokens, int& current) {
-    // Print type of current token
-    std::cout << "Current token type: " << tokenTypeToString(tokens[current].type) << "\n";
-
-    flushPrint();
-
-    // LEFT_PAREN Token
-    if (tokens[current].type == TokenType::LEFT_PAREN) {
-        // Something is wrong if we get here
-        std::cerr << "Unexpected '('\n";
-        exit(1);
-    }
+    // Drop every function nothing reachable calls, before anything gets generated for it.
+    // @comptime functions already did their work, the program never calls them.
+    std::size_t droppedFunctions = 0;
+    std::vector<ASTNodeBase*> statements;
+    for (ASTNodeBase* statement : tree->statements) {
+        FunctionNode* function = dynamic_cast<FunctionNode*>(statement);
+        if (function && (!reached.count(function) || function->comptime)) {
+            functions.erase(std::find(functions.begin(), functions.end(), function));
+            droppedFunctions += !function->comptime;
+            delete function;
+            continue;
+        }
 
-    // RIGHT_PAREN Token
-    if (tokens[current].type == TokenType::RIGHT_PAREN) {
-        // Something is wrong if we get here
-        std::cerr << "Unexpected ')'\n";
-        exit(1);
+        statements.push_back(statement);
     }
+    tree->statements = std::move(statements);
 
-    // LEFT_BRACE Token
-    if (tokens[current].type == TokenType::LEFT_BRACE) {
-        // Something is wrong if we get here
-        std::cerr << "Unexpected '{'\n";
-        exit(1);
+    if (droppedFunctions > 0) {
+        logStream(options) << "Dropped " << droppedFunctions << " unreachable functions\n";
     }
+}
 
-    // RIGHT_BRACE Token
-    if (tokens[current].type == TokenType::RIGHT_BRACE) {
-        // Something is wrong if we get here
-        std::cerr << "Unexpected '}'\n";
-        exit(1);
+FunctionNode* Parser::parseBody(FunctionNode* function, std::size_t line) {
+    if (function->body != nullptr) {
+        return function;
     }
 
-    // COMMA Token
-    if (tokens[current].type == TokenType::COMMA) {
-        // Something is wrong if we get here
-        std::cerr << "Unexpected ','\n";
-        exit(1);
+    if (std::find(parsingBodies.begin(), parsingBodies.end(), function) != parsingBodies.end()) {
+        diagnostics.error("Function " + function->name + " can't run at compile time inside of its own body", line);
     }
 
-    // SEMICOLON Token
-    if (tokens[current].type == TokenType::SEMICOLON) {
-        ++current;
-        return nullptr;
+    // @comptime can need a body while another one is half parsed, that one's locals and calls are put aside
+    std::vector<std::vector<std::unique_ptr<Variable>>> outerScopes;
+    while (scopes.size() > 1) {
+        outerScopes.push_back(std::move(scopes.back()));
+        scopes.pop_back();
     }
 
-    // FN Token
-    if (tokens[current].type == TokenType::FN) {
-        auto* node = new FunctionNode();
-
-        // Consume the FN token
-        ++current;
-
-        // Parse the function name
-        node->name = tokens[current].lexeme;
-        ++current;
+    std::vector<std::string> outerCalls = std::move(calledFunctions);
+    bool outerComptime = parsingComptimeFunction;
 
-        // Parse the function parameters and print them
-        // Why is there a * here?
-        node->parameters = *parseParameters(tokens, current);
+    calledFunctions.clear();
+    parsingComptimeFunction = function->comptime;
+    parsingBodies.push_back(function);
 
-        // Parse the function body
-        node->body = parseFunctionBody(tokens, current, node);
+    int current = function->bodyStart;
+    function->body = parseFunctionBody(*function->bodyTokens, current, function);
 
-        // Debug Print the name, return type, and parameters of the function
-        std::cout << "Function name: " << node->name << "\n";
-        std::cout << "Function return type: " << tokenTypeToString(node->returnVariable->type) << "\n";
-        std::cout << "Function parameters: " << "\n";
-        for (auto& parameter : node->parameters.parameters) {
-            std::cout << "Parameter name: " << parameter->name << "\n";
-            std::cout << "Parameter type: " << tokenTypeToString(parameter->type) << "\n";
-        }
+    if (function->returnValue == nullptr) {
+        diagnostics.error("Function " + function->name + " has no return statement",
+                          (*function->bodyTokens)[function->bodyEnd].position);
+    }
 
-        return node;
+    // Debug Print the name, return type, and parameters of the function
+    logStream(options) << "Function name: " << function->name << "\n";
+    logStream(options) << "Function return type: " << tokenTypeToString(function->parameters.returnType) << "\n";
+    logStream(options) << "Function parameters: " << "\n";
+    for (auto& parameter : function->parameters.parameters) {
+        logStream(options) << "Parameter name: " << parameter->name << "\n";
+        logStream(options) << "Parameter type: " << tokenTypeToString(parameter->type) << "\n";
     }
 
-    // PRINT Token
-    if (tokens[current].type == TokenType::PRINT) {
-        auto* node = new PrintNode();
+    function->callees = std::move(calledFunctions);
 
-        ++current;
+    parsingBodies.pop_back();
+    parsingComptimeFunction = outerComptime;
+    calledFunctions = std::move(outerCalls);
+    while (!outerScopes.empty()) {
+        scopes.push_back(std::move(outerScopes.back()));
+        outerScopes.pop_back();
+    }
 
-        // Parse the contents of the print statement
-        std::vector<Token> printContents;
-        while (tokens[current].type != TokenType::SEMICOLON) {
-            printContents.push_back(tokens[current++]);
-        }
+    return function;
+}
 
-        // Remove the first and last tokens as they are ( and )
-        printContents.erase(printContents.begin());
-        printContents.pop_back();
+// Calls to @comptime functions run right away, except in other @comptime functions, which run them when they run
+bool Parser::isComptimeCall(CallNode* call) {
+    return findFunction(call->name)->comptime && !parsingComptimeFunction;
+}
 
-        // Check and ground variables.
-        for (auto& token : printContents) {
-            // Check if the token is an operator
-            if (isOperator(token.type)) {
-                continue;
+Interpreter Parser::createInterpreter() {
+    return Interpreter(
+        diagnostics, tree->strings,
+        [this](const std::string& name, std::size_t line) { return parseBody(findFunction(name), line); },
+        [this](const std::string& name, bool outermost) -> const std::vector<int>* {
+            // Functions only see the top level, the expression itself sees everything around it
+            Variable* variable = nullptr;
+            if (outermost) {
+                variable = findVariable(name);
+            } else {
+                for (auto& topLevel : scopes.front()) {
+                    if (topLevel->name == name) {
+                        variable = topLevel.get();
+                    }
+                }
             }
 
-            // Check if the token is a number or string literal
-            if (token.type == TokenType::INT || token.type == TokenType::STRING) {
-                continue;
+            if (!variable || !variable->constant || variable->arrayLength == 0) {
+                return nullptr;
             }
+            return &variable->values;
+        });
+}
 
-            // Check if the token is a valid variable name
-            std::string variable_name = token.lexeme;
-            if (validStringName(variable_name)) {
-                bool variable_found = false;
-
-                // Check if it's in the variable list
-                for (auto& list_variable : variables) {
-                    if (variable_name == list_variable->name) {
-                        variable_found = true;
-                        list_variable->used = true;
+LiteralNode* Parser::evaluateAtCompileTime(ExpressionNode* expression) {
+    Interpreter interpreter = createInterpreter();
 
-                        // Replace the IDENTIFIER token with the correct node type for the variable
-                        token.type = list_variable->type;
-                        token.lexeme = std::to_string(dynamic_cast<Variable<int>*>(list_variable.get())->value);
+    LiteralNode* literal;
+    try {
+        literal = interpreter.evaluate(expression);
+    } catch (const CompilationError&) {
+        delete expression;
+        throw;
+    }
 
-                        break;
-                    }
-                }
+    delete expression;
+    return literal;
+}
 
-                if (!variable_found) {
-                    // Variable not found
-                    std::cerr << "Variable not found: " << variable_name << " Line: " << token.position << "\n";
-                }
-            }
-        }
+// @comptime int x = value; or @comptime int[N] table = generator; current is on the type
+VariableDeclarationNode* Parser::parseConstant(const std::vector<Token>& tokens, int& current) {
+    TokenType type;
+    std::size_t arrayLength;
+    parseType(tokens, current, type, arrayLength);
 
-        // Debug print the print contents
-        std::cout << "Print contents: ";
-        for (auto& token : printContents) {
-            std::cout << "(" << token.lexeme << ", " << tokenTypeToString(token.type) << ")";
-        }
-        std::cout << "\n";
+    if (tokens[current].type != TokenType::IDENTIFIER) {
+        diagnostics.error("Expected a variable name after " + tokens[current - 1].lexeme, tokens[current].position);
+    }
 
-        // Calculate the result of the print statement
-        Token printCalculationResult = calculateExpression(printContents);
+    std::string name = tokens[current].lexeme;
+    std::size_t line = tokens[current].position;
+    ++current;
 
-        VariableBase* printVariable = nullptr;
+    expect(tokens, current, TokenType::EQUAL, "'=' after @comptime variable " + name);
 
-        switch(printCalculationResult.type) {
-            case TokenType::INT: {
-                Variable<int>* intVariable = new Variable<int>();
-                intVariable->type = TokenType::INT;
-                intVariable->value = std::stoi(printCalculationResult.lexeme);
-                printVariable = intVariable;
-                break;
-            }
-            case TokenType::STRING: {
-                Variable<std::string>* stringVariable = new Variable<std::string>();
-                stringVariable->type = TokenType::STRING;
-                stringVariable->value = printCalculationResult.lexeme;
-                printVariable = stringVariable;
-                break;
-            }
+    // Tables are filled in by a function, the program gets them as a constant array
+    if (arrayLength > 0) {
+        if (tokens[current].type != TokenType::IDENTIFIER || !findFunction(tokens[current].lexeme)) {
+            diagnostics.error("@comptime array " + name + " needs the name of a function to fill it in",
+                              tokens[current].position);
         }
 
-        if (!printVariable) {
-            std::cerr << "Something went wrong when calculating the print statement\n";
-            exit(1);
+        std::string generator = tokens[current].lexeme;
+        ++current;
+        expect(tokens, current, TokenType::SEMICOLON, "semicolon after @comptime array " + name);
+
+        Interpreter interpreter = createInterpreter();
+
+        auto variable = std::make_unique<Variable>();
+        variable->name = name;
+        variable->type = type;
+        variable->arrayLength = arrayLength;
+        variable->constant = true;
+        variable->values = interpreter.generateArray(generator, arrayLength, line);
+
+        auto* node = new VariableDeclarationNode();
+        node->name = name;
+        node->type = type;
+        node->arrayLength = arrayLength;
+        node->line = line;
+        node->constant = true;
+        node->values = variable->values;
+
+        try {
+            addVariable(std::move(variable), line);
+        } catch (const CompilationError&) {
+            delete node;
+            throw;
         }
 
-        node->expression = printVariable;
-
         return node;
     }
 
-    // FLOAT Token
-    if (tokens[current].type == TokenType::FLOAT) {
-        current++;
-        return nullptr;
-    }
-
-    // INT Token
-    if (tokens[current].type == TokenType::INT) {
-        current++;
-        return nullptr;
-    }
+    std::size_t calls = calledFunctions.size();
+    ExpressionNode* value = parseExpression(tokens, current);
+    calledFunctions.resize(calls);
 
-    // STRING Token
-    if (tokens[current].type == TokenType::STRING) {
-        current++;
-        return nullptr;
+    if (value->type != type) {
+        delete value;
+        diagnostics.error("Type mismatch for variable " + name, line);
     }
 
-    // END_OF_FILE Token
-    if (tokens[current].type == TokenType::END_OF_FILE) {
-        current++;
-        return nullptr;
+    if (tokens[current].type != TokenType::SEMICOLON) {
+        delete value;
+        diagnostics.error("Expected semicolon", tokens[current].position);
     }
+    ++current;
 
-    // IDENTIFIER Token
-    if (tokens[current].type == TokenType::IDENTIFIER) {
-        // Check if the previous token is a type token. This would mean that this is a variable declaration
-        if(isTypeToken(tokens[current - 1].type)) {
-            auto* variable = new VariableNode();
-            variable->variable = parseEquation(tokens, current);
-        } else {
-            updateVariable(tokens, current);
-        }// If there is something else before the identifier, then it's a "variable update"
-
-        return nullptr;
-    }
+    // Every use becomes the value, so nothing is left to generate
+    LiteralNode* literal = evaluateAtCompileTime(value);
+    auto variable = std::make_unique<Variable>();
+    variable->name = name;
+    variable->type = type;
+    variable->constant = true;
+    variable->value = literal->value;
+    delete literal;
 
-    // EQUAL Token
-    if (tokens[current].type == TokenType::EQUAL) {
-        ++current;
-        return nullptr;
-    }
+    addVariable(std::move(variable), line);
 
-    // If we don't recognize the token, return nullptr
-    std::cerr << "Unrecognized token type: " << tokenTypeToString(tokens[current].type) << "\n at line: " << tokens[current].position << "\n";
-    exit(1);
+    return nullptr;
 }
 
-ASTTree* performParserAnalysis(const std::vector<Token>& tokens) {
-    std::cout << "RUNNING: Starting Parser Analysis\n";
+ASTTree* performParserAnalysis(const std::vector<Token>& tokens, const CompilerOptions& options, Diagnostics& diagnostics,
+                               ImportLoader importLoader, ParserListener* listener) {
+    logStream(options) << "RUNNING: Starting Parser Analysis\n";
 
     // Start the timer
     auto startTime = std::chrono::high_resolution_clock::now();
 
-    auto* root = new ASTTree();
-
-    int current = 0;
-    while (current < tokens.size()) {
-        ASTNodeBase* statement = parseStatement(tokens, current);
-        if (statement != nullptr) {
-            root->statements.push_back(statement);
-        }
-        // If the statement is null, we just skip it
-    }
+    Parser parser(options, diagnostics, std::move(importLoader), listener);
+    ASTTree* root = parser.parse(tokens);
 
     // Stop the timer
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -653,21 +1849,14 @@ ASTTree* performParserAnalysis(const std::vector<Token>& tokens) {
 
     // Print the elapsed time
     double seconds = duration / 1e9;  // Convert nanoseconds to seconds
-    flushPrint();
-    flushPrint();
-    std::cout << "DONE: Parser Analysis took " << seconds << " seconds\n";
-
-    // Warn about unused variables
-    for (auto& variable : variables) {
-        if (!variable->used) {
-            std::cerr << "\033[1;31m" << "WARNING: Unused variable: " << variable->name << "\033[0m\n"; // Red
-        }
-    }
+    flushPrint(options);
+    flushPrint(options);
+    logStream(options) << "DONE: Parser Analysis took " << seconds << " seconds\n";
 
     return root;
 }
 
-void printAST(ASTNodeBase* node, int indent) {
+void printAST(ASTNodeBase* node, int indent, std::ostream& stream) {
     if (node == nullptr) {
         return;
     }
@@ -679,15 +1868,55 @@ void printAST(ASTNodeBase* node, int indent) {
     std::string cornerLine = u8"\u2514\u2500";     // └─
     std::string branchLine = u8"\u2502 ";          // │
 
-    std::cout << indentation;
+    stream << indentation;
 
     // Print the node type
-    std::cout << std::string(typeid(node).name()) << "\n";
+    stream << std::string(typeid(node).name()) << "\n";
 }
 
-void flushPrint() {
-    if (!verboseMode) {
-        // Flush the output
-        std::cout << "\033[1A\033[2K" << std::flush;
+void printStructLayouts(const ASTTree* tree, std::ostream& stream) {
+    auto printRow = [&stream](std::size_t offset, const std::string& what, std::size_t size) {
+        std::string offsetText = std::to_string(offset);
+        stream << "  " << std::string(offsetText.size() < 6 ? 6 - offsetText.size() : 0, ' ') << offsetText << "  " << what
+               << std::string(what.size() < 24 ? 24 - what.size() : 1, ' ') << size << (size == 1 ? " byte" : " bytes")
+               << "\n";
+    };
+
+    for (const StructLayout* layout : tree->structs) {
+        std::string attributes;
+        if (layout->packed) {
+            attributes += "@packed ";
+        }
+        if (layout->requestedAlignment > 0) {
+            attributes += "@align(" + std::to_string(layout->requestedAlignment) + ") ";
+        }
+        if (layout->reordered) {
+            attributes += "@reorder ";
+        }
+
+        std::size_t fieldBytes = 0;
+        for (const StructField& field : layout->fields) {
+            fieldBytes += field.size;
+        }
+
+        stream << attributes << "struct " << layout->name << ": " << layout->size << " bytes, aligned to "
+               << layout->alignment << ", " << layout->size - fieldBytes << " bytes of padding";
+        if (layout->reordered && layout->sourceOrderSize != layout->size) {
+            stream << ", " << layout->sourceOrderSize << " bytes in source order";
+        }
+        stream << "\n";
+
+        // Offset, field and size, with the gaps between the fields and at the end as padding rows
+        std::size_t offset = 0;
+        for (const StructField& field : layout->fields) {
+            if (field.offset > offset) {
+                printRow(offset, "(padding)", field.offset - offset);
+            }
+            printRow(field.offset, (field.type == TokenType::INT ? "int " : "string ") + field.name, field.size);
+            offset = field.offset + field.size;
+        }
+        if (layout->size > offset) {
+            printRow(offset, "(padding)", layout->size - offset);
+        }
     }
 }
@@ -1,19 +1,56 @@
+
 #ifndef ASTGEN_HPP
 #define ASTGEN_HPP
 
+#include <functional>
+#include <memory>
+
 #include "../lexer/lexer.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+#include "value.hpp"
 
-// Base class for variables
-struct VariableBase {
+// One field of a struct, where its struct's layout put it
+struct StructField {
     std::string name;
-    TokenType type;
-    bool used;
-    virtual ~VariableBase() = default;
+    TokenType type; // INT or STRING
+    std::size_t size = 0;
+    std::size_t offset = 0;
+    std::size_t alignment = 1; // What loads and stores of the field can count on
 };
 
-template <typename T>
-struct Variable : public VariableBase {
-    T value;
+// struct Name { int a; string b; }, optionally with @packed, @align(N) and @reorder in front.
+// The parser works out the layout, codegen and --print-layouts both take it exactly as it is.
+struct StructLayout {
+    std::string name;
+    std::vector<StructField> fields; // In memory order, which @reorder can make differ from the source
+    bool packed = false; // @packed, no padding at all and byte alignment
+    bool reordered = false; // @reorder, fields sorted by alignment so padding is as small as it gets
+    std::size_t requestedAlignment = 0; // @align(N), 0 without it
+    std::size_t size = 0; // Includes the padding at the end
+    std::size_t alignment = 1;
+    std::size_t sourceOrderSize = 0; // What the size would have been without @reorder
+    std::size_t line = 0;
+
+    const StructField* findField(const std::string& fieldName) const {
+        for (const StructField& field : fields) {
+            if (field.name == fieldName) {
+                return &field;
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct Variable {
+    std::string name;
+    TokenType type;
+    std::size_t arrayLength = 0; // N for int[N], 0 for everything that isn't an array
+    const StructLayout* structType = nullptr; // Set for structs, type is STRUCT then
+    bool used = false;
+    bool constant = false; // @comptime, the parser replaces every use with the value
+    ConstValue value; // Only for constants
+    std::vector<int> values; // Only for constant arrays
 };
 
 struct ASTNodeBase {
@@ -21,44 +58,331 @@ struct ASTNodeBase {
 };
 
 struct ParameterNode : public ASTNodeBase {
-    std::vector<VariableBase*> parameters;
+    std::vector<Variable*> parameters;
     TokenType returnType; // This is the return type declared in the parameter list.
+
+    ~ParameterNode() override {
+        for (Variable* parameter : parameters) {
+            delete parameter;
+        }
+    }
+};
+
+// Expressions are evaluated at runtime, the parser only folds the parts that are constant
+struct ExpressionNode : public ASTNodeBase {
+    TokenType type; // The type of the value, INT or STRING
+    std::size_t line = 0;
+};
+
+// A literal, or an expression the parser could fold into one
+struct LiteralNode : public ExpressionNode {
+    ConstValue value;
+};
+
+struct VariableReferenceNode : public ExpressionNode {
+    std::string name;
+    std::size_t arrayLength = 0; // Set when a whole array is passed to a function
+    const StructLayout* structType = nullptr; // Set when a whole struct is passed to a function
+};
+
+// variable.field
+struct FieldNode : public ExpressionNode {
+    std::string name;
+    const StructLayout* structType = nullptr;
+    const StructField* field = nullptr;
+};
+
+// array[index]
+struct IndexNode : public ExpressionNode {
+    std::string name;
+    std::size_t arrayLength = 0;
+    ExpressionNode* index = nullptr;
+
+    ~IndexNode() override {
+        delete index;
+    }
+};
+
+struct BinaryExpressionNode : public ExpressionNode {
+    TokenType operatorType; // An arithmetic operator or a comparison, comparisons give 0 or 1
+    ExpressionNode* left = nullptr;
+    ExpressionNode* right = nullptr;
+
+    ~BinaryExpressionNode() override {
+        delete left;
+        delete right;
+    }
+};
+
+// A call, either used as a statement or as part of an expression
+struct CallNode : public ExpressionNode {
+    std::string name;
+    std::vector<ExpressionNode*> arguments;
+
+    ~CallNode() override {
+        for (ExpressionNode* argument : arguments) {
+            delete argument;
+        }
+    }
+};
+
+// int x = value; or int[N] x; or Name x;
+struct VariableDeclarationNode : public ASTNodeBase {
+    std::string name;
+    TokenType type;
+    std::size_t arrayLength = 0; // Arrays have no value, they start out zeroed
+    const StructLayout* structType = nullptr; // Neither do structs, their strings start out empty
+    ExpressionNode* value = nullptr;
+    bool constant = false; // A @comptime array, it never changes and starts out as values
+    std::vector<int> values;
+    std::size_t line = 0;
+    int sourceIndex = 0; // The file a top level variable came from, see ASTTree::sourceCount
+
+    ~VariableDeclarationNode() override {
+        delete value;
+    }
+};
+
+// x = value; or x[index] = value; or x.field = value;
+struct AssignmentNode : public ASTNodeBase {
+    std::string name;
+    ExpressionNode* index = nullptr; // Only for array elements
+    std::size_t arrayLength = 0;
+    const StructLayout* structType = nullptr; // Only for struct fields
+    const StructField* field = nullptr;
+    ExpressionNode* value = nullptr;
+    std::size_t line = 0;
+
+    ~AssignmentNode() override {
+        delete index;
+        delete value;
+    }
+};
+
+// while (condition) { body }
+struct WhileNode : public ASTNodeBase {
+    ExpressionNode* condition = nullptr;
+    std::vector<ASTNodeBase*> body;
+
+    ~WhileNode() override {
+        delete condition;
+        for (ASTNodeBase* statement : body) {
+            delete statement;
+        }
+    }
 };
 
-// A wrapper for a variable node
-struct VariableNode : public ASTNodeBase {
-    VariableBase variable;
+// for (initializer; condition; step) { body }
+struct ForNode : public ASTNodeBase {
+    ASTNodeBase* initializer = nullptr; // A VariableDeclarationNode or an AssignmentNode
+    ExpressionNode* condition = nullptr;
+    AssignmentNode* step = nullptr;
+    std::vector<ASTNodeBase*> body;
+
+    ~ForNode() override {
+        delete initializer;
+        delete condition;
+        delete step;
+        for (ASTNodeBase* statement : body) {
+            delete statement;
+        }
+    }
 };
 
 struct FunctionBodyNode : public ASTNodeBase {
     std::vector<ASTNodeBase*> statements;
+
+    ~FunctionBodyNode() override {
+        for (ASTNodeBase* statement : statements) {
+            delete statement;
+        }
+    }
 };
 
 struct PrintNode : public ASTNodeBase {
-    VariableBase* expression;
-    TokenType type; // Used for dynamically casting it later on. There probably is a better solution.
+    ExpressionNode* expression = nullptr;
+    TokenType type; // The type of the printed value
+
+    ~PrintNode() override {
+        delete expression;
+    }
 };
 
 struct FunctionNode : public ASTNodeBase {
     std::string name;
-    VariableBase* returnVariable; // This is the return type at the bottom of the function.
+    ExpressionNode* returnValue = nullptr; // This is the return statement at the bottom of the function.
     ParameterNode parameters;
-    FunctionBodyNode* body;
+    FunctionBodyNode* body = nullptr; // Stays null until something reachable calls the function
+    bool exported = false; // Declared with @export
+    bool comptime = false; // Declared with @comptime, it only ever runs in the compiler and isn't generated
+    std::vector<std::string> callees; // What the body calls, once it is parsed
+    int sourceIndex = 0; // The file the function came from, see ASTTree::sourceCount
+
+    // The body's tokens, from the left brace up to and including the right brace
+    const std::vector<Token>* bodyTokens = nullptr;
+    int bodyStart = 0;
+    int bodyEnd = 0;
+
+    ~FunctionNode() override {
+        delete returnValue;
+        delete body;
+    }
+
+    // --low-memory, once nothing needs the body for code generation anymore
+    void releaseBody() {
+        delete returnValue;
+        delete body;
+        returnValue = nullptr;
+        body = nullptr;
+    }
 };
 
 struct ASTTree {
     std::vector<ASTNodeBase*> statements;
+
+    // Every struct declared, in the order they were. Nodes point into them, so they live as long as the tree.
+    std::vector<StructLayout*> structs;
+
+    // The text of every string literal. Members are destroyed after the statements, so no literal outlives its text.
+    StringPool strings;
+
+    // Number of files that went into the tree. The main file is 0, imports count up in the order they are seen.
+    int sourceCount = 0;
+
+    ~ASTTree() {
+        for (ASTNodeBase* statement : statements) {
+            delete statement;
+        }
+        for (StructLayout* structType : structs) {
+            delete structType;
+        }
+    }
 };
 
-ASTTree* performParserAnalysis(const std::vector<Token>& tokens);
+// Returns the tokens of an imported file, or nullptr if it was already imported.
+// The tokens have to outlive the AST since function bodies are parsed from them lazily.
+using ImportLoader = std::function<const std::vector<Token>*(const std::string& path, std::size_t line)>;
 
-ASTNodeBase* parseStatement(const std::vector<Token>& tokens, int& current);
-ASTNodeBase* calculateExpression(const std::vector<Token>& tokens, int& current);
-ASTNodeBase* parseFunction(const std::vector<Token>& tokens, int& current);
-ParameterNode* parseParameters(const std::vector<Token>& tokens, int& current);
+// Constant folding, shared with the @comptime interpreter. Returns false when the result isn't defined.
+bool performOperation(TokenType operatorType, int left, int right, int& result);
+LiteralNode* createLiteral(ConstValue value, std::size_t line);
+LiteralNode* createIntLiteral(int value, std::size_t line);
+LiteralNode* createStringLiteral(StringPool& pool, const std::string& value, std::size_t line);
 
-void printAST(ASTNodeBase* node, int indent);
-void flushPrint();
+// Told about the tree while it's still being parsed, so --pipeline can generate a function's code while
+// the next one is parsed. Everything is called on the parser's thread.
+class ParserListener {
+public:
+    virtual ~ParserListener() = default;
 
-#endif // ASTGEN_HPP
+    // Every top level declaration is parsed. The bodies come after this, apart from those @comptime needed.
+    virtual void declarationsParsed(ASTTree* tree) = 0;
+
+    // The body of function is parsed and function stays in the tree. @comptime functions never come here.
+    virtual void functionParsed(FunctionNode* function) = 0;
+
+    // The parser is done. When it failed the tree is deleted right after this returns.
+    virtual void parsingDone(bool success) = 0;
+};
+
+class Interpreter;
+
+// Holds everything that used to live in the parser's global lists, one instance per compilation
+class Parser {
+public:
+    Parser(const CompilerOptions& options, Diagnostics& diagnostics, ImportLoader importLoader = nullptr,
+           ParserListener* listener = nullptr);
+
+    // Parses the top level declarations, then the bodies of the functions reachable from main
+    ASTTree* parse(const std::vector<Token>& tokens);
+
+    ASTNodeBase* parseStatement(const std::vector<Token>& tokens, int& current);
+    FunctionNode* parseFunction(const std::vector<Token>& tokens, int& current);
+    ParameterNode* parseParameters(const std::vector<Token>& tokens, int& current);
+
+private:
+    void parseDeclarations(const std::vector<Token>& tokens);
+    void parseReachableFunctions();
+    FunctionNode* findFunction(const std::string& name);
 
+    // Parses the body of function if that didn't happen yet, in a scope of its own
+    FunctionNode* parseBody(FunctionNode* function, std::size_t line);
+
+    // @comptime, the interpreter runs while parsing and its results replace the code
+    Interpreter createInterpreter();
+    LiteralNode* evaluateAtCompileTime(ExpressionNode* expression);
+    VariableDeclarationNode* parseConstant(const std::vector<Token>& tokens, int& current);
+    bool isComptimeCall(CallNode* call);
+
+    // Expressions
+    ExpressionNode* parseExpression(const std::vector<Token>& tokens, int& current);
+    ExpressionNode* parseBinaryExpression(const std::vector<Token>& tokens, int& current, int precedence, ExpressionNode* left);
+    ExpressionNode* parsePrimary(const std::vector<Token>& tokens, int& current);
+    ExpressionNode* createBinaryExpression(TokenType operatorType, ExpressionNode* left, ExpressionNode* right, std::size_t line);
+    CallNode* parseCall(const std::vector<Token>& tokens, int& current);
+    VariableReferenceNode* parseReferenceArgument(const std::vector<Token>& tokens, int& current, CallNode* call, Variable* parameter);
+
+    // Structs, current is on the first attribute or the STRUCT token, their variables on the struct's name
+    void parseStruct(const std::vector<Token>& tokens, int& current);
+    const StructLayout* findStruct(const std::string& name);
+    VariableDeclarationNode* parseStructVariable(const std::vector<Token>& tokens, int& current);
+    const StructField* parseField(const std::vector<Token>& tokens, int& current, Variable* variable);
+
+    // structType is only passed where struct types are allowed, which are parameters
+    void parseType(const std::vector<Token>& tokens, int& current, TokenType& type, std::size_t& arrayLength,
+                   const StructLayout** structType = nullptr);
+    VariableDeclarationNode* parseEquation(const std::vector<Token>& tokens, int& current, TokenType type, std::size_t arrayLength);
+    AssignmentNode* updateVariable(const std::vector<Token>& tokens, int& current);
+    AssignmentNode* parseAssignment(const std::vector<Token>& tokens, int& current);
+    IndexNode* parseIndex(const std::vector<Token>& tokens, int& current, Variable* array);
+
+    // Loops, their bodies get a scope of their own
+    WhileNode* parseWhile(const std::vector<Token>& tokens, int& current);
+    ForNode* parseFor(const std::vector<Token>& tokens, int& current);
+    ExpressionNode* parseCondition(const std::vector<Token>& tokens, int& current);
+    void parseBlock(const std::vector<Token>& tokens, int& current, std::vector<ASTNodeBase*>& statements);
+    ExpressionNode* parseReturn(const std::vector<Token>& tokens, int& current);
+    FunctionBodyNode* parseFunctionBody(const std::vector<Token>& tokens, int& current, FunctionNode* functionNode);
+
+    // Scopes, the first one holds the top level variables
+    void pushScope();
+    void popScope();
+    Variable* declareVariable(const std::string& name, TokenType type, std::size_t line, std::size_t arrayLength = 0);
+    Variable* addVariable(std::unique_ptr<Variable> variable, std::size_t line);
+    Variable* findVariable(const std::string& name);
+
+    void expect(const std::vector<Token>& tokens, int& current, TokenType type, const std::string& what);
+
+    const CompilerOptions& options;
+    Diagnostics& diagnostics;
+    ImportLoader importLoader;
+    ParserListener* listener;
+
+    // The tree being built, imported files add their declarations to it
+    ASTTree* tree = nullptr;
+
+    // Functions called by the body that is currently being parsed
+    std::vector<std::string> calledFunctions;
+
+    // Set while the body of a @comptime function is parsed, calls in there run when the function does
+    bool parsingComptimeFunction = false;
+
+    // Bodies being parsed right now, one can't run at compile time before it is done
+    std::vector<FunctionNode*> parsingBodies;
+
+    // Variables declared so far, one list per scope
+    std::vector<std::vector<std::unique_ptr<Variable>>> scopes;
+
+    // Functions declared so far
+    std::vector<FunctionNode*> functions;
+};
+
+ASTTree* performParserAnalysis(const std::vector<Token>& tokens, const CompilerOptions& options, Diagnostics& diagnostics,
+                               ImportLoader importLoader = nullptr, ParserListener* listener = nullptr);
+
+void printAST(ASTNodeBase* node, int indent, std::ostream& stream);
+
+// --print-layouts, the size, alignment and offsets of every struct with the padding between them
+void printStructLayouts(const ASTTree* tree, std::ostream& stream);
+
+#endif // ASTGEN_HPP
@@ -0,0 +1,22 @@
+#include "value.hpp"
+
+ConstValue ConstValue::fromInt(int value) {
+    ConstValue constant;
+    constant.type = TokenType::INT;
+    constant.integer = value;
+    return constant;
+}
+
+ConstValue ConstValue::fromFloat(double value) {
+    ConstValue constant;
+    constant.type = TokenType::FLOAT;
+    constant.floating = value;
+    return constant;
+}
+
+ConstValue ConstValue::fromString(StringPool& pool, const std::string& value) {
+    ConstValue constant;
+    constant.type = TokenType::STRING;
+    constant.string = &pool.intern(value);
+    return constant;
+}
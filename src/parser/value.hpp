@@ -0,0 +1,51 @@
+#ifndef VALUE_HPP
+#define VALUE_HPP
+
+#include <string>
+#include <unordered_set>
+
+#include "../lexer/token.hpp"
+
+// The one copy of every constant string, owned by the tree whose literals point into it, so the strings
+// go with the session. Only the parser's thread adds to it. A string never moves once it's in, so other
+// threads can read the ones they were handed while more are added.
+class StringPool {
+public:
+    const std::string& intern(const std::string& text) {
+        // Elements of an unordered_set never move, rehashing only moves the buckets
+        return *strings.insert(text).first;
+    }
+
+private:
+    std::unordered_set<std::string> strings;
+};
+
+// A value the parser knows at compile time. Ints and floats live right in it, strings are interned
+// so a copy is a pointer copy. The type tells which one it is, nothing has to be cast.
+class ConstValue {
+public:
+    ConstValue() : type(TokenType::INT), integer(0) {}
+
+    static ConstValue fromInt(int value);
+    static ConstValue fromFloat(double value);
+    static ConstValue fromString(StringPool& pool, const std::string& value);
+
+    TokenType getType() const { return type; }
+    bool isInt() const { return type == TokenType::INT; }
+    bool isFloat() const { return type == TokenType::FLOAT; }
+    bool isString() const { return type == TokenType::STRING; }
+
+    int getInt() const { return integer; }
+    double getFloat() const { return floating; }
+    const std::string& getString() const { return *string; }
+
+private:
+    TokenType type;
+    union {
+        int integer;
+        double floating;
+        const std::string* string;
+    };
+};
+
+#endif  // VALUE_HPP
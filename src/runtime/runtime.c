@@ -0,0 +1,557 @@
+#include "runtime.h"
+
+#ifdef STARSHIP_FREESTANDING
+
+// No libc: system calls are made directly and the program starts at our own _start
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#define SYS_WRITE 1
+#define SYS_IOCTL 16
+#define SYS_EXIT_GROUP 231
+#elif defined(__aarch64__)
+#define SYS_WRITE 64
+#define SYS_IOCTL 29
+#define SYS_EXIT_GROUP 94
+#else
+#error "--freestanding only knows the system calls of x86_64 and aarch64 Linux"
+#endif
+
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#define TCGETS 0x5401
+
+static long systemCall3(long number, long a, long b, long c) {
+    long result;
+#if defined(__x86_64__)
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+#else
+    register long x8 __asm__("x8") = number;
+    register long x0 __asm__("x0") = a;
+    register long x1 __asm__("x1") = b;
+    register long x2 __asm__("x2") = c;
+    __asm__ volatile("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2) : "memory");
+    result = x0;
+#endif
+    return result;
+}
+
+__attribute__((noreturn))
+static void exitProgram(int status) {
+    for (;;) {
+        systemCall3(SYS_EXIT_GROUP, status, 0, 0);
+    }
+}
+
+static int isTerminal(int fd) {
+    // struct termios is 60 bytes, TCGETS only succeeds on a terminal
+    char termios[64];
+    return systemCall3(SYS_IOCTL, fd, TCGETS, (long)termios) == 0;
+}
+
+// Generated code and the compiler may call these even without libc
+void* memcpy(void* destination, const void* source, size_t length) {
+    char* to = destination;
+    const char* from = source;
+    while (length--) {
+        *to++ = *from++;
+    }
+    return destination;
+}
+
+void* memmove(void* destination, const void* source, size_t length) {
+    char* to = destination;
+    const char* from = source;
+    if (to < from) {
+        while (length--) {
+            *to++ = *from++;
+        }
+    } else {
+        while (length--) {
+            to[length] = from[length];
+        }
+    }
+    return destination;
+}
+
+void* memset(void* destination, int value, size_t length) {
+    char* to = destination;
+    while (length--) {
+        *to++ = (char)value;
+    }
+    return destination;
+}
+
+int memcmp(const void* left, const void* right, size_t length) {
+    const unsigned char* a = left;
+    const unsigned char* b = right;
+    for (; length; --length, ++a, ++b) {
+        if (*a != *b) {
+            return *a - *b;
+        }
+    }
+    return 0;
+}
+
+static uint64_t stringLength(const char* data) {
+    const char* end = data;
+    while (*end) {
+        ++end;
+    }
+    return (uint64_t)(end - data);
+}
+
+static int containsNewline(const char* data, uint64_t length) {
+    for (uint64_t i = 0; i < length; ++i) {
+        if (data[i] == '\n') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Output goes through here, a strong definition linked into the program replaces the system call,
+// a serial port or a kernel console can be plugged in that way
+__attribute__((weak))
+int64_t starship_write(int32_t fd, const char* data, uint64_t length) {
+    return systemCall3(SYS_WRITE, fd, (long)data, (long)length);
+}
+
+int main(int argc);
+static void starship_initialize(void);
+
+// The kernel leaves argc on top of the stack, the stack has to be 16 byte aligned for the call
+#if defined(__x86_64__)
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "    xor %rbp, %rbp\n"
+        "    mov (%rsp), %rdi\n"
+        "    and $-16, %rsp\n"
+        "    call starship_start\n"
+        "    hlt\n");
+#else
+__asm__(".text\n"
+        ".global _start\n"
+        "_start:\n"
+        "    mov x29, #0\n"
+        "    mov x30, #0\n"
+        "    ldr x0, [sp]\n"
+        "    bl starship_start\n");
+#endif
+
+__attribute__((noreturn, used))
+void starship_start(long argc) {
+    // Nothing runs constructors without libc
+    starship_initialize();
+    int status = main((int)argc);
+    starship_flush();
+    exitProgram(status);
+}
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define exitProgram exit
+#define isTerminal isatty
+#define stringLength strlen
+#define containsNewline(data, length) (memchr(data, '\n', length) != NULL)
+
+int64_t starship_write(int32_t fd, const char* data, uint64_t length) {
+    return write(fd, data, length);
+}
+
+#endif
+
+#define STARSHIP_BUFFER_SIZE 65536
+
+static char outputBuffer[STARSHIP_BUFFER_SIZE];
+static uint64_t outputLength = 0;
+
+// A terminal should see every line as it's printed, pipes and files only get full buffers
+static int lineBuffered = 0;
+
+// Two digits per table lookup halves the number of divisions
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void writeAll(int fd, const char* data, uint64_t length) {
+    while (length > 0) {
+        int64_t written = starship_write(fd, data, length);
+        if (written <= 0) {
+            // Nothing sensible to do about a closed stdout, drop the output
+            return;
+        }
+        data += written;
+        length -= (uint64_t)written;
+    }
+}
+
+void starship_flush(void) {
+    writeAll(STDOUT_FILENO, outputBuffer, outputLength);
+    outputLength = 0;
+}
+
+static void appendOutput(const char* data, uint64_t length) {
+    if (outputLength + length > STARSHIP_BUFFER_SIZE) {
+        starship_flush();
+
+        // Too big to ever fit, skip the copy
+        if (length > STARSHIP_BUFFER_SIZE) {
+            writeAll(STDOUT_FILENO, data, length);
+            return;
+        }
+    }
+
+    memcpy(outputBuffer + outputLength, data, length);
+    outputLength += length;
+
+    if (lineBuffered && containsNewline(data, length)) {
+        starship_flush();
+    }
+}
+
+// Writes the digits so they end right before end, returns where they start.
+// 20 digits and a sign is enough for any int64.
+static char* formatInteger(int64_t value, char* end) {
+    char* start = end;
+
+    // Work on the magnitude as unsigned so INT64_MIN doesn't overflow
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    while (magnitude >= 100) {
+        uint64_t pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        start -= 2;
+        start[0] = digitPairs[pair];
+        start[1] = digitPairs[pair + 1];
+    }
+
+    if (magnitude >= 10) {
+        start -= 2;
+        start[0] = digitPairs[magnitude * 2];
+        start[1] = digitPairs[magnitude * 2 + 1];
+    } else {
+        *--start = (char)('0' + magnitude);
+    }
+
+    if (value < 0) {
+        *--start = '-';
+    }
+
+    return start;
+}
+
+void starship_print_i64(int64_t value) {
+    char digits[21];
+    char* end = digits + sizeof(digits);
+    char* start = formatInteger(value, end);
+    appendOutput(start, (uint64_t)(end - start));
+}
+
+void starship_print_str(const char* data, uint64_t length) {
+    appendOutput(data, length);
+}
+
+void starship_print_cstr(const char* data) {
+    appendOutput(data, stringLength(data));
+}
+
+// Writes parts[0], values[0], parts[1], ... to stderr and exits with status 1. There is one value
+// fewer than there are parts.
+__attribute__((noreturn))
+static void fail(const char* const* parts, const int64_t* values, int partCount) {
+    // Whatever was printed before the error comes first
+    starship_flush();
+
+    // Formatted by hand, there is no printf without libc
+    char message[160];
+    uint64_t messageLength = 0;
+    for (int i = 0; i < partCount; ++i) {
+        for (const char* c = parts[i]; *c; ++c) {
+            message[messageLength++] = *c;
+        }
+
+        if (i < partCount - 1) {
+            char digits[21];
+            char* end = digits + sizeof(digits);
+            for (char* digit = formatInteger(values[i], end); digit < end; ++digit) {
+                message[messageLength++] = *digit;
+            }
+        }
+    }
+
+    writeAll(STDERR_FILENO, message, messageLength);
+    exitProgram(1);
+}
+
+void starship_bounds_fail(int64_t index, int64_t length, int32_t line) {
+    const char* parts[] = {"Index ", " is out of bounds for an array of length ", " (line ", ")\n"};
+    int64_t values[] = {index, length, line};
+    fail(parts, values, 4);
+}
+
+// The same messages as starship interp
+void starship_division_fail(int32_t divisor, int32_t line) {
+    const char* parts[] = {divisor == 0 ? "Division by zero (line " : "Integer overflow in division (line ", ")\n"};
+    int64_t values[] = {line};
+    fail(parts, values, 2);
+}
+
+#ifndef STARSHIP_FREESTANDING
+
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STARSHIP_PROFILE_UNIT "TSC cycles"
+#else
+#define STARSHIP_PROFILE_UNIT "nanoseconds"
+#endif
+
+static uint64_t readTimer(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// One node per distinct call stack, a calling context tree. Its time includes the callees,
+// what's left after subtracting the children is the function's own.
+typedef struct ProfileNode {
+    StarshipProfileRecord* record;
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint64_t calls;
+    uint64_t cycles;
+    uint64_t start;
+} ProfileNode;
+
+// Node 0 is the root above main, nothing links to it as a sibling so 0 also means none
+static ProfileNode* profileNodes = NULL;
+static uint32_t profileNodeCount = 0;
+static uint32_t profileNodeCapacity = 0;
+static uint32_t currentProfileNode = 0;
+
+// Set when the tree can't grow, the profile stops there instead of the program
+static int profileFailed = 0;
+
+static void writeProfile(void);
+
+// Returns 0 and gives up on the profile when there's no memory left
+static uint32_t allocateProfileNode(void) {
+    if (profileNodeCount == profileNodeCapacity) {
+        uint32_t capacity = profileNodeCapacity ? profileNodeCapacity * 2 : 1024;
+        ProfileNode* nodes = realloc(profileNodes, capacity * sizeof(ProfileNode));
+        if (!nodes || capacity < profileNodeCapacity) {
+            profileFailed = 1;
+            return 0;
+        }
+        profileNodes = nodes;
+        profileNodeCapacity = capacity;
+    }
+
+    memset(&profileNodes[profileNodeCount], 0, sizeof(ProfileNode));
+    return profileNodeCount++;
+}
+
+static uint32_t findProfileChild(uint32_t parent, StarshipProfileRecord* record) {
+    for (uint32_t child = profileNodes[parent].firstChild; child != 0; child = profileNodes[child].nextSibling) {
+        if (profileNodes[child].record == record) {
+            return child;
+        }
+    }
+
+    uint32_t child = allocateProfileNode();
+    if (child == 0) {
+        return 0;
+    }
+
+    profileNodes[child].record = record;
+    profileNodes[child].parent = parent;
+    profileNodes[child].nextSibling = profileNodes[parent].firstChild;
+    profileNodes[parent].firstChild = child;
+    return child;
+}
+
+void starship_profile_enter(StarshipProfileRecord* record) {
+    ++record->calls;
+
+    if (profileNodeCount == 0 && !profileFailed) {
+        // The root. Registered after the runtime's flush, so the profile is written first.
+        allocateProfileNode();
+        atexit(writeProfile);
+    }
+
+    uint32_t node = profileFailed ? 0 : findProfileChild(currentProfileNode, record);
+    if (node == 0) {
+        return;
+    }
+
+    currentProfileNode = node;
+    ++profileNodes[node].calls;
+    profileNodes[node].start = readTimer();
+}
+
+void starship_profile_exit(StarshipProfileRecord* record) {
+    uint64_t now = readTimer();
+
+    // Exits can only pair up with the entry of the same function, anything else means the tree gave up
+    if (profileFailed || currentProfileNode == 0 || profileNodes[currentProfileNode].record != record) {
+        return;
+    }
+
+    ProfileNode* node = &profileNodes[currentProfileNode];
+
+    node->cycles += now - node->start;
+    currentProfileNode = node->parent;
+}
+
+static uint64_t childCycles(uint32_t index) {
+    uint64_t cycles = 0;
+    for (uint32_t child = profileNodes[index].firstChild; child != 0; child = profileNodes[child].nextSibling) {
+        cycles += profileNodes[child].cycles;
+    }
+    return cycles;
+}
+
+// A recursive call is already part of the outer call's time
+static int isRecursive(uint32_t index) {
+    for (uint32_t parent = profileNodes[index].parent; parent != 0; parent = profileNodes[parent].parent) {
+        if (profileNodes[parent].record == profileNodes[index].record) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void writeStack(FILE* file, uint32_t index) {
+    if (profileNodes[index].parent != 0) {
+        writeStack(file, profileNodes[index].parent);
+        fputc(';', file);
+    }
+    fputs(profileNodes[index].record->name, file);
+}
+
+typedef struct FlatEntry {
+    StarshipProfileRecord* record;
+    uint64_t self;
+    uint64_t total;
+} FlatEntry;
+
+static int compareFlatEntries(const void* left, const void* right) {
+    const FlatEntry* a = left;
+    const FlatEntry* b = right;
+    return a->self < b->self ? 1 : a->self > b->self ? -1 : 0;
+}
+
+static void writeFlatProfile(FILE* file) {
+    FlatEntry* entries = calloc(profileNodeCount, sizeof(FlatEntry));
+    if (!entries) {
+        return;
+    }
+
+    // Nodes of the same function add up, the list is short enough to search
+    uint32_t entryCount = 0;
+    for (uint32_t index = 1; index < profileNodeCount; ++index) {
+        uint32_t entry = 0;
+        while (entry < entryCount && entries[entry].record != profileNodes[index].record) {
+            ++entry;
+        }
+        if (entry == entryCount) {
+            entries[entryCount++].record = profileNodes[index].record;
+        }
+
+        entries[entry].self += profileNodes[index].cycles - childCycles(index);
+        if (!isRecursive(index)) {
+            entries[entry].total += profileNodes[index].cycles;
+        }
+    }
+
+    qsort(entries, entryCount, sizeof(FlatEntry), compareFlatEntries);
+
+    uint64_t programCycles = childCycles(0);
+    fprintf(file, "# Flat profile, times in " STARSHIP_PROFILE_UNIT "\n");
+    fprintf(file, "%7s %14s %20s %20s  %s\n", "self %", "calls", "self", "total", "function");
+    for (uint32_t entry = 0; entry < entryCount; ++entry) {
+        double percent = programCycles ? 100.0 * (double)entries[entry].self / (double)programCycles : 0.0;
+        fprintf(file, "%7.2f %14llu %20llu %20llu  %s\n", percent, (unsigned long long)entries[entry].record->calls,
+                (unsigned long long)entries[entry].self, (unsigned long long)entries[entry].total,
+                entries[entry].record->name);
+    }
+
+    free(entries);
+}
+
+static void writeCollapsedStacks(FILE* file) {
+    for (uint32_t index = 1; index < profileNodeCount; ++index) {
+        writeStack(file, index);
+        fprintf(file, " %llu\n", (unsigned long long)(profileNodes[index].cycles - childCycles(index)));
+    }
+}
+
+static void writeProfile(void) {
+    if (profileFailed) {
+        fputs("starship: the function profile ran out of memory, nothing was written\n", stderr);
+        return;
+    }
+
+    const char* filename = getenv("STARSHIP_PROFILE");
+    if (!filename || !*filename) {
+        filename = "starship-profile.txt";
+    }
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "starship: failed to write the function profile to %s\n", filename);
+        return;
+    }
+
+    // Whatever is still running, main after a failed bounds check, ends now
+    uint64_t now = readTimer();
+    for (uint32_t index = currentProfileNode; index != 0; index = profileNodes[index].parent) {
+        profileNodes[index].cycles += now - profileNodes[index].start;
+    }
+    currentProfileNode = 0;
+
+    const char* format = getenv("STARSHIP_PROFILE_FORMAT");
+    if (format && strcmp(format, "collapsed") == 0) {
+        writeCollapsedStacks(file);
+    } else {
+        writeFlatProfile(file);
+    }
+
+    fclose(file);
+}
+
+#endif
+
+#ifdef STARSHIP_FREESTANDING
+static void starship_initialize(void) {
+    // starship_start flushes by itself after main
+    lineBuffered = isTerminal(STDOUT_FILENO);
+}
+#else
+__attribute__((constructor))
+static void starship_initialize(void) {
+    lineBuffered = isTerminal(STDOUT_FILENO);
+    atexit(starship_flush);
+}
+#endif
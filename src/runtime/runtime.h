@@ -0,0 +1,45 @@
+#ifndef STARSHIP_RUNTIME_H
+#define STARSHIP_RUNTIME_H
+
+#include <stdint.h>
+
+// The runtime library every program is linked against. The compiler emits calls to these
+// instead of printf, output is buffered and flushed when the program exits.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void starship_print_i64(int64_t value);
+void starship_print_str(const char* data, uint64_t length);
+void starship_print_cstr(const char* data);
+void starship_flush(void);
+
+// Every byte of output goes through here. With --freestanding it is a weak write system call,
+// a program can define its own to send output somewhere else.
+int64_t starship_write(int32_t fd, const char* data, uint64_t length);
+
+// Called by failed array bounds checks, prints the error and exits with status 1
+void starship_bounds_fail(int64_t index, int64_t length, int32_t line) __attribute__((noreturn, cold));
+
+// Called when an int is divided by zero, or INT_MIN by -1, which would otherwise trap. Prints the
+// error and exits with status 1.
+void starship_division_fail(int32_t divisor, int32_t line) __attribute__((noreturn, cold));
+
+// --instrument=functions, the compiler emits one record per function
+typedef struct StarshipProfileRecord {
+    const char* name;
+    uint64_t calls;
+} StarshipProfileRecord;
+
+// Called first and last thing in every instrumented function. At exit the profile is written to
+// $STARSHIP_PROFILE (starship-profile.txt by default), as a flat profile or, with
+// STARSHIP_PROFILE_FORMAT=collapsed, as collapsed stacks for flamegraph.pl. Needs libc.
+void starship_profile_enter(StarshipProfileRecord* record);
+void starship_profile_exit(StarshipProfileRecord* record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STARSHIP_RUNTIME_H
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "llvm/Target/TargetMachine.h"
+
+#include "build.hpp"
+#include "session.hpp"
+
+// Saves tend to come in bursts (write, rename, touch), a rebuild waits until it's quiet for this long
+static const int debounceMilliseconds = 100;
+
+// One build of main.rk. targetMachine is handed from build to build with --watch, and the
+// directories of every source file are added to sourceDirectories.
+static int buildOnce(const CompilerOptions& options, std::unique_ptr<llvm::TargetMachine>& targetMachine,
+                     std::set<std::string>& sourceDirectories) {
+    // Build tool
+    std::string sourceFilename = "main.rk";
+
+    CompilationSession session(options);
+    session.setTargetMachine(std::move(targetMachine));
+
+    if (!session.loadSourceFile(sourceFilename)) {
+        std::cout << "Error: Build Directory must contain a file named main.rk\n";
+        std::cout << "I am in the directory: " << std::filesystem::current_path() << "\n";
+        return 1;
+    }
+
+    bool success = session.run();
+    session.getDiagnostics().print(std::cerr);
+
+    if (options.lowMemory) {
+        std::cout << "Peak RSS: " << (session.getPeakRSSBytes() >> 20) << " MiB\n";
+    }
+
+    targetMachine = session.takeTargetMachine();
+    for (const std::string& sourceFile : session.getSourceFiles()) {
+        sourceDirectories.insert(std::filesystem::path(sourceFile).parent_path().string());
+    }
+
+    // Also when the build failed, the phases that ran are still worth seeing
+    if (options.stats) {
+        std::cout << "\n";
+        session.getStatistics().print(std::cout);
+
+        if (!options.statsFilename.empty()) {
+            std::ofstream statsFile(options.statsFilename);
+            if (!statsFile) {
+                std::cerr << "Error: Failed to write " << options.statsFilename << "\n";
+                return 1;
+            }
+            session.getStatistics().writeJSON(statsFile);
+        }
+    }
+
+    if (!success) {
+        return 1;
+    }
+
+    if (options.stopAfter == CompilationStage::LINK) {
+        std::cout << "\nSuccessfully built: " << options.outputFilename << "\n";
+    } else {
+        std::cout << "\nStopped after: " << compilationStageToString(options.stopAfter) << "\n";
+    }
+
+    return 0;
+}
+
+// Blocks until a .rk file in one of the directories was written, created, moved in or deleted, then
+// until nothing has happened for debounceMilliseconds. Editors often save through a temporary file and
+// a rename, which is why whole directories are watched. Returns false if inotify failed.
+static bool waitForChanges(int inotify) {
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    bool changed = false;
+    while (true) {
+        pollfd descriptor = {inotify, POLLIN, 0};
+        int ready = poll(&descriptor, 1, changed ? debounceMilliseconds : -1);
+        if (ready < 0) {
+            return false;
+        }
+        if (ready == 0) {
+            return true;
+        }
+
+        ssize_t length = read(inotify, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return false;
+        }
+
+        for (char* position = buffer; position < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(position);
+            std::string name = event->len > 0 ? event->name : "";
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".rk") == 0) {
+                changed = true;
+            }
+            position += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+static int watch(CompilerOptions options) {
+    // Only the functions that changed get compiled again, through the function cache. It needs a
+    // full build without LTO or profiles, anything else rebuilds everything every time. --pipeline
+    // asked for the whole module instead.
+    if (options.functionCacheDirectory.empty() && options.stopAfter == CompilationStage::LINK &&
+        options.lto == LTOMode::NONE && options.profileGenerate.empty() && options.profileUse.empty() &&
+        !options.pipeline) {
+        options.functionCacheDirectory = ".starship-cache";
+    }
+
+    int inotify = inotify_init1(IN_CLOEXEC);
+    if (inotify < 0) {
+        std::cerr << "Error: --watch needs inotify, which failed to start\n";
+        return 1;
+    }
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    std::set<std::string> sourceDirectories = {std::filesystem::current_path().string()};
+    std::set<std::string> watchedDirectories;
+
+    while (true) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        int status = buildOnce(options, targetMachine, sourceDirectories);
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count() / 1e9;
+        if (status == 0) {
+            std::cout << "Building took " << seconds << " seconds\n";
+        }
+
+        // Imports can come and go with every build, directories are only ever added
+        for (const std::string& directory : sourceDirectories) {
+            if (watchedDirectories.count(directory)) {
+                continue;
+            }
+
+            if (inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+                std::cerr << "Error: Failed to watch " << directory << "\n";
+                continue;
+            }
+            watchedDirectories.insert(directory);
+        }
+
+        std::cout << "Watching " << watchedDirectories.size() << " directories for changes, Ctrl-C to stop\n"
+                  << std::flush;
+
+        if (!waitForChanges(inotify)) {
+            std::cerr << "Error: Watching for changes failed\n";
+            close(inotify);
+            return 1;
+        }
+
+        std::cout << "\nChange detected, rebuilding\n";
+    }
+}
+
+extern "C" int starshipBuild(const CompilerOptions* options) {
+    if (options->watch) {
+        return watch(*options);
+    }
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    std::set<std::string> sourceDirectories;
+    return buildOnce(*options, targetMachine, sourceDirectories);
+}
@@ -0,0 +1,15 @@
+#ifndef BUILD_HPP
+#define BUILD_HPP
+
+#include "../util/options.hpp"
+
+// starship build once the flags are parsed: compiles main.rk and reports how it went, returns the
+// exit status. This is the only way the driver reaches LLVM. It lives in a module of its own that
+// the driver loads for builds, so check and interp never load LLVM.
+extern "C" int starshipBuild(const CompilerOptions* options);
+
+// What the driver looks up in the module
+using BuildFunction = int (*)(const CompilerOptions* options);
+static const char* const buildFunctionName = "starshipBuild";
+
+#endif  // BUILD_HPP
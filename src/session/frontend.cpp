@@ -0,0 +1,288 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "frontend.hpp"
+#include "../interp/bytecode.hpp"
+#include "../interp/vm.hpp"
+#include "../lexer/lexer.hpp"
+
+FrontendSession::FrontendSession(CompilerOptions options)
+    : options(std::move(options)), statistics(this->options.stats, this->options.perfCounters, this->options.ownsProcess) {
+    const PerfCounters* perfCounters = statistics.getPerfCounters();
+    if (perfCounters && !perfCounters->getError().empty()) {
+        diagnostics.warning("Not every hardware counter is available (" + perfCounters->getError() +
+                            "), --stats leaves them out");
+    }
+}
+
+bool FrontendSession::loadSourceFile(const std::string& filename) {
+    std::ifstream sourceFile(filename);
+
+    if (!sourceFile) {
+        diagnostics.report(DiagnosticSeverity::ERROR, "Failed to open source file " + filename);
+        return false;
+    }
+
+    sourceFilename = filename;
+    sourceCode.assign((std::istreambuf_iterator<char>(sourceFile)),
+                      std::istreambuf_iterator<char>());
+    return true;
+}
+
+void FrontendSession::setSource(std::string sourceCode) {
+    this->sourceCode = std::move(sourceCode);
+}
+
+bool FrontendSession::check() {
+    try {
+        runLexer();
+        runParser();
+    } catch (const CompilationError&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool FrontendSession::interpret(int argc, int& exitStatus) {
+    try {
+        runLexer();
+        runParser();
+
+        BytecodeProgram program = compileBytecode(ast.get(), options, diagnostics);
+        exitStatus = runBytecode(program, argc, options);
+    } catch (const CompilationError&) {
+        return false;
+    }
+
+    return true;
+}
+
+// What a token list holds on the heap, the vector and every lexeme too long for the string itself
+static std::uint64_t tokenBytes(const std::vector<Token>& tokens) {
+    std::uint64_t bytes = tokens.capacity() * sizeof(Token);
+    for (const Token& token : tokens) {
+        const char* inside = reinterpret_cast<const char*>(&token.lexeme);
+        if (token.lexeme.data() < inside || token.lexeme.data() >= inside + sizeof(std::string)) {
+            bytes += token.lexeme.capacity() + 1;
+        }
+    }
+    return bytes;
+}
+
+// For --stats, every node below node with its own size. Strings and vectors aren't included.
+struct ASTCounts {
+    std::uint64_t nodes = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t functions = 0;
+    std::uint64_t variables = 0;
+};
+
+static void countAST(ASTNodeBase* node, ASTCounts& counts);
+
+static void countAST(const std::vector<ASTNodeBase*>& statements, ASTCounts& counts) {
+    for (ASTNodeBase* statement : statements) {
+        countAST(statement, counts);
+    }
+}
+
+static void countVariable(Variable* variable, ASTCounts& counts) {
+    if (variable) {
+        ++counts.variables;
+        counts.bytes += sizeof(Variable);
+    }
+}
+
+static void countAST(ASTNodeBase* node, ASTCounts& counts) {
+    if (!node) {
+        return;
+    }
+
+    ++counts.nodes;
+
+    if (dynamic_cast<LiteralNode*>(node)) {
+        counts.bytes += sizeof(LiteralNode);
+    } else if (dynamic_cast<VariableReferenceNode*>(node)) {
+        counts.bytes += sizeof(VariableReferenceNode);
+    } else if (dynamic_cast<FieldNode*>(node)) {
+        counts.bytes += sizeof(FieldNode);
+    } else if (auto* index = dynamic_cast<IndexNode*>(node)) {
+        counts.bytes += sizeof(IndexNode);
+        countAST(index->index, counts);
+    } else if (auto* binary = dynamic_cast<BinaryExpressionNode*>(node)) {
+        counts.bytes += sizeof(BinaryExpressionNode);
+        countAST(binary->left, counts);
+        countAST(binary->right, counts);
+    } else if (auto* call = dynamic_cast<CallNode*>(node)) {
+        counts.bytes += sizeof(CallNode);
+        for (ExpressionNode* argument : call->arguments) {
+            countAST(argument, counts);
+        }
+    } else if (auto* declaration = dynamic_cast<VariableDeclarationNode*>(node)) {
+        counts.bytes += sizeof(VariableDeclarationNode);
+        countAST(declaration->value, counts);
+    } else if (auto* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        counts.bytes += sizeof(AssignmentNode);
+        countAST(assignment->index, counts);
+        countAST(assignment->value, counts);
+    } else if (auto* whileNode = dynamic_cast<WhileNode*>(node)) {
+        counts.bytes += sizeof(WhileNode);
+        countAST(whileNode->condition, counts);
+        countAST(whileNode->body, counts);
+    } else if (auto* forNode = dynamic_cast<ForNode*>(node)) {
+        counts.bytes += sizeof(ForNode);
+        countAST(forNode->initializer, counts);
+        countAST(forNode->condition, counts);
+        countAST(forNode->step, counts);
+        countAST(forNode->body, counts);
+    } else if (auto* body = dynamic_cast<FunctionBodyNode*>(node)) {
+        counts.bytes += sizeof(FunctionBodyNode);
+        countAST(body->statements, counts);
+    } else if (auto* print = dynamic_cast<PrintNode*>(node)) {
+        counts.bytes += sizeof(PrintNode);
+        countAST(print->expression, counts);
+    } else if (auto* function = dynamic_cast<FunctionNode*>(node)) {
+        // The parameters are part of the function
+        counts.bytes += sizeof(FunctionNode);
+        ++counts.functions;
+        for (Variable* parameter : function->parameters.parameters) {
+            countVariable(parameter, counts);
+        }
+        countAST(function->returnValue, counts);
+        countAST(function->body, counts);
+    }
+}
+
+void FrontendSession::runLexer() {
+    auto measurement = statistics.measure("lex");
+
+    tokens = performLexicalAnalysis(sourceCode, options, diagnostics);
+
+    if (statistics.isEnabled()) {
+        statistics.count("lex", "tokens", tokens.size());
+        statistics.count("lex", "token bytes", tokenBytes(tokens));
+    }
+
+    if (options.debugMode) {
+        // Print tokens with all information
+        logStream(options) << "Tokens:\n";
+        for (const Token& token : tokens) {
+            logStream(options) << "[" << tokenTypeToString(token.type) << "] " << token.lexeme << "\n";
+        }
+    }
+}
+
+void FrontendSession::runParser(ParserListener* listener) {
+    auto measurement = statistics.measure("parse");
+
+    // Imports are resolved relative to the main file, which counts as imported already
+    if (!sourceFilename.empty()) {
+        importedFiles.push_back(std::filesystem::weakly_canonical(sourceFilename).string());
+    }
+
+    ImportLoader importLoader = [this](const std::string& path, std::size_t line) {
+        return loadImport(path, line);
+    };
+
+    ast.reset(performParserAnalysis(tokens, options, diagnostics, importLoader, listener));
+
+    if (options.printLayouts) {
+        printStructLayouts(ast.get(), std::cout);
+    }
+
+    if (statistics.isEnabled()) {
+        // Imports are lexed while parsing, so their tokens count here
+        for (const std::unique_ptr<std::vector<Token>>& imported : importedTokens) {
+            statistics.count("parse", "imported tokens", imported->size());
+            statistics.count("parse", "imported token bytes", tokenBytes(*imported));
+        }
+
+        ASTCounts counts;
+        countAST(ast->statements, counts);
+        statistics.count("parse", "AST nodes", counts.nodes);
+        statistics.count("parse", "AST bytes", counts.bytes);
+        statistics.count("parse", "functions", counts.functions);
+        statistics.count("parse", "variables", counts.variables);
+    }
+
+    if (options.debugMode) {
+        logStream(options) << "\n";
+        printAST(reinterpret_cast<ASTNodeBase *>(ast.get()), 0, logStream(options));
+    }
+}
+
+void FrontendSession::releaseSource() {
+    for (ASTNodeBase* statement : ast->statements) {
+        if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+            function->bodyTokens = nullptr;
+        }
+    }
+
+    std::string().swap(sourceCode);
+    std::vector<Token>().swap(tokens);
+    importedTokens.clear();
+
+#ifdef __GLIBC__
+    // The tokens were a lot of small blocks, give the pages back instead of keeping them for later
+    malloc_trim(0);
+#endif
+}
+
+const std::vector<Token>* FrontendSession::loadImport(const std::string& path, std::size_t line) {
+    std::filesystem::path importPath = std::filesystem::path(sourceFilename).parent_path() / path;
+    std::string canonicalPath = std::filesystem::weakly_canonical(importPath).string();
+
+    // Every file is only imported once
+    for (const std::string& importedFile : importedFiles) {
+        if (importedFile == canonicalPath) {
+            return nullptr;
+        }
+    }
+
+    std::ifstream importFile(importPath);
+    if (!importFile) {
+        diagnostics.error("Failed to open imported file " + path, line);
+    }
+
+    std::string importSource((std::istreambuf_iterator<char>(importFile)),
+                             std::istreambuf_iterator<char>());
+
+    importedFiles.push_back(canonicalPath);
+    importedTokens.push_back(std::make_unique<std::vector<Token>>(
+        performLexicalAnalysis(importSource, options, diagnostics)));
+
+    return importedTokens.back().get();
+}
+
+const CompilerOptions& FrontendSession::getOptions() const {
+    return options;
+}
+
+const std::string& FrontendSession::getSource() const {
+    return sourceCode;
+}
+
+const std::vector<Token>& FrontendSession::getTokens() const {
+    return tokens;
+}
+
+ASTTree* FrontendSession::getAST() const {
+    return ast.get();
+}
+
+const std::vector<std::string>& FrontendSession::getSourceFiles() const {
+    return importedFiles;
+}
+
+const Diagnostics& FrontendSession::getDiagnostics() const {
+    return diagnostics;
+}
+
+const CompilerStatistics& FrontendSession::getStatistics() const {
+    return statistics;
+}
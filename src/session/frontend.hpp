@@ -0,0 +1,73 @@
+#ifndef FRONTEND_HPP
+#define FRONTEND_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../lexer/token.hpp"
+#include "../parser/parser.hpp"
+#include "../util/options.hpp"
+#include "../util/diagnostics.hpp"
+#include "../util/stats.hpp"
+
+// The part of a compilation that doesn't need LLVM: the source, its tokens and imports, the AST.
+// starship check and interp only ever use this, so they start without loading LLVM at all.
+// CompilationSession adds code generation on top.
+class FrontendSession {
+public:
+    explicit FrontendSession(CompilerOptions options);
+    virtual ~FrontendSession() = default;
+
+    FrontendSession(const FrontendSession&) = delete;
+    FrontendSession& operator=(const FrontendSession&) = delete;
+
+    // Source input
+    bool loadSourceFile(const std::string& filename);
+    void setSource(std::string sourceCode);
+
+    // starship check: lexes and parses, returns false if that found an error
+    bool check();
+
+    // starship interp: lexes and parses, then runs the program as bytecode. LLVM is never set up.
+    // Returns false if the program didn't compile, otherwise exitStatus is what main returned.
+    bool interpret(int argc, int& exitStatus);
+
+    const CompilerOptions& getOptions() const;
+    const std::string& getSource() const;
+    const std::vector<Token>& getTokens() const;
+    ASTTree* getAST() const;
+
+    // The main file and every file it imported so far, canonical paths
+    const std::vector<std::string>& getSourceFiles() const;
+    const Diagnostics& getDiagnostics() const;
+
+    // --stats, empty unless options.stats is set
+    const CompilerStatistics& getStatistics() const;
+
+protected:
+    void runLexer();
+    // listener gets the tree while it is parsed, see ParserListener
+    void runParser(ParserListener* listener = nullptr);
+
+    const std::vector<Token>* loadImport(const std::string& path, std::size_t line);
+
+    // --low-memory, once every body is parsed nothing needs the source or the tokens anymore
+    void releaseSource();
+
+    CompilerOptions options;
+    Diagnostics diagnostics;
+    CompilerStatistics statistics;
+
+    std::string sourceFilename;
+    std::string sourceCode;
+    std::vector<Token> tokens;
+
+    // Imported files, their tokens stay alive because function bodies are parsed from them lazily
+    std::vector<std::string> importedFiles;
+    std::vector<std::unique_ptr<std::vector<Token>>> importedTokens;
+
+    std::unique_ptr<ASTTree> ast;
+};
+
+#endif  // FRONTEND_HPP
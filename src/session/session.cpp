@@ -0,0 +1,648 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "session.hpp"
+#include "../link/cache.hpp"
+#include "../link/codegen.hpp"
+#include "../link/emitter.hpp"
+#include "../link/optimizer.hpp"
+#include "../util/queue.hpp"
+
+// How many parsed functions can wait for IR generation before the parser has to
+static const std::size_t pipelineQueueCapacity = 64;
+
+// --low-memory compiles functions in groups of about this many body tokens. One module per function
+// spends most of its time setting up passes, and the linker then has to take thousands of objects.
+static const int lowMemoryGroupTokens = 20000;
+
+// --pipeline. The declarations are generated on the parser's thread, every function after that on a
+// thread of its own while the parser goes on with the next one. Like the emitter's workers, the IR thread
+// reports into its own diagnostics, they are merged once it's joined.
+class PipelineListener : public ParserListener {
+public:
+    PipelineListener(llvm::Module& module, const CompilerOptions& options)
+        : codeGenerator(module, options, pipelineDiagnostics), queue(pipelineQueueCapacity) {}
+
+    ~PipelineListener() override {
+        join();
+    }
+
+    void declarationsParsed(ASTTree* tree) override {
+        codeGenerator.generateDeclarationsIR(tree);
+        thread = std::thread([this]() { generateFunctions(); });
+    }
+
+    void functionParsed(FunctionNode* function) override {
+        if (!queue.push(function)) {
+            // IR generation failed, there's no point in parsing any further
+            throw CompilationError("IR generation failed");
+        }
+    }
+
+    void parsingDone(bool success) override {
+        // The tree is about to go, the IR thread can't be looking at it anymore
+        if (!success) {
+            join();
+        }
+    }
+
+    // Waits for the functions that are still queued, then generates what needs the whole tree.
+    // Everything the IR thread reported ends up in diagnostics.
+    void finish(ASTTree* tree, Diagnostics& diagnostics) {
+        join();
+
+        try {
+            if (!failed) {
+                codeGenerator.finishStreamedIR(tree);
+            }
+        } catch (const CompilationError&) {
+            // Already recorded in pipelineDiagnostics
+        }
+
+        for (const Diagnostic& diagnostic : pipelineDiagnostics.getDiagnostics()) {
+            diagnostics.report(diagnostic.severity, diagnostic.message, diagnostic.line);
+        }
+        if (pipelineDiagnostics.hasErrors()) {
+            throw CompilationError("IR generation failed");
+        }
+    }
+
+private:
+    void generateFunctions() {
+        FunctionNode* function;
+        try {
+            while (queue.pop(function)) {
+                codeGenerator.generateStreamedFunctionIR(function);
+            }
+        } catch (const CompilationError&) {
+            failed = true;
+            queue.close();
+        }
+    }
+
+    void join() {
+        queue.close();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    Diagnostics pipelineDiagnostics;
+    CodeGenerator codeGenerator;
+    BoundedQueue<FunctionNode*> queue;
+    std::thread thread;
+
+    // Set by the IR thread, only read after it's joined
+    bool failed = false;
+};
+
+CompilationSession::CompilationSession(CompilerOptions options)
+    : FrontendSession(std::move(options)) {}
+
+CompilationSession::~CompilationSession() {
+    // The module has to go before the context that owns its types
+    targetMachine.reset();
+    functionModules.clear();
+    importedModules.clear();
+    module.reset();
+    context.reset();
+}
+
+bool CompilationSession::run() {
+    try {
+        checkOptions();
+        runLexer();
+        checkMemory("after lexing");
+        if (options.stopAfter == CompilationStage::LEX) {
+            return true;
+        }
+
+        if (usePipeline()) {
+            runPipeline();
+        } else {
+            runParser();
+            if (options.lowMemory) {
+                releaseSource();
+            }
+            checkMemory("after parsing");
+            if (options.stopAfter == CompilationStage::PARSE) {
+                return true;
+            }
+
+            runCodeGeneration();
+        }
+        checkMemory("after IR generation");
+        if (options.stopAfter == CompilationStage::IR) {
+            return true;
+        }
+
+        runObjectEmission();
+        checkMemory("after object emission");
+        if (options.stopAfter == CompilationStage::OBJ) {
+            return true;
+        }
+
+        runLinker();
+        checkMemory("after linking");
+    } catch (const CompilationError&) {
+        return false;
+    }
+
+    return true;
+}
+
+// Flag combinations the optimizer or the linker would only reject after the work before them is done,
+// and with objects left behind
+void CompilationSession::checkOptions() {
+    if (!options.profileGenerate.empty() || !options.profileUse.empty()) {
+        if (options.optimizationLevel == 0) {
+            diagnostics.error("--profile-generate and --profile-use need -O1 or higher");
+        }
+        if (options.profileGenerate.empty() && !std::filesystem::exists(options.profileUse)) {
+            diagnostics.error("Profile " + options.profileUse + " does not exist");
+        }
+    }
+
+    if (options.stopAfter != CompilationStage::LINK) {
+        return;
+    }
+
+    if (options.freestanding) {
+        if (!options.profileGenerate.empty()) {
+            diagnostics.error("--profile-generate needs libc, it can't be used with --freestanding");
+        }
+        if (options.instrumentFunctions) {
+            diagnostics.error("--instrument=functions needs libc, it can't be used with --freestanding");
+        }
+    }
+
+    // Instrumented programs need LLVM's profile runtime, which clang would normally pull in
+    if (!options.profileGenerate.empty() && !std::filesystem::exists(options.profileRuntimeLibrary)) {
+        diagnostics.error("--profile-generate needs LLVM's profile runtime, but " + options.profileRuntimeLibrary +
+                          " does not exist. Install compiler-rt for this LLVM, or use --stop-after=obj to only get the instrumented object");
+    }
+}
+
+void CompilationSession::runCodeGeneration() {
+    {
+        auto measurement = statistics.measure("ir");
+        context = std::make_unique<llvm::LLVMContext>();
+    }
+
+    if (useFunctionCache()) {
+        generateCachedModules();
+        return;
+    }
+
+    if (useLowMemoryBuild()) {
+        generateFunctionObjects();
+        return;
+    }
+
+    if (options.lto == LTOMode::THIN) {
+        // Every source file gets a module of its own, the ThinLTO link brings them back together
+        module = generateModule(options.moduleName, 0);
+        for (int i = 1; i < ast->sourceCount; ++i) {
+            importedModules.push_back(generateModule(partitionFilename(options.moduleName, i), i));
+        }
+    } else {
+        module = generateModule(options.moduleName, -1);
+    }
+
+    if (options.stopAfter == CompilationStage::IR || options.keepTemporaries) {
+        writeModule(*module, options.irFilename);
+        for (std::size_t i = 0; i < importedModules.size(); ++i) {
+            writeModule(*importedModules[i], partitionFilename(options.irFilename, i + 1));
+        }
+    }
+}
+
+bool CompilationSession::usePipeline() {
+    if (!options.pipeline) {
+        return false;
+    }
+
+    // ThinLTO, the function cache and --low-memory split the program into modules, they need the whole tree for that
+    if (options.stopAfter == CompilationStage::PARSE || options.lto == LTOMode::THIN ||
+        !options.functionCacheDirectory.empty() || options.lowMemory) {
+        diagnostics.warning("--pipeline only works for builds that generate IR, without --lto=thin, --function-cache or --low-memory, it is ignored");
+        return false;
+    }
+
+    return true;
+}
+
+void CompilationSession::runPipeline() {
+    logStream(options) << "RUNNING: Starting Pipelined Parsing and IR Generation\n";
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // The IR thread stays quiet, its lines would only end up in the middle of the parser's
+    CompilerOptions quietOptions = options;
+    quietOptions.log = nullptr;
+
+    {
+        auto measurement = statistics.measure("ir");
+        context = std::make_unique<llvm::LLVMContext>();
+        module = createModule(options.moduleName);
+    }
+
+    // The parse phase includes the IR generation that ran alongside it
+    PipelineListener listener(*module, quietOptions);
+    runParser(&listener);
+
+    {
+        auto measurement = statistics.measure("ir");
+        listener.finish(ast.get(), diagnostics);
+        statistics.count("ir", "instructions", module->getInstructionCount());
+    }
+
+    {
+        auto measurement = statistics.measure("opt");
+        optimizeModule(*module, *targetMachine, options, diagnostics);
+        statistics.count("opt", "instructions", module->getInstructionCount());
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count() / 1e9;
+    logStream(options) << "DONE: Pipelined Parsing and IR Generation took " << seconds << " seconds\n";
+
+    if (options.stopAfter == CompilationStage::IR || options.keepTemporaries) {
+        writeModule(*module, options.irFilename);
+    }
+}
+
+bool CompilationSession::useLowMemoryBuild() {
+    if (!options.lowMemory) {
+        return false;
+    }
+
+    // The tokens are gone either way, only the module has to stay whole
+    if (options.stopAfter == CompilationStage::IR || options.lto != LTOMode::NONE ||
+        !options.functionCacheDirectory.empty()) {
+        diagnostics.warning("--low-memory generates the whole module with --stop-after=ir, --lto or --function-cache");
+        return false;
+    }
+
+    return true;
+}
+
+void CompilationSession::generateFunctionObjects() {
+    logStream(options) << "RUNNING: Starting Group by Group Compilation\n";
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    lowMemoryBuild = true;
+
+    // Thousands of small modules, the summary below is all that gets logged
+    CompilerOptions quietOptions = options;
+    quietOptions.log = nullptr;
+
+    // Both need every body, so they are worked out before the first one goes
+    std::map<std::string, FunctionNode*> functions = indexFunctions(ast.get());
+    std::map<std::string, FunctionEffects> effects = inferFunctionEffects(ast.get());
+
+    // Neighbours in the source go together, they tend to call each other
+    std::vector<VariableDeclarationNode*> globals;
+    std::vector<std::vector<FunctionNode*>> groups;
+    int groupTokens = lowMemoryGroupTokens;
+    for (ASTNodeBase* statement : ast->statements) {
+        if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+            if (groupTokens >= lowMemoryGroupTokens) {
+                groups.emplace_back();
+                groupTokens = 0;
+            }
+            groups.back().push_back(function);
+            groupTokens += function->bodyEnd - function->bodyStart;
+        } else if (VariableDeclarationNode* declaration = dynamic_cast<VariableDeclarationNode*>(statement)) {
+            globals.push_back(declaration);
+        }
+    }
+
+    // Callers inline their direct callees, so a body is released once its own group and every group
+    // that calls it are compiled
+    std::map<std::string, std::size_t> lastUse;
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        for (FunctionNode* function : groups[i]) {
+            lastUse[function->name] = std::max(lastUse[function->name], i);
+            for (const std::string& callee : function->callees) {
+                lastUse[callee] = std::max(lastUse[callee], i);
+            }
+        }
+    }
+
+    std::vector<std::vector<FunctionNode*>> releasedAfter(groups.size());
+    for (const std::vector<FunctionNode*>& group : groups) {
+        for (FunctionNode* function : group) {
+            releasedAfter[lastUse[function->name]].push_back(function);
+        }
+    }
+
+    // The global variables get the object of their own that the whole module would have gone to
+    {
+        auto measurement = statistics.measure("ir");
+        module = createModule(options.moduleName);
+        CodeGenerator(*module, quietOptions, diagnostics).generateFunctionIR(ast.get(), nullptr);
+    }
+
+    {
+        auto measurement = statistics.measure("obj");
+        emitObjectFile(*module, *targetMachine, options.objectFilename, quietOptions, diagnostics);
+        objectFilenames = {options.objectFilename};
+        module.reset();
+    }
+
+    for (std::size_t i = 0; i < groups.size(); ++i) {
+        std::unique_ptr<llvm::Module> groupModule;
+
+        {
+            auto measurement = statistics.measure("ir");
+
+            // A new context for every group, types and constants are never freed while theirs is alive
+            context = std::make_unique<llvm::LLVMContext>();
+            groupModule = createModule(groups[i].front()->name);
+            CodeGenerator(*groupModule, quietOptions, diagnostics, &statistics)
+                .generateFunctionGroupIR(groups[i], functions, globals, effects);
+            statistics.count("ir", "instructions", groupModule->getInstructionCount());
+        }
+
+        {
+            auto measurement = statistics.measure("opt");
+            optimizeModule(*groupModule, *targetMachine, quietOptions, diagnostics);
+            statistics.count("opt", "instructions", groupModule->getInstructionCount());
+        }
+
+        {
+            auto measurement = statistics.measure("obj");
+            std::string objectFilename = partitionFilename(options.objectFilename, i + 1);
+            emitObjectFile(*groupModule, *targetMachine, objectFilename, quietOptions, diagnostics);
+            objectFilenames.push_back(objectFilename);
+            groupModule.reset();
+        }
+
+        for (FunctionNode* released : releasedAfter[i]) {
+            released->releaseBody();
+        }
+
+        checkMemory("while compiling " + groups[i].front()->name);
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count() / 1e9;
+    logStream(options) << "DONE: Group by Group Compilation took " << seconds << " seconds, "
+                       << groups.size() << " groups\n";
+}
+
+void CompilationSession::checkMemory(const std::string& stage) {
+    if (!options.lowMemory) {
+        return;
+    }
+
+    // --stats resets the peak whenever a phase starts, it keeps the peak of every phase instead
+    peakRSSBytes = std::max(peakRSSBytes, readPeakRSSBytes());
+    for (const PhaseStatistics& phase : statistics.getPhases()) {
+        peakRSSBytes = std::max(peakRSSBytes, phase.peakRSSBytes);
+    }
+    // Another session in the process could be the one over it
+    if (options.ownsProcess && options.memoryLimitBytes > 0 && peakRSSBytes > options.memoryLimitBytes) {
+        diagnostics.error("The peak RSS of " + std::to_string(peakRSSBytes >> 20) + " MiB " + stage +
+                          " is over the --low-memory limit of " + std::to_string(options.memoryLimitBytes >> 20) + " MiB");
+    }
+}
+
+std::unique_ptr<llvm::Module> CompilationSession::createModule(const std::string& name) {
+    auto newModule = std::make_unique<llvm::Module>(name, *context);
+
+    // The target decides the data layout, so it has to be known before any IR is built
+    if (!targetMachine) {
+        targetMachine = createTargetMachine(*newModule, options, diagnostics);
+    } else {
+        newModule->setTargetTriple(targetMachine->getTargetTriple().str());
+        newModule->setDataLayout(targetMachine->createDataLayout());
+    }
+
+    return newModule;
+}
+
+std::unique_ptr<llvm::Module> CompilationSession::generateModule(const std::string& name, int sourceIndex) {
+    std::unique_ptr<llvm::Module> newModule;
+
+    {
+        auto measurement = statistics.measure("ir");
+        newModule = createModule(name);
+
+        CodeGenerator codeGenerator(*newModule, options, diagnostics, &statistics);
+        codeGenerator.generateIR(ast.get(), sourceIndex);
+        statistics.count("ir", "instructions", newModule->getInstructionCount());
+    }
+
+    {
+        auto measurement = statistics.measure("opt");
+        optimizeModule(*newModule, *targetMachine, options, diagnostics);
+        statistics.count("opt", "instructions", newModule->getInstructionCount());
+    }
+
+    return newModule;
+}
+
+bool CompilationSession::useFunctionCache() {
+    if (options.functionCacheDirectory.empty()) {
+        return false;
+    }
+
+    // The objects only make sense for a full build, and the profile isn't part of the hash
+    if (options.stopAfter != CompilationStage::LINK || options.lto != LTOMode::NONE ||
+        !options.profileGenerate.empty() || !options.profileUse.empty()) {
+        diagnostics.warning("--function-cache only works for full builds without --lto or profiles, it is ignored");
+        return false;
+    }
+
+    return true;
+}
+
+void CompilationSession::generateCachedModules() {
+    logStream(options) << "RUNNING: Starting Cached IR Generation\n";
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // Thousands of small modules, the summary below is all that gets logged
+    CompilerOptions quietOptions = options;
+    quietOptions.log = nullptr;
+
+    {
+        auto measurement = statistics.measure("ir");
+        functionCache = std::make_unique<FunctionCache>(options.functionCacheDirectory, ast.get(), options, diagnostics);
+
+        // The global variables are always generated, there's next to nothing to them
+        module = createModule(options.moduleName);
+        CodeGenerator(*module, quietOptions, diagnostics).generateFunctionIR(ast.get(), nullptr);
+    }
+
+    std::size_t hits = 0;
+    for (ASTNodeBase* statement : ast->statements) {
+        FunctionNode* function = dynamic_cast<FunctionNode*>(statement);
+        if (!function || !function->body) {
+            continue;
+        }
+
+        std::unique_ptr<llvm::Module> functionModule;
+        std::string fingerprint;
+
+        {
+            auto measurement = statistics.measure("ir");
+            fingerprint = functionCache->fingerprint(function);
+            if (functionCache->contains(fingerprint)) {
+                cachedObjectFilenames.push_back(functionCache->objectFilename(fingerprint));
+                ++hits;
+                continue;
+            }
+
+            functionModule = createModule(function->name);
+            CodeGenerator(*functionModule, quietOptions, diagnostics, &statistics).generateFunctionIR(ast.get(), function);
+            statistics.count("ir", "instructions", functionModule->getInstructionCount());
+        }
+
+        {
+            auto measurement = statistics.measure("opt");
+            optimizeModule(*functionModule, *targetMachine, quietOptions, diagnostics);
+            statistics.count("opt", "instructions", functionModule->getInstructionCount());
+        }
+
+        functionModules.emplace_back(fingerprint, std::move(functionModule));
+    }
+
+    statistics.count("ir", "cached functions", hits);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count() / 1e9;
+    logStream(options) << "DONE: Cached IR Generation took " << seconds << " seconds, " << hits
+                       << " functions from the cache, " << functionModules.size() << " compiled\n";
+}
+
+void CompilationSession::emitCachedModules() {
+    CompilerOptions quietOptions = options;
+    quietOptions.log = nullptr;
+
+    emitObjectFile(*module, *targetMachine, options.objectFilename, options, diagnostics);
+    objectFilenames = {options.objectFilename};
+
+    for (auto& [fingerprint, functionModule] : functionModules) {
+        std::string temporaryFilename = functionCache->temporaryFilename(fingerprint);
+        emitObjectFile(*functionModule, *targetMachine, temporaryFilename, quietOptions, diagnostics);
+        functionCache->store(temporaryFilename, fingerprint);
+        cachedObjectFilenames.push_back(functionCache->objectFilename(fingerprint));
+    }
+}
+
+void CompilationSession::writeModule(llvm::Module& module, const std::string& filename) {
+    if (options.emitBitcode) {
+        writeBitcodeFile(module, filename, diagnostics);
+    } else {
+        writeIRFile(module, filename, diagnostics);
+    }
+}
+
+void CompilationSession::runObjectEmission() {
+    auto measurement = statistics.measure("obj");
+    emitObjects();
+
+    if (statistics.isEnabled()) {
+        std::vector<std::string> emittedFilenames = objectFilenames;
+        emittedFilenames.insert(emittedFilenames.end(), cachedObjectFilenames.begin(), cachedObjectFilenames.end());
+        for (const std::string& objectFilename : emittedFilenames) {
+            statistics.count("obj", "objects", 1);
+            statistics.count("obj", "object bytes", std::filesystem::file_size(objectFilename));
+        }
+    }
+}
+
+void CompilationSession::emitObjects() {
+    if (lowMemoryBuild) {
+        return;
+    }
+
+    if (functionCache) {
+        emitCachedModules();
+        return;
+    }
+
+    if (options.lto == LTOMode::THIN) {
+        std::vector<llvm::Module*> modules = {module.get()};
+        for (const std::unique_ptr<llvm::Module>& importedModule : importedModules) {
+            modules.push_back(importedModule.get());
+        }
+
+        // Only main and the exported functions are seen from outside the program
+        std::vector<std::string> preservedSymbols = {"main"};
+        for (ASTNodeBase* statement : ast->statements) {
+            FunctionNode* function = dynamic_cast<FunctionNode*>(statement);
+            if (function && function->exported) {
+                preservedSymbols.push_back(function->name);
+            }
+        }
+
+        objectFilenames = emitObjectFilesWithThinLTO(modules, preservedSymbols, options.objectFilename,
+                                                     options, diagnostics);
+        return;
+    }
+
+    if (options.codegenThreads > 1) {
+        objectFilenames = emitObjectFilesInParallel(*module, options.codegenThreads, options.objectFilename,
+                                                    options, diagnostics);
+        return;
+    }
+
+    emitObjectFile(*module, *targetMachine, options.objectFilename, options, diagnostics);
+    objectFilenames = {options.objectFilename};
+}
+
+void CompilationSession::runLinker() {
+    auto measurement = statistics.measure("link");
+
+    std::vector<std::string> linkedFilenames = objectFilenames;
+    linkedFilenames.insert(linkedFilenames.end(), cachedObjectFilenames.begin(), cachedObjectFilenames.end());
+    linkExecutable(linkedFilenames, options.outputFilename, options, diagnostics);
+
+    if (options.sizeLevel > 0) {
+        std::set<std::string> functionNames;
+        for (ASTNodeBase* statement : ast->statements) {
+            if (FunctionNode* function = dynamic_cast<FunctionNode*>(statement)) {
+                functionNames.insert(function->name);
+            }
+        }
+
+        reportBinarySize(options.outputFilename, functionNames, options, diagnostics);
+        stripExecutable(options.outputFilename, options, diagnostics);
+    }
+
+    if (statistics.isEnabled()) {
+        statistics.count("link", "executable bytes", std::filesystem::file_size(options.outputFilename));
+    }
+
+    // Remove the temporary files
+    if (!options.keepTemporaries) {
+        for (const std::string& objectFilename : objectFilenames) {
+            std::remove(objectFilename.c_str());
+        }
+    }
+}
+
+llvm::Module* CompilationSession::getModule() const {
+    return module.get();
+}
+
+std::uint64_t CompilationSession::getPeakRSSBytes() const {
+    return peakRSSBytes;
+}
+
+void CompilationSession::setTargetMachine(std::unique_ptr<llvm::TargetMachine> targetMachine) {
+    this->targetMachine = std::move(targetMachine);
+}
+
+std::unique_ptr<llvm::TargetMachine> CompilationSession::takeTargetMachine() {
+    return std::move(targetMachine);
+}
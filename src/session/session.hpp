@@ -0,0 +1,88 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frontend.hpp"
+
+namespace llvm {
+class LLVMContext;
+class Module;
+class TargetMachine;
+}
+
+class FunctionCache;
+
+// One compilation of one program. A session owns all of its state (the frontend's, the LLVM context
+// and the modules), so separate sessions can run on separate threads.
+class CompilationSession : public FrontendSession {
+public:
+    explicit CompilationSession(CompilerOptions options);
+    ~CompilationSession() override;
+
+    // Runs every stage up to and including options.stopAfter. Returns false if a stage failed,
+    // the reason is in the diagnostics.
+    bool run();
+
+    llvm::Module* getModule() const;
+
+    // --low-memory, the most the process had resident at any of the checks, see checkMemory. That's
+    // the whole process, with other sessions running alongside it includes their memory too.
+    std::uint64_t getPeakRSSBytes() const;
+
+    // --watch builds the same program over and over, the target machine is only set up once and
+    // handed from one session to the next. It doesn't depend on the LLVM context.
+    void setTargetMachine(std::unique_ptr<llvm::TargetMachine> targetMachine);
+    std::unique_ptr<llvm::TargetMachine> takeTargetMachine();
+
+private:
+    void checkOptions();
+    void runCodeGeneration();
+
+    // --pipeline, parsing and IR generation at the same time, see PipelineListener
+    bool usePipeline();
+    void runPipeline();
+
+    // --low-memory, the functions are generated, optimized and emitted a small group at a time and freed right after
+    bool useLowMemoryBuild();
+    void generateFunctionObjects();
+    void checkMemory(const std::string& stage);
+
+    void runObjectEmission();
+    void emitObjects();
+    void runLinker();
+
+    std::unique_ptr<llvm::Module> createModule(const std::string& name);
+    std::unique_ptr<llvm::Module> generateModule(const std::string& name, int sourceIndex);
+
+    // --function-cache, see FunctionCache
+    bool useFunctionCache();
+    void generateCachedModules();
+    void emitCachedModules();
+    void writeModule(llvm::Module& module, const std::string& filename);
+
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+
+    // With --lto=thin the module above is the main file's, every import gets one here
+    std::vector<std::unique_ptr<llvm::Module>> importedModules;
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+
+    // What runObjectEmission wrote, more than one file with -j
+    std::vector<std::string> objectFilenames;
+
+    // With --function-cache the module above only has the global variables. The functions that
+    // weren't in the cache get a module each, keyed by their fingerprint. Cached objects are never removed.
+    std::unique_ptr<FunctionCache> functionCache;
+    std::vector<std::pair<std::string, std::unique_ptr<llvm::Module>>> functionModules;
+    std::vector<std::string> cachedObjectFilenames;
+
+    // --low-memory, set when generateFunctionObjects already wrote the objects
+    bool lowMemoryBuild = false;
+    std::uint64_t peakRSSBytes = 0;
+};
+
+#endif  // SESSION_HPP
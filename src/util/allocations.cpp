@@ -0,0 +1,119 @@
+// The global operator new of the starship executable, it counts every allocation for --stats.
+// Only the driver links this, programs using the library keep their own allocator.
+
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include "stats.hpp"
+
+static void recordAllocation(void* pointer) {
+    std::int64_t size = static_cast<std::int64_t>(malloc_usable_size(pointer));
+    allocationCounters.allocations.fetch_add(1, std::memory_order_relaxed);
+    allocationCounters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    std::int64_t live = allocationCounters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::int64_t peak = allocationCounters.peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !allocationCounters.peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+static void recordFree(void* pointer) {
+    if (pointer) {
+        allocationCounters.liveBytes.fetch_sub(static_cast<std::int64_t>(malloc_usable_size(pointer)),
+                                               std::memory_order_relaxed);
+    }
+}
+
+static void* allocate(std::size_t size) {
+    void* pointer = std::malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+
+    recordAllocation(pointer);
+    return pointer;
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+    std::size_t align = static_cast<std::size_t>(alignment);
+
+    // aligned_alloc wants a multiple of the alignment
+    void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+
+    recordAllocation(pointer);
+    return pointer;
+}
+
+static void deallocate(void* pointer) noexcept {
+    recordFree(pointer);
+    std::free(pointer);
+}
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+    deallocate(pointer);
+}
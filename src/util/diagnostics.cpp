@@ -0,0 +1,44 @@
+#include "diagnostics.hpp"
+
+void Diagnostics::warning(const std::string& message, std::size_t line) {
+    report(DiagnosticSeverity::WARNING, message, line);
+}
+
+void Diagnostics::error(const std::string& message, std::size_t line) {
+    report(DiagnosticSeverity::ERROR, message, line);
+    throw CompilationError(message);
+}
+
+void Diagnostics::report(DiagnosticSeverity severity, const std::string& message, std::size_t line) {
+    diagnostics.push_back({severity, message, line});
+}
+
+bool Diagnostics::hasErrors() const {
+    for (const Diagnostic& diagnostic : diagnostics) {
+        if (diagnostic.severity == DiagnosticSeverity::ERROR) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const std::vector<Diagnostic>& Diagnostics::getDiagnostics() const {
+    return diagnostics;
+}
+
+void Diagnostics::print(std::ostream& stream) const {
+    for (const Diagnostic& diagnostic : diagnostics) {
+        if (diagnostic.severity == DiagnosticSeverity::WARNING) {
+            stream << "\033[1;31m" << "WARNING: " << diagnostic.message << "\033[0m";
+        } else {
+            stream << "\033[1;31m" << "ERROR: " << diagnostic.message << "\033[0m";
+        }
+
+        if (diagnostic.line != 0) {
+            stream << " (line " << diagnostic.line << ")";
+        }
+
+        stream << "\n";
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class DiagnosticSeverity {
+    WARNING,
+    ERROR
+};
+
+struct Diagnostic {
+    DiagnosticSeverity severity;
+    std::string message;
+    std::size_t line; // 0 when the message isn't tied to a line
+};
+
+// Thrown by Diagnostics::error to unwind out of the current compilation.
+// The session catches it, the message itself is already stored in the diagnostics list.
+class CompilationError : public std::runtime_error {
+public:
+    explicit CompilationError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Collects the warnings and errors of one compilation session
+class Diagnostics {
+public:
+    void warning(const std::string& message, std::size_t line = 0);
+    [[noreturn]] void error(const std::string& message, std::size_t line = 0);
+
+    // Records a diagnostic without unwinding, for callers that aren't inside a compilation stage
+    void report(DiagnosticSeverity severity, const std::string& message, std::size_t line = 0);
+
+    bool hasErrors() const;
+    const std::vector<Diagnostic>& getDiagnostics() const;
+
+    // Print everything collected so far, warnings in red like before
+    void print(std::ostream& stream) const;
+
+private:
+    std::vector<Diagnostic> diagnostics;
+};
+
+#endif  // DIAGNOSTICS_HPP
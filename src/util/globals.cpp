@@ -1,8 +0,0 @@
-#include "globals.hpp"
-#include <iostream>
-
-void debugPrint(const std::string& message) {
-    if (debugMode) {
-        std::cout << "[DEBUG] " << message << "\n";
-    }
-}
\ No newline at end of file
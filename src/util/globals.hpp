@@ -1,11 +0,0 @@
-#ifndef GLOBALS_HPP
-#define GLOBALS_HPP
-
-#include <iostream>
-
-
-extern bool verboseMode;
-extern bool debugMode;
-
-
-#endif  // GLOBALS_HPP
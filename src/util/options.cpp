@@ -0,0 +1,84 @@
+#include <iostream>
+#include <ostream>
+#include <streambuf>
+
+#include "options.hpp"
+
+std::string defaultRuntimeLibrary() {
+    return STARSHIP_RUNTIME_LIBRARY;
+}
+
+std::string defaultFreestandingRuntimeLibrary() {
+    return STARSHIP_FREESTANDING_RUNTIME_LIBRARY;
+}
+
+std::string defaultProfileRuntimeLibrary() {
+    return STARSHIP_PROFILE_RUNTIME_LIBRARY;
+}
+
+bool parseCompilationStage(const std::string& name, CompilationStage& stage) {
+    if (name == "lex") {
+        stage = CompilationStage::LEX;
+    } else if (name == "parse") {
+        stage = CompilationStage::PARSE;
+    } else if (name == "ir") {
+        stage = CompilationStage::IR;
+    } else if (name == "obj") {
+        stage = CompilationStage::OBJ;
+    } else if (name == "link") {
+        stage = CompilationStage::LINK;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+std::string compilationStageToString(CompilationStage stage) {
+    switch (stage) {
+        case CompilationStage::LEX:
+            return "lex";
+        case CompilationStage::PARSE:
+            return "parse";
+        case CompilationStage::IR:
+            return "ir";
+        case CompilationStage::OBJ:
+            return "obj";
+        case CompilationStage::LINK:
+            return "link";
+    }
+
+    return "";
+}
+
+// A stream that swallows everything, used when a session has no log
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+};
+
+std::ostream& logStream(const CompilerOptions& options) {
+    if (options.log) {
+        return *options.log;
+    }
+
+    // NullBuffer keeps no state, so one instance can back every thread's stream
+    static NullBuffer nullBuffer;
+    thread_local std::ostream nullStream(&nullBuffer);
+    return nullStream;
+}
+
+void debugPrint(const CompilerOptions& options, const std::string& message) {
+    if (options.debugMode) {
+        logStream(options) << "[DEBUG] " << message;
+    }
+}
+
+void flushPrint(const CompilerOptions& options) {
+    if (!options.verboseMode && options.log) {
+        // Flush the output
+        *options.log << "\033[1A\033[2K" << std::flush;
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// The last stage a compilation session runs before it stops.
+enum class CompilationStage {
+    LEX,
+    PARSE,
+    IR,
+    OBJ,
+    LINK
+};
+
+// --lto=<mode>
+enum class LTOMode {
+    NONE,
+    THIN
+};
+
+// The runtime library that was built alongside the compiler
+std::string defaultRuntimeLibrary();
+
+// The runtime for --freestanding programs, it brings its own _start and makes system calls itself
+std::string defaultFreestandingRuntimeLibrary();
+
+// LLVM's profile runtime, needed to link programs built with --profile-generate
+std::string defaultProfileRuntimeLibrary();
+
+// Everything that used to be a process-wide flag. Each CompilationSession owns a copy,
+// so several sessions with different settings can run side by side.
+struct CompilerOptions {
+    bool debugMode = false;
+    bool verboseMode = false;
+
+    CompilationStage stopAfter = CompilationStage::LINK;
+
+    std::string moduleName = "main.rk";
+    std::string irFilename = "output.ll";
+    std::string objectFilename = "output.o";
+    std::string outputFilename = "main";
+
+    // 0 to 3, like -O0 to -O3
+    int optimizationLevel = 2;
+
+    // 1 for -Os, 2 for -Oz, both on top of -O2. Every function and string gets its own section, the link
+    // drops the unused ones, folds identical code and strips the binary, then reports what is left.
+    int sizeLevel = 0;
+
+    // -mcpu= / -march= and -mattr=. "native" means the CPU and features of the machine we run on,
+    // explicit features like "+avx2,-avx512f" are applied on top.
+    std::string targetCPU = "generic";
+    std::string targetFeatures;
+
+    // --emit=bc writes irFilename as bitcode with a ThinLTO summary instead of text
+    bool emitBitcode = false;
+
+    // With THIN every source file becomes its own module and the link imports across them
+    LTOMode lto = LTOMode::NONE;
+
+    // -j N, the backend splits the module and emits this many objects in parallel
+    unsigned codegenThreads = 1;
+
+    // --pipeline, IR generation runs on a thread of its own and takes every function as soon as the
+    // parser is done with it, see CompilationSession::runPipeline
+    bool pipeline = false;
+
+    // --low-memory[=MiB], tokens are freed after parsing and the functions are compiled a group of about
+    // 20k body tokens at a time, each group into an object of its own, see CompilationSession::generateFunctionObjects.
+    // The peak RSS is reported, and with a limit the build fails once it's over. 0 when there's no limit.
+    bool lowMemory = false;
+    std::uint64_t memoryLimitBytes = 0;
+
+    // Set by the starship driver, which runs a single session in its process. The peak RSS belongs to the
+    // whole process, so only then does --stats reset it at every phase and does the --low-memory limit apply.
+    // A program running several sessions leaves it off, they would reset and count each other's memory.
+    bool ownsProcess = false;
+
+    // Linked into every program, it provides print and flushes stdout at exit
+    std::string runtimeLibrary = defaultRuntimeLibrary();
+
+    // Link without libc, libstdc++ or a dynamic loader, a static binary that starts at the runtime's _start
+    bool freestanding = false;
+    std::string freestandingRuntimeLibrary = defaultFreestandingRuntimeLibrary();
+
+    // --profile-generate makes the program write its raw profile here when it exits,
+    // --profile-use reads a merged .profdata. Empty when not in use.
+    std::string profileGenerate;
+    std::string profileUse;
+    std::string profileRuntimeLibrary = defaultProfileRuntimeLibrary();
+
+    // --instrument=functions, every function counts its calls and the cycles spent in it. The runtime
+    // writes the profile when the program exits, see starship_profile_enter.
+    bool instrumentFunctions = false;
+
+    // --function-cache[=dir], every function becomes an object of its own in this directory and is only
+    // compiled again when its hash changes. Empty when the cache is off.
+    std::string functionCacheDirectory;
+
+    // --stats, every phase is timed and counted, see CompilerStatistics. --stats-file also writes them as JSON.
+    bool stats = false;
+    std::string statsFilename;
+
+    // --perf-counters, --stats with hardware counters per phase and per function's IR generation
+    bool perfCounters = false;
+
+    // --watch, rebuild whenever main.rk or one of its imports changes, see starshipBuild
+    bool watch = false;
+
+    // Keep output.ll and output.o around after linking
+    bool keepTemporaries = false;
+
+    // Function bodies are only parsed when reachable from main, this also keeps @export functions
+    bool keepExportedFunctions = false;
+
+    // starship check parses the unreachable bodies too, for their errors. They are still dropped afterwards.
+    bool parseEveryFunction = false;
+
+    // --print-layouts, the size, offsets and padding of every struct once parsing is done
+    bool printLayouts = false;
+
+    // Where progress and debug messages go. Set to nullptr to silence a session.
+    std::ostream* log = &std::cout;
+};
+
+bool parseCompilationStage(const std::string& name, CompilationStage& stage);
+std::string compilationStageToString(CompilationStage stage);
+
+// Logging helpers, these replace the old debugMode/verboseMode globals
+std::ostream& logStream(const CompilerOptions& options);
+void debugPrint(const CompilerOptions& options, const std::string& message);
+void flushPrint(const CompilerOptions& options);
+
+#endif  // OPTIONS_HPP
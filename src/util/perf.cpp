@@ -0,0 +1,120 @@
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf.hpp"
+
+const char* perfCounterToString(PerfCounter counter) {
+    switch (counter) {
+        case PerfCounter::CYCLES:
+            return "cycles";
+        case PerfCounter::INSTRUCTIONS:
+            return "instructions";
+        case PerfCounter::CACHE_MISSES:
+            return "cache misses";
+        case PerfCounter::BRANCH_MISSES:
+            return "branch misses";
+        case PerfCounter::PAGE_FAULTS:
+            return "page faults";
+    }
+    return "unknown";
+}
+
+#ifdef __linux__
+
+static int openCounter(std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attributes.inherit = 1; // -j and ThinLTO run codegen on threads of their own
+
+    // Only our own code, which is all perf_event_paranoid=2 (the default) allows anyway
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+PerfCounters::PerfCounters() {
+    static const std::pair<std::uint32_t, std::uint64_t> events[perfCounterCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    };
+
+    for (std::size_t i = 0; i < perfCounterCount; ++i) {
+        descriptors[i] = openCounter(events[i].first, events[i].second);
+        if (descriptors[i] < 0 && error.empty()) {
+            error = std::string(perfCounterToString(static_cast<PerfCounter>(i))) + ": " + std::strerror(errno);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+}
+
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+
+    for (std::size_t i = 0; i < perfCounterCount; ++i) {
+        // value, time enabled, time running
+        std::uint64_t values[3];
+        if (descriptors[i] < 0 || ::read(descriptors[i], values, sizeof(values)) != sizeof(values)) {
+            continue;
+        }
+
+        if (values[2] > 0 && values[2] < values[1]) {
+            values[0] = static_cast<std::uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+        }
+        sample.values[i] = values[0];
+    }
+
+    return sample;
+}
+
+#else
+
+PerfCounters::PerfCounters() : error("perf_event_open only exists on Linux") {
+    descriptors.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {}
+
+PerfSample PerfCounters::read() const {
+    return PerfSample();
+}
+
+#endif
+
+bool PerfCounters::isAvailable(PerfCounter counter) const {
+    return descriptors[static_cast<std::size_t>(counter)] >= 0;
+}
+
+bool PerfCounters::isAnyAvailable() const {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string& PerfCounters::getError() const {
+    return error;
+}
@@ -0,0 +1,50 @@
+#ifndef PERF_HPP
+#define PERF_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// What --perf-counters reads around every phase
+enum class PerfCounter {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    PAGE_FAULTS
+};
+
+static const std::size_t perfCounterCount = 5;
+
+const char* perfCounterToString(PerfCounter counter);
+
+struct PerfSample {
+    std::array<std::uint64_t, perfCounterCount> values{};
+};
+
+// Counters of the whole process, threads started later included, through Linux's perf_event_open.
+// Each counter is opened on its own: virtual machines often have no PMU, and perf_event_paranoid can
+// forbid everything. What can't be opened is simply not available, it never fails the build.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAvailable(PerfCounter counter) const;
+    bool isAnyAvailable() const;
+
+    // Why the first counter that failed couldn't be opened, empty when they all work
+    const std::string& getError() const;
+
+    // Scaled up when the kernel had to multiplex the counters
+    PerfSample read() const;
+
+private:
+    std::array<int, perfCounterCount> descriptors;
+    std::string error;
+};
+
+#endif  // PERF_HPP
@@ -0,0 +1,95 @@
+#ifndef QUEUE_HPP
+#define QUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A bounded queue between exactly one producer thread and one consumer thread, see --pipeline.
+// Items go through a ring buffer without a lock. Only a side that has to wait, because the queue is
+// full or empty, takes the mutex to sleep until the other side wakes it.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : slots(capacity + 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Blocks while the queue is full. Returns false, without adding item, once the consumer closed it.
+    bool push(T item) {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        std::size_t next = advance(position);
+
+        if (next == head.load()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            producerWaiting = true;
+            wakeup.wait(lock, [&] { return next != head.load() || closed.load(); });
+            producerWaiting = false;
+        }
+        if (closed.load()) {
+            return false;
+        }
+
+        slots[position] = std::move(item);
+        tail.store(next);
+        wake(consumerWaiting);
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false once it is closed and everything was taken out.
+    bool pop(T& item) {
+        std::size_t position = head.load(std::memory_order_relaxed);
+
+        if (position == tail.load()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            consumerWaiting = true;
+            wakeup.wait(lock, [&] { return position != tail.load() || closed.load(); });
+            consumerWaiting = false;
+        }
+        if (position == tail.load()) {
+            return false;
+        }
+
+        item = std::move(slots[position]);
+        head.store(advance(position));
+        wake(producerWaiting);
+        return true;
+    }
+
+    // Either side is done. The consumer still gets what was pushed before, the producer's pushes fail from now on.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed.store(true);
+        wakeup.notify_all();
+    }
+
+private:
+    std::size_t advance(std::size_t position) const {
+        return position + 1 == slots.size() ? 0 : position + 1;
+    }
+
+    // The sleeper sets its flag before it checks the indices one last time, and both are sequentially
+    // consistent. So either it sees the new index, or we see the flag and wait for it to be asleep.
+    void wake(const std::atomic<bool>& waiting) {
+        if (waiting.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeup.notify_all();
+        }
+    }
+
+    // One slot always stays empty, that's how full and empty are told apart
+    std::vector<T> slots;
+    std::atomic<std::size_t> head{0};
+    std::atomic<std::size_t> tail{0};
+    std::atomic<bool> closed{false};
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> producerWaiting{false};
+    std::atomic<bool> consumerWaiting{false};
+};
+
+#endif  // QUEUE_HPP
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.hpp"
+
+AllocationCounters allocationCounters;
+
+static double processCPUSeconds() {
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Linux can reset the peak RSS, then every phase gets its own. Elsewhere it only ever goes up.
+static void resetPeakRSS() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+std::uint64_t readPeakRSSBytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+CompilerStatistics::Measurement::Measurement(CompilerStatistics* statistics, std::string phase, bool function)
+    : statistics(statistics), phase(std::move(phase)), function(function) {
+    if (!statistics) {
+        return;
+    }
+
+    liveBytesStart = allocationCounters.liveBytes.load(std::memory_order_relaxed);
+    if (!function) {
+        if (statistics->resetsPeakRSS) {
+            resetPeakRSS();
+        }
+        allocationCounters.peakLiveBytes.store(liveBytesStart, std::memory_order_relaxed);
+    }
+    allocationsStart = allocationCounters.allocations.load(std::memory_order_relaxed);
+    allocatedBytesStart = allocationCounters.allocatedBytes.load(std::memory_order_relaxed);
+
+    cpuStart = processCPUSeconds();
+    if (statistics->perfCounters) {
+        perfStart = statistics->perfCounters->read();
+    }
+    wallStart = std::chrono::steady_clock::now();
+}
+
+CompilerStatistics::Measurement::~Measurement() {
+    if (!statistics) {
+        return;
+    }
+
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    PerfSample perfEnd = statistics->perfCounters ? statistics->perfCounters->read() : PerfSample();
+    double cpuSeconds = processCPUSeconds() - cpuStart;
+
+    PhaseStatistics& phaseStatistics = function ? statistics->findFunction(phase) : statistics->findPhase(phase);
+    for (std::size_t i = 0; i < perfCounterCount; ++i) {
+        phaseStatistics.perf.values[i] += perfEnd.values[i] - perfStart.values[i];
+    }
+    phaseStatistics.wallSeconds += wallSeconds;
+    phaseStatistics.cpuSeconds += cpuSeconds;
+    phaseStatistics.allocations += allocationCounters.allocations.load(std::memory_order_relaxed) - allocationsStart;
+    phaseStatistics.allocatedBytes +=
+        allocationCounters.allocatedBytes.load(std::memory_order_relaxed) - allocatedBytesStart;
+    phaseStatistics.retainedBytes += allocationCounters.liveBytes.load(std::memory_order_relaxed) - liveBytesStart;
+    if (!function) {
+        phaseStatistics.peakHeapBytes =
+            std::max(phaseStatistics.peakHeapBytes, allocationCounters.peakLiveBytes.load(std::memory_order_relaxed));
+        phaseStatistics.peakRSSBytes = std::max(phaseStatistics.peakRSSBytes, readPeakRSSBytes());
+    }
+}
+
+CompilerStatistics::CompilerStatistics(bool enabled, bool hardwareCounters, bool resetsPeakRSS)
+    : enabled(enabled), resetsPeakRSS(resetsPeakRSS) {
+    if (enabled && hardwareCounters) {
+        perfCounters = std::make_unique<PerfCounters>();
+    }
+}
+
+CompilerStatistics::Measurement CompilerStatistics::measure(const std::string& phase) {
+    return Measurement(enabled ? this : nullptr, phase);
+}
+
+// Thousands of functions, so only when the counters were asked for
+CompilerStatistics::Measurement CompilerStatistics::measureFunction(const std::string& function) {
+    return Measurement(perfCounters ? this : nullptr, function, true);
+}
+
+void CompilerStatistics::count(const std::string& phase, const std::string& counter, std::uint64_t value) {
+    if (!enabled) {
+        return;
+    }
+
+    PhaseStatistics& phaseStatistics = findPhase(phase);
+    for (auto& [name, total] : phaseStatistics.counters) {
+        if (name == counter) {
+            total += value;
+            return;
+        }
+    }
+
+    phaseStatistics.counters.emplace_back(counter, value);
+}
+
+bool CompilerStatistics::isEnabled() const {
+    return enabled;
+}
+
+const std::vector<PhaseStatistics>& CompilerStatistics::getPhases() const {
+    return phases;
+}
+
+const std::vector<PhaseStatistics>& CompilerStatistics::getFunctions() const {
+    return functions;
+}
+
+const PerfCounters* CompilerStatistics::getPerfCounters() const {
+    return perfCounters.get();
+}
+
+PhaseStatistics& CompilerStatistics::findPhase(const std::string& phase) {
+    for (PhaseStatistics& phaseStatistics : phases) {
+        if (phaseStatistics.name == phase) {
+            return phaseStatistics;
+        }
+    }
+
+    phases.emplace_back();
+    phases.back().name = phase;
+    return phases.back();
+}
+
+// Split modules generate the functions they inline again, those add up under the one name
+PhaseStatistics& CompilerStatistics::findFunction(const std::string& function) {
+    auto [index, inserted] = functionIndices.emplace(function, functions.size());
+    if (inserted) {
+        functions.emplace_back();
+        functions.back().name = function;
+    }
+    return functions[index->second];
+}
+
+static std::string formatBytes(std::int64_t bytes) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+    if (std::abs(bytes) >= 1024 * 1024) {
+        text << bytes / (1024.0 * 1024.0) << " MiB";
+    } else if (std::abs(bytes) >= 1024) {
+        text << bytes / 1024.0 << " KiB";
+    } else {
+        text << bytes << " B";
+    }
+    return text.str();
+}
+
+void CompilerStatistics::print(std::ostream& stream) const {
+    stream << "Statistics:\n";
+    stream << std::left << std::setw(8) << "phase" << std::right << std::setw(11) << "wall s" << std::setw(11)
+           << "cpu s" << std::setw(13) << "allocations" << std::setw(13) << "allocated" << std::setw(13)
+           << "peak heap" << std::setw(13) << "retained" << std::setw(13) << "peak RSS" << "\n";
+
+    for (const PhaseStatistics& phase : phases) {
+        stream << std::left << std::setw(8) << phase.name << std::right << std::fixed << std::setprecision(6)
+               << std::setw(11) << phase.wallSeconds << std::setw(11) << phase.cpuSeconds << std::setw(13)
+               << phase.allocations << std::setw(13) << formatBytes(phase.allocatedBytes) << std::setw(13)
+               << formatBytes(phase.peakHeapBytes) << std::setw(13) << formatBytes(phase.retainedBytes)
+               << std::setw(13) << formatBytes(phase.peakRSSBytes) << "\n";
+
+        for (const auto& [name, value] : phase.counters) {
+            stream << "    " << std::left << std::setw(24) << name << std::right << value << "\n";
+        }
+        printPerf(stream, phase);
+    }
+
+    if (!functions.empty()) {
+        // The most expensive first, by cycles when the machine counts them
+        std::vector<const PhaseStatistics*> sorted;
+        for (const PhaseStatistics& function : functions) {
+            sorted.push_back(&function);
+        }
+
+        bool byCycles = perfCounters->isAvailable(PerfCounter::CYCLES);
+        std::sort(sorted.begin(), sorted.end(), [byCycles](const PhaseStatistics* a, const PhaseStatistics* b) {
+            std::size_t cycles = static_cast<std::size_t>(PerfCounter::CYCLES);
+            return byCycles ? a->perf.values[cycles] > b->perf.values[cycles] : a->wallSeconds > b->wallSeconds;
+        });
+        if (sorted.size() > 10) {
+            sorted.resize(10);
+        }
+
+        stream << "IR generation of the " << sorted.size() << " most expensive of " << functions.size()
+               << " functions:\n";
+        for (const PhaseStatistics* function : sorted) {
+            stream << "  " << std::left << std::setw(22) << function->name << std::right << std::fixed
+                   << std::setprecision(6) << std::setw(11) << function->wallSeconds << " s\n";
+            printPerf(stream, *function);
+        }
+    }
+
+    stream << std::defaultfloat;
+}
+
+void CompilerStatistics::printPerf(std::ostream& stream, const PhaseStatistics& phase) const {
+    if (!perfCounters) {
+        return;
+    }
+
+    // The session already warned about the missing ones
+    for (std::size_t i = 0; i < perfCounterCount; ++i) {
+        PerfCounter counter = static_cast<PerfCounter>(i);
+        if (perfCounters->isAvailable(counter)) {
+            stream << "    " << std::left << std::setw(24) << perfCounterToString(counter) << std::right
+                   << phase.perf.values[i] << "\n";
+        }
+    }
+}
+
+static std::string quoteJSON(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Unavailable counters are null
+void CompilerStatistics::writePerfJSON(std::ostream& stream, const PhaseStatistics& phase) const {
+    if (!perfCounters) {
+        return;
+    }
+
+    stream << ", \"perf\": {";
+    for (std::size_t i = 0; i < perfCounterCount; ++i) {
+        PerfCounter counter = static_cast<PerfCounter>(i);
+        stream << (i > 0 ? ", " : "") << quoteJSON(perfCounterToString(counter)) << ": ";
+        if (perfCounters->isAvailable(counter)) {
+            stream << phase.perf.values[i];
+        } else {
+            stream << "null";
+        }
+    }
+    stream << "}";
+}
+
+void CompilerStatistics::writeJSON(std::ostream& stream) const {
+    stream << "{\n  \"phases\": [";
+
+    for (std::size_t i = 0; i < phases.size(); ++i) {
+        const PhaseStatistics& phase = phases[i];
+        stream << (i > 0 ? ",\n" : "\n") << "    {\"name\": " << quoteJSON(phase.name)
+               << ", \"wallSeconds\": " << phase.wallSeconds << ", \"cpuSeconds\": " << phase.cpuSeconds
+               << ", \"allocations\": " << phase.allocations << ", \"allocatedBytes\": " << phase.allocatedBytes
+               << ", \"peakHeapBytes\": " << phase.peakHeapBytes << ", \"retainedBytes\": " << phase.retainedBytes
+               << ", \"peakRSSBytes\": " << phase.peakRSSBytes << ", \"counters\": {";
+
+        for (std::size_t j = 0; j < phase.counters.size(); ++j) {
+            stream << (j > 0 ? ", " : "") << quoteJSON(phase.counters[j].first) << ": " << phase.counters[j].second;
+        }
+
+        stream << "}";
+        writePerfJSON(stream, phase);
+        stream << "}";
+    }
+
+    stream << "\n  ]";
+
+    if (perfCounters) {
+        stream << ",\n  \"functions\": [";
+        for (std::size_t i = 0; i < functions.size(); ++i) {
+            const PhaseStatistics& function = functions[i];
+            stream << (i > 0 ? ",\n" : "\n") << "    {\"name\": " << quoteJSON(function.name)
+                   << ", \"wallSeconds\": " << function.wallSeconds << ", \"cpuSeconds\": " << function.cpuSeconds
+                   << ", \"allocations\": " << function.allocations
+                   << ", \"allocatedBytes\": " << function.allocatedBytes;
+            writePerfJSON(stream, function);
+            stream << "}";
+        }
+        stream << "\n  ]";
+    }
+
+    stream << "\n}\n";
+}
@@ -0,0 +1,106 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "perf.hpp"
+
+// Heap counters, kept up to date by the counting operator new in allocations.cpp. Programs that
+// link the library without it just see zeros. There's one set for the whole process, sessions running
+// side by side count each other's allocations.
+struct AllocationCounters {
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> allocatedBytes{0};
+    std::atomic<std::int64_t> liveBytes{0};
+    std::atomic<std::int64_t> peakLiveBytes{0}; // Since the last phase started
+};
+
+extern AllocationCounters allocationCounters;
+
+// The most the process ever had resident, whichever session or thread it was. On Linux --stats resets
+// it whenever a phase starts, but only for a session that owns the process.
+std::uint64_t readPeakRSSBytes();
+
+// What one phase of the compiler cost. A phase that runs more than once, like IR generation for
+// every module, adds up.
+struct PhaseStatistics {
+    std::string name;
+    double wallSeconds = 0;
+    double cpuSeconds = 0; // Every thread of the process
+    std::uint64_t allocations = 0;
+    std::uint64_t allocatedBytes = 0;
+    std::int64_t peakHeapBytes = 0;  // The most heap in use at any point, everything before included
+    std::int64_t retainedBytes = 0;  // Heap still in use when the phase was done, what it leaves to the next ones
+    std::uint64_t peakRSSBytes = 0;
+    std::vector<std::pair<std::string, std::uint64_t>> counters; // Tokens, AST nodes, instructions...
+    PerfSample perf; // --perf-counters, see CompilerStatistics::getPerfCounters for which are real
+};
+
+// --stats, collected by the session around every phase. The time is the session's own, the CPU time,
+// allocations, heap and RSS are those of the whole process, see CompilerOptions::ownsProcess.
+class CompilerStatistics {
+public:
+    // Measures from construction to destruction, also when the phase throws
+    class Measurement {
+    public:
+        // A function is measured inside its phase, it leaves the phase's peaks alone
+        Measurement(CompilerStatistics* statistics, std::string phase, bool function = false);
+        ~Measurement();
+
+        Measurement(const Measurement&) = delete;
+        Measurement& operator=(const Measurement&) = delete;
+
+    private:
+        CompilerStatistics* statistics; // nullptr when statistics are off
+        std::string phase;
+        bool function;
+        std::chrono::steady_clock::time_point wallStart;
+        double cpuStart = 0;
+        std::uint64_t allocationsStart = 0;
+        std::uint64_t allocatedBytesStart = 0;
+        std::int64_t liveBytesStart = 0;
+        PerfSample perfStart;
+    };
+
+    // With hardwareCounters every phase and the IR generation of every function also read the
+    // perf counters, as far as the machine has them. With resetsPeakRSS every phase starts from
+    // the RSS it has instead of the process' peak so far.
+    explicit CompilerStatistics(bool enabled = false, bool hardwareCounters = false, bool resetsPeakRSS = false);
+
+    Measurement measure(const std::string& phase);
+    Measurement measureFunction(const std::string& function);
+    void count(const std::string& phase, const std::string& counter, std::uint64_t value);
+
+    bool isEnabled() const;
+    const std::vector<PhaseStatistics>& getPhases() const;
+    const std::vector<PhaseStatistics>& getFunctions() const;
+
+    // nullptr without hardware counters
+    const PerfCounters* getPerfCounters() const;
+
+    void print(std::ostream& stream) const;
+    void writeJSON(std::ostream& stream) const;
+
+private:
+    PhaseStatistics& findPhase(const std::string& phase);
+    PhaseStatistics& findFunction(const std::string& function);
+    void printPerf(std::ostream& stream, const PhaseStatistics& phase) const;
+    void writePerfJSON(std::ostream& stream, const PhaseStatistics& phase) const;
+
+    bool enabled;
+    bool resetsPeakRSS;
+    std::vector<PhaseStatistics> phases;
+    std::vector<PhaseStatistics> functions;
+    std::unordered_map<std::string, std::size_t> functionIndices;
+    std::unique_ptr<PerfCounters> perfCounters;
+};
+
+#endif  // STATS_HPP